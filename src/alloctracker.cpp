@@ -0,0 +1,254 @@
+#include "alloctracker.h"
+#include "stats.h"
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+static const char *const TagNames[AllocTracker::TagCount] = {
+    "untagged", "overlay", "network", "parsing", "rendering", "transcript"};
+
+const char *AllocTracker::name(Tag tag)
+{
+    return tag < TagCount ? TagNames[tag] : "?";
+}
+
+#ifdef D0_ALLOC_TRACKING
+
+// Constant-initialized, so allocations made during static initialization
+// are counted safely
+struct alignas(64) TagCounters
+{
+    std::atomic<qint64> liveBytes{0};
+    std::atomic<qint64> allocations{0};
+    std::atomic<qint64> allocatedBytes{0};
+};
+
+static TagCounters counters[AllocTracker::TagCount];
+static thread_local unsigned char currentTag = AllocTracker::Untagged;
+
+#if defined(__GLIBC__)
+#include <unistd.h>
+// QString, QByteArray and QJsonDocument storage comes from malloc, so on glibc
+// the malloc family is replaced too (glibc supports this) and forwards to the
+// libc allocator underneath
+extern "C" void *__libc_malloc(std::size_t size);
+extern "C" void __libc_free(void *pointer);
+#define rawAllocate __libc_malloc
+#define rawFree __libc_free
+#else
+#define rawAllocate std::malloc
+#define rawFree std::free
+#endif
+
+// Sits right before every block handed out; base is what rawAllocate returned
+struct alignas(16) BlockHeader
+{
+    void *base;
+    std::size_t size;
+    unsigned char tag;
+};
+
+static void *allocate(std::size_t size, std::size_t alignment = alignof(BlockHeader))
+{
+    std::size_t padding = alignment > alignof(BlockHeader) ? alignment : 0;
+    if (size > std::size_t(-1) - sizeof(BlockHeader) - padding)
+    {
+        return nullptr;
+    }
+    void *base = rawAllocate(size + sizeof(BlockHeader) + padding);
+    if (!base)
+    {
+        return nullptr;
+    }
+    std::uintptr_t user = reinterpret_cast<std::uintptr_t>(base) + sizeof(BlockHeader);
+    if (padding)
+    {
+        user = (user + alignment - 1) & ~std::uintptr_t(alignment - 1);
+    }
+    BlockHeader *header = reinterpret_cast<BlockHeader *>(user) - 1;
+    header->base = base;
+    header->size = size;
+    header->tag = currentTag;
+    TagCounters &tag = counters[currentTag];
+    tag.liveBytes.fetch_add(qint64(size), std::memory_order_relaxed);
+    tag.allocations.fetch_add(1, std::memory_order_relaxed);
+    tag.allocatedBytes.fetch_add(qint64(size), std::memory_order_relaxed);
+    return reinterpret_cast<void *>(user);
+}
+
+static void release(void *pointer)
+{
+    if (!pointer)
+    {
+        return;
+    }
+    BlockHeader *header = static_cast<BlockHeader *>(pointer) - 1;
+    counters[header->tag].liveBytes.fetch_sub(qint64(header->size), std::memory_order_relaxed);
+    rawFree(header->base);
+}
+
+static void *allocateOrThrow(std::size_t size)
+{
+    void *pointer = allocate(size);
+    if (!pointer)
+    {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void *operator new(std::size_t size) { return allocateOrThrow(size); }
+void *operator new[](std::size_t size) { return allocateOrThrow(size); }
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept { return allocate(size); }
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept { return allocate(size); }
+void operator delete(void *pointer) noexcept { release(pointer); }
+void operator delete[](void *pointer) noexcept { release(pointer); }
+void operator delete(void *pointer, std::size_t) noexcept { release(pointer); }
+void operator delete[](void *pointer, std::size_t) noexcept { release(pointer); }
+void operator delete(void *pointer, const std::nothrow_t &) noexcept { release(pointer); }
+void operator delete[](void *pointer, const std::nothrow_t &) noexcept { release(pointer); }
+// Over-aligned new/delete keep the library versions, which pair with each
+// other and are not counted
+
+#if defined(__GLIBC__)
+extern "C"
+{
+    void *malloc(std::size_t size) { return allocate(size); }
+    void free(void *pointer) { release(pointer); }
+
+    void *calloc(std::size_t count, std::size_t size)
+    {
+        if (size && count > std::size_t(-1) / size)
+        {
+            return nullptr;
+        }
+        void *pointer = allocate(count * size);
+        if (pointer)
+        {
+            std::memset(pointer, 0, count * size);
+        }
+        return pointer;
+    }
+
+    void *realloc(void *pointer, std::size_t size)
+    {
+        if (!pointer)
+        {
+            return allocate(size);
+        }
+        if (size == 0)
+        {
+            release(pointer);
+            return nullptr;
+        }
+        // Always moves, so the bytes are charged to the current tag
+        void *moved = allocate(size);
+        if (moved)
+        {
+            std::size_t old = (static_cast<BlockHeader *>(pointer) - 1)->size;
+            std::memcpy(moved, pointer, old < size ? old : size);
+            release(pointer);
+        }
+        return moved;
+    }
+
+    std::size_t malloc_usable_size(void *pointer)
+    {
+        return pointer ? (static_cast<BlockHeader *>(pointer) - 1)->size : 0;
+    }
+
+    void *memalign(std::size_t alignment, std::size_t size) { return allocate(size, alignment); }
+    void *aligned_alloc(std::size_t alignment, std::size_t size) { return allocate(size, alignment); }
+    void *valloc(std::size_t size) { return allocate(size, std::size_t(sysconf(_SC_PAGESIZE))); }
+
+    void *pvalloc(std::size_t size)
+    {
+        std::size_t page = std::size_t(sysconf(_SC_PAGESIZE));
+        return allocate((size + page - 1) & ~(page - 1), page);
+    }
+
+    int posix_memalign(void **out, std::size_t alignment, std::size_t size)
+    {
+        if (alignment < sizeof(void *) || (alignment & (alignment - 1)))
+        {
+            return EINVAL;
+        }
+        void *pointer = allocate(size, alignment);
+        if (!pointer)
+        {
+            return ENOMEM;
+        }
+        *out = pointer;
+        return 0;
+    }
+}
+#endif
+
+AllocScope::AllocScope(AllocTracker::Tag tag) : previous(currentTag)
+{
+    currentTag = tag;
+}
+
+AllocScope::~AllocScope()
+{
+    currentTag = previous;
+}
+
+AllocTracker::Usage AllocTracker::usage(Tag tag)
+{
+    Usage usage;
+    if (tag < TagCount)
+    {
+        usage.liveBytes = counters[tag].liveBytes.load(std::memory_order_relaxed);
+        usage.allocations = counters[tag].allocations.load(std::memory_order_relaxed);
+        usage.allocatedBytes = counters[tag].allocatedBytes.load(std::memory_order_relaxed);
+    }
+    return usage;
+}
+
+void AllocTracker::publish()
+{
+    for (int i = 0; i < TagCount; ++i)
+    {
+        Tag tag = Tag(i);
+        Usage current = usage(tag);
+        QString prefix = QString("alloc.") + name(tag);
+        Stats::instance()->set(prefix + ".live_bytes", current.liveBytes);
+        Stats::instance()->set(prefix + ".allocations", current.allocations);
+        Stats::instance()->set(prefix + ".allocated_bytes", current.allocatedBytes);
+    }
+}
+
+QByteArray AllocTracker::summary()
+{
+    QByteArray text;
+    for (int i = 0; i < TagCount; ++i)
+    {
+        Usage current = usage(Tag(i));
+        text += QByteArray(name(Tag(i))).leftJustified(12) + QByteArray::number(current.liveBytes).rightJustified(12) +
+                " live bytes " + QByteArray::number(current.allocations).rightJustified(10) + " allocations " +
+                QByteArray::number(current.allocatedBytes).rightJustified(14) + " bytes allocated\n";
+    }
+    return text;
+}
+
+#else
+
+AllocTracker::Usage AllocTracker::usage(Tag)
+{
+    return Usage();
+}
+
+void AllocTracker::publish()
+{
+}
+
+QByteArray AllocTracker::summary()
+{
+    return QByteArray();
+}
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef ALLOCTRACKER_H
+#define ALLOCTRACKER_H
+
+#include <QByteArray>
+
+// Heap usage per subsystem. Built only with -DD0_ALLOC_TRACKING=ON (ignored
+// for Release builds): the global operator new/delete then record every
+// allocation against the tag of the innermost AllocScope on the allocating
+// thread, and a free is credited back to the tag that made the allocation.
+// Without the option AllocScope is empty and publish()/summary() do nothing.
+class AllocTracker
+{
+public:
+    enum Tag : unsigned char
+    {
+        Untagged,
+        Overlay,   // ChatOverlay event handling
+        Network,   // reply buffers
+        Parsing,   // JSON and transcript import
+        Rendering, // paint and update requests
+        Transcript,
+        TagCount,
+    };
+
+    struct Usage
+    {
+        qint64 liveBytes = 0;
+        qint64 allocations = 0; // since start
+        qint64 allocatedBytes = 0;
+    };
+
+#ifdef D0_ALLOC_TRACKING
+    static constexpr bool Enabled = true;
+#else
+    static constexpr bool Enabled = false;
+#endif
+
+    static const char *name(Tag tag);
+    static Usage usage(Tag tag);
+    // Copies the counters into Stats as alloc.<tag>.live_bytes and friends
+    static void publish();
+    // One line per tag, for benchmark output
+    static QByteArray summary();
+};
+
+class AllocScope
+{
+public:
+#ifdef D0_ALLOC_TRACKING
+    explicit AllocScope(AllocTracker::Tag tag);
+    ~AllocScope();
+
+private:
+    unsigned char previous;
+#else
+    explicit AllocScope(AllocTracker::Tag) {}
+#endif
+    Q_DISABLE_COPY(AllocScope)
+};
+
+#endif // ALLOCTRACKER_H
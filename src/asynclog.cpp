@@ -0,0 +1,330 @@
+#include "asynclog.h"
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QList>
+#include <QMutex>
+#include <QStandardPaths>
+#include <QThread>
+#include <QWaitCondition>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+static const quint32 RingCapacity = 4096; // entries per logging thread, 512 KB
+static const qint64 MaxFileBytes = 8 * 1024 * 1024;
+static const int KeptFiles = 3; // d0.log.1 .. d0.log.3
+static const int DrainIntervalMs = 10; // while messages keep coming
+
+static qint64 steadyNanos()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int initialLevel()
+{
+    QByteArray level = qgetenv("D0_LOG_LEVEL").toLower();
+    if (level == "warning")
+    {
+        return AsyncLog::Warning;
+    }
+    return level == "info" ? AsyncLog::Info : AsyncLog::Debug;
+}
+
+std::atomic<int> AsyncLog::minimumLevel{initialLevel()};
+
+// Single producer (the owning thread), single consumer (whoever holds drainMutex)
+struct LogRing
+{
+    alignas(64) std::atomic<quint32> head{0};
+    alignas(64) std::atomic<quint32> tail{0};
+    std::atomic<qint64> dropped{0};
+    std::atomic<bool> retired{false}; // owning thread has exited
+    int thread = 0;
+    AsyncLog::Entry entries[RingCapacity];
+};
+
+struct LogWriter
+{
+    QMutex ringsMutex;
+    QList<LogRing *> rings;
+    int nextThread = 1;
+
+    QMutex drainMutex;
+    QFile file;
+    qint64 fileBytes = 0;
+    qint64 droppedTotal = 0;
+    bool echo = qgetenv("D0_LOG_STDERR") != "0";
+    QDateTime baseTime = QDateTime::currentDateTime();
+    qint64 baseNanos = steadyNanos();
+
+    QThread *thread = nullptr;
+    std::atomic<bool> stopping{false};
+
+    // An idle writer sleeps until a producer commits; it does not poll
+    QMutex wakeMutex;
+    QWaitCondition wakeCondition;
+    std::atomic<bool> idle{false};
+
+    LogWriter();
+    void run();
+    bool hasPending();
+    void wake();
+    void drain();
+    void write(const QByteArray &lines);
+    void rotate();
+};
+
+static LogWriter *writer()
+{
+    static LogWriter *w = new LogWriter;
+    return w;
+}
+
+struct RingHolder
+{
+    LogRing *ring = nullptr;
+    ~RingHolder()
+    {
+        if (ring)
+        {
+            ring->retired.store(true, std::memory_order_release);
+        }
+    }
+};
+
+static thread_local RingHolder holder;
+
+LogWriter::LogWriter()
+{
+    QString path = qEnvironmentVariable("D0_LOG_FILE");
+    if (path.isEmpty())
+    {
+        QString dir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/logs";
+        QDir().mkpath(dir);
+        path = dir + "/d0.log";
+    }
+    file.setFileName(path);
+    if (file.open(QIODevice::WriteOnly | QIODevice::Append))
+    {
+        fileBytes = file.size();
+    }
+
+    thread = QThread::create([this]()
+                             { run(); });
+    thread->start(QThread::LowPriority);
+    if (qApp)
+    {
+        QObject::connect(qApp, &QCoreApplication::aboutToQuit, &AsyncLog::shutdown);
+    }
+    else
+    {
+        std::atexit(&AsyncLog::shutdown);
+    }
+}
+
+void LogWriter::run()
+{
+    while (!stopping.load())
+    {
+        drain();
+        QMutexLocker locker(&wakeMutex);
+        // idle and the ring heads are seq_cst on both sides: either a
+        // producer sees idle and wakes us, or hasPending() sees its entry
+        idle.store(true);
+        if (!hasPending() && !stopping.load())
+        {
+            wakeCondition.wait(&wakeMutex);
+        }
+        idle.store(false);
+        locker.unlock();
+        QThread::msleep(DrainIntervalMs); // gather what follows into one write
+    }
+}
+
+bool LogWriter::hasPending()
+{
+    QMutexLocker locker(&ringsMutex);
+    for (LogRing *ring : std::as_const(rings))
+    {
+        if (ring->head.load() != ring->tail.load(std::memory_order_relaxed))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void LogWriter::wake()
+{
+    QMutexLocker locker(&wakeMutex);
+    wakeCondition.wakeOne();
+}
+
+AsyncLog::Entry *AsyncLog::beginEntry()
+{
+    LogRing *ring = holder.ring;
+    if (!ring)
+    {
+        LogWriter *w = writer();
+        ring = new LogRing;
+        QMutexLocker locker(&w->ringsMutex);
+        ring->thread = w->nextThread++;
+        w->rings.append(ring);
+        holder.ring = ring;
+    }
+    quint32 head = ring->head.load(std::memory_order_relaxed);
+    if (head - ring->tail.load(std::memory_order_acquire) >= RingCapacity)
+    {
+        ring->dropped.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    Entry *entry = &ring->entries[head % RingCapacity];
+    entry->nanos = steadyNanos();
+    return entry;
+}
+
+void AsyncLog::commitEntry()
+{
+    LogRing *ring = holder.ring;
+    ring->head.store(ring->head.load(std::memory_order_relaxed) + 1); // seq_cst: before the idle check
+    LogWriter *w = writer();
+    if (w->stopping.load(std::memory_order_relaxed))
+    {
+        w->drain(); // after shutdown messages are written synchronously
+    }
+    else if (w->idle.load())
+    {
+        w->wake();
+    }
+}
+
+QByteArray AsyncLog::format(const Entry &entry)
+{
+    QByteArray text;
+    int next = 0;
+    for (const char *p = entry.format; *p; ++p)
+    {
+        if (p[0] == '{' && p[1] == '}' && next < entry.count)
+        {
+            const Arg &arg = entry.args[next++];
+            switch (arg.type)
+            {
+            case Arg::Int:
+                text += QByteArray::number(arg.i);
+                break;
+            case Arg::UInt:
+                text += QByteArray::number(arg.u);
+                break;
+            case Arg::Double:
+                text += QByteArray::number(arg.d, 'g', 6);
+                break;
+            case Arg::Text:
+                text += arg.text ? arg.text : "(null)";
+                break;
+            }
+            ++p;
+            continue;
+        }
+        text += *p;
+    }
+    return text;
+}
+
+void LogWriter::drain()
+{
+    static const char LevelNames[] = {'D', 'I', 'W'};
+
+    QMutexLocker locker(&drainMutex);
+    QByteArray lines;
+    QList<LogRing *> snapshot;
+    {
+        QMutexLocker ringsLocker(&ringsMutex);
+        snapshot = rings;
+    }
+    for (LogRing *ring : snapshot)
+    {
+        // Read retired before head so a ring is only freed once fully drained
+        bool retired = ring->retired.load(std::memory_order_acquire);
+        quint32 tail = ring->tail.load(std::memory_order_relaxed);
+        quint32 head = ring->head.load(std::memory_order_acquire);
+        for (; tail != head; ++tail)
+        {
+            const AsyncLog::Entry &entry = ring->entries[tail % RingCapacity];
+            QDateTime time = baseTime.addMSecs((entry.nanos - baseNanos) / 1000000);
+            lines += time.toString("yyyy-MM-dd hh:mm:ss.zzz").toLatin1() + ' ' + LevelNames[entry.level] +
+                     " [t" + QByteArray::number(ring->thread) + "] " + AsyncLog::format(entry) + '\n';
+        }
+        ring->tail.store(tail, std::memory_order_release);
+
+        qint64 dropped = ring->dropped.exchange(0, std::memory_order_relaxed);
+        if (dropped > 0)
+        {
+            droppedTotal += dropped;
+            lines += "[t" + QByteArray::number(ring->thread) + "] " + QByteArray::number(dropped) + " messages dropped\n";
+        }
+        if (retired)
+        {
+            QMutexLocker ringsLocker(&ringsMutex);
+            rings.removeOne(ring);
+            delete ring;
+        }
+    }
+    if (!lines.isEmpty())
+    {
+        write(lines);
+    }
+}
+
+void LogWriter::write(const QByteArray &lines)
+{
+    if (echo)
+    {
+        fwrite(lines.constData(), 1, size_t(lines.size()), stderr);
+    }
+    if (!file.isOpen())
+    {
+        return;
+    }
+    if (fileBytes + lines.size() > MaxFileBytes)
+    {
+        rotate();
+    }
+    file.write(lines);
+    file.flush();
+    fileBytes += lines.size();
+}
+
+void LogWriter::rotate()
+{
+    QString path = file.fileName();
+    file.close();
+    QFile::remove(path + '.' + QString::number(KeptFiles));
+    for (int i = KeptFiles - 1; i >= 1; --i)
+    {
+        QFile::rename(path + '.' + QString::number(i), path + '.' + QString::number(i + 1));
+    }
+    QFile::rename(path, path + ".1");
+    file.open(QIODevice::WriteOnly | QIODevice::Truncate);
+    fileBytes = 0;
+}
+
+void AsyncLog::shutdown()
+{
+    LogWriter *w = writer();
+    if (w->stopping.exchange(true))
+    {
+        return;
+    }
+    w->wake();
+    w->thread->wait();
+    w->drain();
+}
+
+qint64 AsyncLog::dropped()
+{
+    LogWriter *w = writer();
+    QMutexLocker locker(&w->drainMutex);
+    return w->droppedTotal;
+}
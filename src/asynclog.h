@@ -0,0 +1,142 @@
+#ifndef ASYNCLOG_H
+#define ASYNCLOG_H
+
+#include <QtGlobal>
+#include <atomic>
+#include <type_traits>
+
+// Logging for hot paths such as CustomApplication::notify. A call copies a
+// format literal and its raw arguments into a ring buffer owned by the
+// calling thread; a background thread formats them, echoes them to stderr and
+// appends them to a log file that rotates at 8 MB. That thread sleeps until
+// something is logged, so it does not wake an idle process. A full ring
+// drops the message and counts the drop instead of blocking.
+//
+//     AsyncLog::info("capture attached in {} ms", latencyMs);
+//
+// Arguments are integers, floating point values, bools and string literals
+// (the pointer is kept, not the text). $D0_LOG_FILE overrides the file,
+// $D0_LOG_LEVEL=warning drops debug and info messages at the call site and
+// $D0_LOG_STDERR=0 turns the echo off.
+class AsyncLog
+{
+public:
+    enum Level : quint8
+    {
+        Debug,
+        Info,
+        Warning,
+    };
+
+    struct Arg
+    {
+        enum Type : quint8
+        {
+            Int,
+            UInt,
+            Double,
+            Text,
+        };
+        Type type;
+        union
+        {
+            qint64 i;
+            quint64 u;
+            double d;
+            const char *text;
+        };
+    };
+
+    static constexpr int MaxArgs = 6;
+
+    struct Entry
+    {
+        qint64 nanos; // steady clock
+        const char *format;
+        Level level;
+        quint8 count;
+        Arg args[MaxArgs];
+    };
+
+    template <typename... Args>
+    static void debug(const char *format, Args... args) { write(Debug, format, args...); }
+    template <typename... Args>
+    static void info(const char *format, Args... args) { write(Info, format, args...); }
+    template <typename... Args>
+    static void warning(const char *format, Args... args) { write(Warning, format, args...); }
+
+    template <typename... Args>
+    static void write(Level level, const char *format, Args... args)
+    {
+        static_assert(sizeof...(Args) <= MaxArgs, "too many log arguments");
+        if (level < minimumLevel.load(std::memory_order_relaxed))
+        {
+            return;
+        }
+        Entry *entry = beginEntry();
+        if (!entry)
+        {
+            return; // ring full, drop counted
+        }
+        entry->format = format;
+        entry->level = level;
+        entry->count = quint8(sizeof...(Args));
+        [[maybe_unused]] int index = 0;
+        ((entry->args[index++] = toArg(args)), ...);
+        commitEntry();
+    }
+
+    // Formats "{}" placeholders; used by the writer thread and tests
+    static QByteArray format(const Entry &entry);
+
+    // Drains every ring and stops the writer; called on aboutToQuit
+    static void shutdown();
+    // Messages dropped because a ring was full
+    static qint64 dropped();
+
+private:
+    template <typename T>
+    static Arg toArg(T value)
+    {
+        Arg arg;
+        if constexpr (std::is_same_v<T, bool>)
+        {
+            arg.type = Arg::Text;
+            arg.text = value ? "true" : "false";
+        }
+        else if constexpr (std::is_enum_v<T>)
+        {
+            arg.type = Arg::Int;
+            arg.i = qint64(value);
+        }
+        else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>)
+        {
+            arg.type = Arg::Int;
+            arg.i = value;
+        }
+        else if constexpr (std::is_integral_v<T>)
+        {
+            arg.type = Arg::UInt;
+            arg.u = value;
+        }
+        else if constexpr (std::is_floating_point_v<T>)
+        {
+            arg.type = Arg::Double;
+            arg.d = value;
+        }
+        else
+        {
+            static_assert(std::is_convertible_v<T, const char *>, "log arguments must be numbers or string literals");
+            arg.type = Arg::Text;
+            arg.text = value;
+        }
+        return arg;
+    }
+
+    static Entry *beginEntry();
+    static void commitEntry();
+
+    static std::atomic<int> minimumLevel;
+};
+
+#endif // ASYNCLOG_H
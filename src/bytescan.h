@@ -0,0 +1,74 @@
+#ifndef BYTESCAN_H
+#define BYTESCAN_H
+
+#include <QtEndian>
+#include <QtGlobal>
+
+// SWAR byte search: eight bytes per step in a 64-bit word. zeroBytes() sets
+// the high bit of exactly those bytes of v that are zero (no false positives
+// from borrows, unlike the shorter (v - 0x01..) & ~v form).
+namespace ByteScan
+{
+    inline quint64 zeroBytes(quint64 v)
+    {
+        const quint64 low7 = 0x7f7f7f7f7f7f7f7fULL;
+        return ~(((v & low7) + low7) | v | low7);
+    }
+
+    inline quint64 matchBytes(quint64 word, uchar c)
+    {
+        return zeroBytes(word ^ (0x0101010101010101ULL * c));
+    }
+
+    inline quint64 load(const char *p)
+    {
+        return qFromLittleEndian<quint64>(p);
+    }
+
+    // Offset of the first set high bit, in bytes
+    inline int firstMatch(quint64 mask)
+    {
+        return qCountTrailingZeroBits(mask) / 8;
+    }
+
+    // First c in [p, end), or end
+    inline const char *find(const char *p, const char *end, uchar c)
+    {
+        while (end - p >= 8)
+        {
+            quint64 mask = matchBytes(load(p), c);
+            if (mask)
+            {
+                return p + firstMatch(mask);
+            }
+            p += 8;
+        }
+        while (p < end && uchar(*p) != c)
+        {
+            ++p;
+        }
+        return p;
+    }
+
+    // First a or b in [p, end), or end; for case-insensitive letters
+    inline const char *findEither(const char *p, const char *end, uchar a, uchar b)
+    {
+        while (end - p >= 8)
+        {
+            quint64 word = load(p);
+            quint64 mask = matchBytes(word, a) | matchBytes(word, b);
+            if (mask)
+            {
+                return p + firstMatch(mask);
+            }
+            p += 8;
+        }
+        while (p < end && uchar(*p) != a && uchar(*p) != b)
+        {
+            ++p;
+        }
+        return p;
+    }
+}
+
+#endif // BYTESCAN_H
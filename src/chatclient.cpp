@@ -0,0 +1,742 @@
+#include "chatclient.h"
+#include "alloctracker.h"
+#include <QCoreApplication>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QCryptographicHash>
+#include "requestbatcher.h"
+#include "responsecache.h"
+#include "stats.h"
+#include "stopmatcher.h"
+#include "toolexecutor.h"
+
+double StreamMetrics::tokensPerSecond() const
+{
+    // Generation rate after the first token, so TTFT does not skew it
+    qint64 generationMs = totalMs - qMax<qint64>(timeToFirstTokenMs, 0);
+    if (tokens == 0 || generationMs <= 0)
+    {
+        return 0.0;
+    }
+    return tokens * 1000.0 / generationMs;
+}
+
+InFlightReply::InFlightReply(QNetworkReply *reply) : reply(nullptr)
+{
+    clock.start();
+    attach(reply);
+}
+
+InFlightReply::InFlightReply(const QString &cachedText) : reply(nullptr)
+{
+    clock.start();
+    // Consumers connect after send() returns, so deliver like a network reply would
+    QMetaObject::invokeMethod(this, [this, cachedText]()
+                              {
+                                  if (done)
+                                  {
+                                      return; // aborted first
+                                  }
+                                  received = cachedText;
+                                  tokenCount = cachedText.size() / 4;
+                                  firstByteMs = endMs = clock.elapsed();
+                                  done = true;
+                                  emit readyRead();
+                                  emit finished();
+                              }, Qt::QueuedConnection);
+}
+
+InFlightReply::InFlightReply() : reply(nullptr)
+{
+    clock.start();
+}
+
+InFlightReply::~InFlightReply() = default;
+
+void InFlightReply::setStopConditions(const ChatRequest &request)
+{
+    maxTokens = request.maxTokens;
+    stopSequences = request.stopSequences;
+    stopOnRepetition = request.stopOnRepetition;
+    armStopConditions();
+}
+
+void InFlightReply::armStopConditions()
+{
+    stopMatcher.reset();
+    repetition.reset();
+    if (!stopSequences.isEmpty())
+    {
+        stopMatcher = std::make_unique<StopMatcher>(stopSequences);
+        if (stopMatcher->isEmpty())
+        {
+            stopMatcher.reset();
+        }
+    }
+    if (stopOnRepetition)
+    {
+        repetition = std::make_unique<RepetitionDetector>();
+    }
+}
+
+void InFlightReply::setSchema(const QJsonObject &replySchema, int retries, std::function<QNetworkReply *()> resendRequest)
+{
+    schema = replySchema;
+    retriesLeft = retries;
+    resend = std::move(resendRequest);
+    validator = std::make_unique<JsonStreamValidator>(schema);
+}
+
+const QList<JsonField> &InFlightReply::validatedFields() const
+{
+    static const QList<JsonField> none;
+    return validator ? validator->fields() : none;
+}
+
+void InFlightReply::attach(QNetworkReply *networkReply)
+{
+    reply = networkReply;
+    reply->setParent(this);
+    reply->setReadBufferSize(ReadBufferBytes);
+    connect(reply, &QNetworkReply::readyRead, this, &InFlightReply::onReplyReadyRead);
+    connect(reply, &QNetworkReply::finished, this, &InFlightReply::onReplyFinished);
+}
+
+void InFlightReply::complete(const QByteArray &body)
+{
+    firstByteMs = endMs = clock.elapsed();
+    buffer = body;
+    eventStream = false;
+    done = true;
+    if (!validateCompleted())
+    {
+        return;
+    }
+    emit readyRead();
+    emit finished();
+}
+
+void InFlightReply::fail(const QString &message, QNetworkReply::NetworkError code)
+{
+    firstByteMs = endMs = clock.elapsed();
+    error = message;
+    networkError = code;
+    done = true;
+    emit finished();
+}
+
+void InFlightReply::onReplyReadyRead()
+{
+    AllocScope scope(AllocTracker::Network);
+    if (firstByteMs < 0)
+    {
+        firstByteMs = clock.elapsed();
+        eventStream = reply->header(QNetworkRequest::ContentTypeHeader).toString().startsWith("text/event-stream");
+    }
+    if (pull())
+    {
+        if (stopMatcher || repetition || validator)
+        {
+            decodeBuffered(); // stop conditions and the schema must see text as soon as it arrives
+        }
+        emit readyRead();
+    }
+}
+
+// Moves bytes out of the reply while the raw and decoded backlogs allow it.
+// Returns true if anything was read.
+bool InFlightReply::pull()
+{
+    bool moved = false;
+    while (reply && reply->bytesAvailable() > 0)
+    {
+        if (received.size() - delivered >= MaxPendingChars)
+        {
+            if (!paused)
+            {
+                paused = true;
+                Stats::instance()->add("chat.backpressure.pauses");
+            }
+            return moved;
+        }
+        // A plain JSON body only parses whole; it is bounded by max_tokens instead
+        if (eventStream && buffer.size() >= MaxRawBytes)
+        {
+            qsizetype before = buffer.size();
+            decodeBuffered();
+            if (buffer.size() == before)
+            {
+                return moved; // one line larger than the cap; wait for it to be consumed
+            }
+            continue;
+        }
+        qint64 room = eventStream ? MaxRawBytes - buffer.size() : reply->bytesAvailable();
+        buffer += reply->read(room);
+        moved = true;
+    }
+    if (paused)
+    {
+        paused = false;
+        Stats::instance()->add("chat.backpressure.resumes");
+    }
+    return moved;
+}
+
+void InFlightReply::markDelivered(qsizetype position)
+{
+    delivered = qMax(delivered, position);
+    if (paused && pull())
+    {
+        emit readyRead();
+    }
+}
+
+void InFlightReply::onReplyFinished()
+{
+    endMs = clock.elapsed();
+    buffer += reply->readAll();
+    if (reply->error() != QNetworkReply::NoError)
+    {
+        error = reply->errorString();
+        networkError = reply->error();
+    }
+    else if (firstByteMs < 0)
+    {
+        eventStream = reply->header(QNetworkRequest::ContentTypeHeader).toString().startsWith("text/event-stream");
+    }
+    done = true;
+    reply->deleteLater();
+    reply = nullptr;
+    if (!validateCompleted())
+    {
+        return;
+    }
+    emit finished();
+}
+
+void InFlightReply::abort()
+{
+    if (reply)
+    {
+        reply->abort(); // emits finished with OperationCanceledError
+    }
+    else if (!done && stopReason.isEmpty() && error.isEmpty())
+    {
+        fail(QStringLiteral("Operation canceled"), QNetworkReply::OperationCanceledError); // still waiting in a batch
+    }
+}
+
+void InFlightReply::mergeToolCall(int index, const QJsonObject &call)
+{
+    while (toolCalls.size() <= index)
+    {
+        toolCalls.append(ToolCall());
+    }
+    ToolCall &merged = toolCalls[index];
+    QJsonObject function = call["function"].toObject();
+    if (call.contains("id"))
+    {
+        merged.id = call["id"].toString();
+    }
+    if (function.contains("name"))
+    {
+        merged.name = function["name"].toString();
+    }
+    merged.arguments += function["arguments"].toString();
+}
+
+void InFlightReply::parseBuffered()
+{
+    decodeBuffered();
+    // Decoding made room in the raw buffer; refill it for the next read
+    if (buffer.size() < MaxRawBytes && pull())
+    {
+        decodeBuffered();
+    }
+}
+
+void InFlightReply::decodeBuffered()
+{
+    AllocScope scope(AllocTracker::Parsing);
+    int startAttempt = attempt;
+    if (!eventStream)
+    {
+        if (done && !buffer.isEmpty())
+        {
+            // Server ignored "stream": the whole completion arrives as one document
+            QJsonObject jsonObject = QJsonDocument::fromJson(buffer).object();
+            QJsonObject choice = jsonObject["choices"].toArray().at(0).toObject();
+            appendText(choice["text"].toString());
+            if (attempt != startAttempt)
+            {
+                return; // rejected by the schema
+            }
+            QJsonArray calls = choice.contains("message") ? choice["message"].toObject()["tool_calls"].toArray() : choice["tool_calls"].toArray();
+            for (int i = 0; i < calls.size(); ++i)
+            {
+                mergeToolCall(i, calls.at(i).toObject());
+            }
+            tokenCount = jsonObject["usage"].toObject()["completion_tokens"].toInt(received.size() / 4);
+            buffer.clear();
+            received += heldBack;
+            heldBack.clear();
+        }
+        return;
+    }
+
+    // Server-sent events: "data: {json}" lines, terminated by "data: [DONE]"
+    int lineStart = 0;
+    int lineEnd;
+    while ((lineEnd = buffer.indexOf('\n', lineStart)) != -1)
+    {
+        QByteArray line = buffer.mid(lineStart, lineEnd - lineStart).trimmed();
+        lineStart = lineEnd + 1;
+        if (!line.startsWith("data:"))
+        {
+            continue;
+        }
+        QByteArray payload = line.mid(5).trimmed();
+        if (payload == "[DONE]")
+        {
+            continue;
+        }
+        QJsonObject choice = QJsonDocument::fromJson(payload).object()["choices"].toArray().at(0).toObject();
+        if (choice.contains("delta"))
+        {
+            QJsonObject delta = choice["delta"].toObject();
+            appendText(delta["content"].toString());
+            // Tool calls stream in pieces keyed by index; arguments arrive as text fragments
+            for (const QJsonValue &call : delta["tool_calls"].toArray())
+            {
+                mergeToolCall(call.toObject()["index"].toInt(), call.toObject());
+            }
+        }
+        else
+        {
+            appendText(choice["text"].toString());
+        }
+        if (attempt != startAttempt)
+        {
+            return; // rejected by the schema; the buffer belonged to the old reply
+        }
+        ++tokenCount; // one event per generated token
+    }
+    buffer.remove(0, lineStart);
+    if (!stopReason.isEmpty())
+    {
+        buffer.clear(); // generated past the stop; never shown
+    }
+    else if (done && !heldBack.isEmpty())
+    {
+        received += heldBack; // the reply ended inside what could have been a stop string
+        heldBack.clear();
+    }
+}
+
+void InFlightReply::appendText(const QString &text)
+{
+    if (!stopReason.isEmpty() || !error.isEmpty())
+    {
+        return;
+    }
+    if (validator && !validator->feed(text))
+    {
+        rejectReply();
+        return;
+    }
+    if (!stopMatcher && !repetition)
+    {
+        received += text;
+        return;
+    }
+    // Both report positions counted from the start of the reply
+    qsizetype cut = stopMatcher ? stopMatcher->feed(text) : -1;
+    const char *reason = "stop";
+    if (repetition)
+    {
+        qsizetype loop = repetition->feed(text);
+        if (loop >= 0 && (cut < 0 || loop < cut))
+        {
+            cut = loop;
+            reason = "repetition";
+        }
+    }
+    heldBack += text;
+    if (cut >= 0)
+    {
+        received += heldBack;
+        heldBack.clear();
+        stopEarly(reason, cut);
+        return;
+    }
+    qsizetype ready = heldBack.size() - (stopMatcher ? stopMatcher->pending() : 0);
+    received += QStringView(heldBack).left(ready);
+    heldBack.remove(0, ready);
+}
+
+void InFlightReply::stopEarly(const char *reason, qsizetype cut)
+{
+    stopReason = QString::fromLatin1(reason);
+    received.truncate(qMax(cut, delivered)); // text a consumer already read stays
+    Stats::instance()->add(QString("chat.stop.") + reason);
+    if (!reply)
+    {
+        return; // the whole reply was generated already
+    }
+
+    // What the rest would have cost, at the rate the reply came in so far
+    qint64 elapsed = clock.elapsed();
+    tokensSaved = qMax(0, maxTokens - tokenCount);
+    qint64 generatingMs = elapsed - qMax<qint64>(firstByteMs, 0);
+    if (tokenCount > 0)
+    {
+        msSaved = tokensSaved * generatingMs / tokenCount;
+    }
+    Stats::instance()->add("chat.stop.tokens_saved", tokensSaved);
+    Stats::instance()->add("chat.stop.ms_saved", msSaved);
+
+    // Close the connection now, but finish on the next pass: this may run
+    // inside a consumer's readText()
+    detachReply();
+    endMs = elapsed;
+    QMetaObject::invokeMethod(this, [this]()
+                              {
+                                  done = true;
+                                  emit finished();
+                              }, Qt::QueuedConnection);
+}
+
+void InFlightReply::detachReply()
+{
+    if (!reply)
+    {
+        return;
+    }
+    QNetworkReply *closing = reply;
+    reply = nullptr;
+    disconnect(closing, nullptr, this, nullptr);
+    closing->abort();
+    closing->deleteLater();
+}
+
+// Runs the schema over a reply that is complete. False if it was rejected:
+// it is then being generated again, or fails on the next pass.
+bool InFlightReply::validateCompleted()
+{
+    if (!validator || !error.isEmpty() || !stopReason.isEmpty())
+    {
+        return true;
+    }
+    int before = attempt;
+    decodeBuffered();
+    if (attempt != before)
+    {
+        return false;
+    }
+    if (!validator->finish())
+    {
+        rejectReply();
+        return false;
+    }
+    return true;
+}
+
+void InFlightReply::rejectReply()
+{
+    ++attempt;
+    QString reason = validator->error();
+    Stats::instance()->add("chat.schema.rejected");
+    Stats::instance()->add("chat.schema.rejected_chars", received.size() + heldBack.size());
+    detachReply();
+
+    if (retriesLeft > 0 && resend)
+    {
+        // Start over; consumers are told on the next pass, before the new reply can deliver anything
+        --retriesLeft;
+        Stats::instance()->add("chat.schema.retries");
+        received.clear();
+        heldBack.clear();
+        buffer.clear();
+        toolCalls.clear();
+        delivered = 0;
+        tokenCount = 0;
+        firstByteMs = endMs = -1;
+        eventStream = paused = done = false;
+        validator = std::make_unique<JsonStreamValidator>(schema);
+        armStopConditions();
+        QMetaObject::invokeMethod(this, &InFlightReply::restarted, Qt::QueuedConnection);
+        attach(resend());
+        return;
+    }
+
+    Stats::instance()->add("chat.schema.failed");
+    error = "Reply does not match the schema: " + reason;
+    networkError = QNetworkReply::UnknownContentError;
+    endMs = clock.elapsed();
+    QMetaObject::invokeMethod(this, [this]()
+                              {
+                                  done = true;
+                                  emit finished();
+                              }, Qt::QueuedConnection);
+}
+
+ChatStream::ChatStream(const ChatRequest &request, std::shared_ptr<InFlightReply> shared, bool coalesced, QObject *parent)
+    : QObject(parent), chatRequest(request), shared(std::move(shared)), coalesced(coalesced)
+{
+    connect(this->shared.get(), &InFlightReply::readyRead, this, &ChatStream::readyRead);
+    connect(this->shared.get(), &InFlightReply::finished, this, &ChatStream::finished);
+    connect(this->shared.get(), &InFlightReply::restarted, this, [this]()
+            {
+                readPosition = 0;
+                fieldPosition = 0;
+                emit restarted();
+            });
+}
+
+ChatStream::~ChatStream() = default;
+
+QString ChatStream::readText()
+{
+    if (cancelled)
+    {
+        return QString();
+    }
+    shared->parseBuffered();
+    QString fresh = shared->received.mid(readPosition);
+    readPosition = shared->received.size();
+    shared->markDelivered(readPosition);
+    return fresh;
+}
+
+void ChatStream::keepReceiving()
+{
+    if (cancelled)
+    {
+        return;
+    }
+    shared->parseBuffered();
+    shared->markDelivered(shared->received.size());
+}
+
+QList<JsonField> ChatStream::readFields()
+{
+    if (cancelled)
+    {
+        return QList<JsonField>();
+    }
+    shared->parseBuffered();
+    const QList<JsonField> &fields = shared->validatedFields();
+    QList<JsonField> fresh = fields.mid(fieldPosition);
+    fieldPosition = fields.size();
+    return fresh;
+}
+
+QString ChatStream::errorString() const
+{
+    return cancelled ? QStringLiteral("Operation canceled") : shared->error;
+}
+
+QNetworkReply::NetworkError ChatStream::networkError() const
+{
+    return cancelled ? QNetworkReply::OperationCanceledError : shared->networkError;
+}
+
+StreamMetrics ChatStream::metrics() const
+{
+    StreamMetrics metrics;
+    metrics.timeToFirstTokenMs = shared->firstByteMs;
+    metrics.totalMs = shared->endMs;
+    metrics.tokens = shared->tokenCount;
+    metrics.stopReason = shared->stopReason;
+    metrics.tokensSaved = shared->tokensSaved;
+    metrics.msSaved = shared->msSaved;
+    return metrics;
+}
+
+void ChatStream::abort()
+{
+    if (isFinished())
+    {
+        return;
+    }
+    cancelled = true;
+    disconnect(shared.get(), nullptr, this, nullptr);
+    if (shared.use_count() == 1)
+    {
+        shared->abort();
+    }
+    emit finished();
+}
+
+ChatClient *ChatClient::instance()
+{
+    static ChatClient *client = new ChatClient(qApp);
+    return client;
+}
+
+ChatClient::ChatClient(QObject *parent)
+    : QObject(parent), manager(new QNetworkAccessManager(this))
+{
+    manager->setObjectName("networkManager");
+
+    QString url = qEnvironmentVariable("D0_API_URL");
+    defaultEndpoint = QUrl(url.isEmpty() ? QStringLiteral("https://api.openai.com/v1/engines/davinci-codex/completions") : url);
+    apiKey = qgetenv("D0_API_KEY");
+    if (apiKey.isEmpty())
+    {
+        apiKey = "YOUR_API_KEY";
+    }
+    if (qgetenv("D0_BATCH") != "0")
+    {
+        batcher = new RequestBatcher([this](const QUrl &url, const QByteArray &body)
+                                     { return post(url, body); },
+                                     this);
+    }
+}
+
+bool ChatClient::isBatching(const QUrl &endpoint) const
+{
+    return batcher && batcher->supports(endpoint.isEmpty() ? defaultEndpoint : endpoint);
+}
+
+QNetworkReply *ChatClient::post(const QUrl &url, const QByteArray &body)
+{
+    QNetworkRequest request(url);
+    request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
+    request.setRawHeader("Authorization", "Bearer " + apiKey);
+    return manager->post(request, body);
+}
+
+QString ChatClient::normalizedPrompt(const QString &prompt)
+{
+    QString normalized = prompt.normalized(QString::NormalizationForm_C);
+    normalized.replace("\r\n", "\n");
+    return normalized.trimmed();
+}
+
+QByteArray ChatClient::requestBody(const ChatRequest &chatRequest) const
+{
+    // QJsonObject keeps keys sorted, so equal requests serialize to equal bytes
+    QJsonObject json;
+    json["prompt"] = normalizedPrompt(chatRequest.prompt);
+    json["max_tokens"] = chatRequest.maxTokens;
+    json["stream"] = true;
+    if (!chatRequest.model.isEmpty())
+    {
+        json["model"] = chatRequest.model;
+    }
+    if (!chatRequest.attachments.isEmpty())
+    {
+        QJsonArray images;
+        for (const ImageAttachment &attachment : chatRequest.attachments)
+        {
+            images.append(QString::fromLatin1("data:" + attachment.mimeType + ";base64," + attachment.data.toBase64()));
+        }
+        json["images"] = images;
+    }
+    if (!chatRequest.responseSchema.isEmpty())
+    {
+        QJsonObject format{{"name", "reply"}, {"schema", chatRequest.responseSchema}, {"strict", true}};
+        json["response_format"] = QJsonObject{{"type", "json_schema"}, {"json_schema", format}};
+    }
+    if (chatRequest.tools)
+    {
+        json["tools"] = ToolExecutor::definitions();
+    }
+    if (!chatRequest.toolResults.isEmpty())
+    {
+        QJsonArray calls;
+        for (const ToolCall &call : chatRequest.toolCalls)
+        {
+            calls.append(QJsonObject{{"id", call.id}, {"name", call.name}, {"arguments", call.arguments}});
+        }
+        QJsonArray results;
+        for (const ToolResult &result : chatRequest.toolResults)
+        {
+            results.append(QJsonObject{{"tool_call_id", result.callId}, {"output", result.output}});
+        }
+        json["tool_calls"] = calls;
+        json["tool_results"] = results;
+    }
+    return QJsonDocument(json).toJson(QJsonDocument::Compact);
+}
+
+ChatStream *ChatClient::send(const ChatRequest &chatRequest, QObject *parent)
+{
+    QUrl url = chatRequest.endpoint.isEmpty() ? defaultEndpoint : chatRequest.endpoint;
+    QByteArray body = requestBody(chatRequest);
+    QByteArray identity = url.toEncoded() + '\n' + body;
+    if (!chatRequest.stopSequences.isEmpty() || chatRequest.stopOnRepetition)
+    {
+        // Client-side stop conditions change the answer without changing the body
+        identity += '\n' + chatRequest.stopSequences.join(QChar(0)).toUtf8() + (chatRequest.stopOnRepetition ? "\n1" : "\n0");
+    }
+    QByteArray key = QCryptographicHash::hash(identity, QCryptographicHash::Sha256);
+
+    if (std::shared_ptr<InFlightReply> existing = inFlight.value(key).lock())
+    {
+        Stats::instance()->add("chat.singleflight.joined");
+        return new ChatStream(chatRequest, existing, true, parent);
+    }
+
+    // Another instance (or an earlier run) may already have the answer. JSON
+    // mode replies are not cached: their consumers read validated fields,
+    // which only come from a reply that streams through the validator.
+    bool cacheable = chatRequest.responseSchema.isEmpty();
+    QString cachedText;
+    if (cacheable && ResponseCache::instance()->lookup(key, &cachedText))
+    {
+        std::shared_ptr<InFlightReply> cached(new InFlightReply(cachedText), [](InFlightReply *reply)
+                                              { reply->deleteLater(); });
+        return new ChatStream(chatRequest, cached, false, parent);
+    }
+
+    // The last subscriber to go away aborts the reply if it is still running
+    InFlightReply *raw;
+    if (chatRequest.background && batcher && batcher->supports(url))
+    {
+        raw = new InFlightReply;
+        batcher->add(url, body, raw);
+    }
+    else
+    {
+        raw = new InFlightReply(post(url, body));
+    }
+    raw->setStopConditions(chatRequest);
+    if (!chatRequest.responseSchema.isEmpty())
+    {
+        raw->setSchema(chatRequest.responseSchema, chatRequest.schemaRetries, [this, url, body]()
+                       { return post(url, body); });
+    }
+    std::shared_ptr<InFlightReply> shared(raw, [](InFlightReply *reply)
+                                          {
+                                              reply->abort();
+                                              reply->deleteLater();
+                                          });
+    inFlight.insert(key, shared);
+    connect(raw, &InFlightReply::finished, this, [this, key, raw, cacheable]()
+            {
+                // Only drop the entry if it is still ours; a newer identical request may have replaced it
+                auto it = inFlight.find(key);
+                if (it != inFlight.end() && (it->expired() || it->lock().get() == raw))
+                {
+                    inFlight.erase(it);
+                }
+                // Plain text answers are shared with other instances; tool calls are not replayable
+                if (raw->error.isEmpty() && cacheable)
+                {
+                    raw->parseBuffered();
+                    if (raw->toolCalls.isEmpty() && !raw->received.isEmpty())
+                    {
+                        ResponseCache::instance()->store(key, raw->received);
+                    }
+                }
+            });
+
+    Stats::instance()->add("chat.singleflight.leaders");
+    return new ChatStream(chatRequest, shared, false, parent);
+}
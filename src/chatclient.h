@@ -0,0 +1,290 @@
+#ifndef CHATCLIENT_H
+#define CHATCLIENT_H
+
+#include <QObject>
+#include <QUrl>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QUuid>
+#include <QSize>
+#include <QStringList>
+#include <QNetworkReply>
+#include <QJsonObject>
+#include <functional>
+#include <memory>
+#include "jsonstreamvalidator.h"
+
+class QNetworkAccessManager;
+class RequestBatcher;
+class StopMatcher;
+class RepetitionDetector;
+
+struct ImageAttachment
+{
+    QByteArray mimeType;
+    QByteArray data; // encoded image
+    QSize size;
+};
+
+// A local tool the reply asks the client to run (see ToolExecutor)
+struct ToolCall
+{
+    QString id;
+    QString name;
+    QString arguments; // JSON object text
+};
+
+struct ToolResult
+{
+    QString callId;
+    QString name;
+    QString output;
+    bool ok = false;
+    qint64 latencyMs = 0;
+};
+
+struct ChatRequest
+{
+    QUuid conversation; // the overlay the request belongs to
+    QString prompt;
+    QString model; // empty: the endpoint's default model
+    QUrl endpoint; // empty: ChatClient::endpoint()
+    int maxTokens = 150;
+    QList<ImageAttachment> attachments; // sent as data URLs in "images"
+    // Offers the local tools (ToolExecutor::definitions()) to the model
+    bool tools = false;
+    // Follow-up to a reply that asked for tools: the calls it made and their outputs
+    QList<ToolCall> toolCalls;
+    QList<ToolResult> toolResults;
+    // Not waited on by anyone typing: may be held for a moment and sent in a batch
+    bool background = false;
+    // Checked on the client as text arrives: the reply ends before the first
+    // stop string, or after the first copy of a passage it keeps repeating
+    QStringList stopSequences;
+    bool stopOnRepetition = false;
+    // JSON mode: the reply must be one document matching this schema. It is
+    // checked as it streams; a reply that can no longer match is cut off and
+    // asked for again, up to schemaRetries times, before the stream fails.
+    QJsonObject responseSchema;
+    int schemaRetries = 2;
+};
+
+// One model to fan a prompt out to in compare mode
+struct ModelBackend
+{
+    QString model;
+    QUrl endpoint; // empty: ChatClient::endpoint()
+};
+
+struct StreamMetrics
+{
+    qint64 timeToFirstTokenMs = -1;
+    qint64 totalMs = -1;
+    int tokens = 0;
+    // Set when a client-side stop condition ended the reply early; saved
+    // time is estimated from the rate so far
+    QString stopReason; // "stop" or "repetition"
+    int tokensSaved = 0;
+    qint64 msSaved = 0;
+
+    double tokensPerSecond() const;
+};
+
+// The network side of a request: one QNetworkReply and everything it has
+// delivered. Shared by every ChatStream subscribed to the same request.
+//
+// What is buffered ahead of the consumers is bounded: QNetworkReply holds at
+// most ReadBufferBytes, raw bytes are decoded once MaxRawBytes are waiting,
+// and once MaxPendingChars of decoded text have not been read by any
+// consumer the reply is left unread. The socket then fills and TCP flow
+// control pauses the server until a consumer catches up and reading resumes.
+// received itself keeps the whole reply (for text(), late subscribers and
+// ResponseCache), so that part grows with the length of the reply.
+class InFlightReply : public QObject
+{
+    Q_OBJECT
+
+public:
+    static constexpr qint64 ReadBufferBytes = 256 * 1024;
+    static constexpr qsizetype MaxRawBytes = 256 * 1024;
+    static constexpr qsizetype MaxPendingChars = 512 * 1024;
+
+    explicit InFlightReply(QNetworkReply *reply);
+    // A reply served from ResponseCache; completes on the next event loop pass
+    explicit InFlightReply(const QString &cachedText);
+    // A reply waiting in a batch; see attach(), complete() and fail()
+    InFlightReply();
+    ~InFlightReply() override;
+
+    // Ends the reply early on request.stopSequences / stopOnRepetition
+    void setStopConditions(const ChatRequest &request);
+    // Checks the reply against schema; resend starts the request over
+    void setSchema(const QJsonObject &schema, int retries, std::function<QNetworkReply *()> resend);
+    const QList<JsonField> &validatedFields() const;
+
+    // Streams from reply from now on (a batch fell back to single requests)
+    void attach(QNetworkReply *reply);
+    // Finishes with a whole non-streamed completion document
+    void complete(const QByteArray &body);
+    void fail(const QString &message, QNetworkReply::NetworkError code);
+
+    void parseBuffered();
+    void abort();
+    void mergeToolCall(int index, const QJsonObject &call);
+    // A consumer has read up to position in received
+    void markDelivered(qsizetype position);
+    bool isPaused() const { return paused; }
+
+    QNetworkReply *reply;
+    QByteArray buffer; // raw bytes not yet parsed
+    QString received;
+    qsizetype delivered = 0; // furthest any consumer has read
+    QList<ToolCall> toolCalls;
+    bool eventStream = false;
+    bool done = false;
+    QString error;
+    QNetworkReply::NetworkError networkError = QNetworkReply::NoError;
+    QElapsedTimer clock;
+    qint64 firstByteMs = -1;
+    qint64 endMs = -1;
+    int tokenCount = 0;
+    QString stopReason;
+    int tokensSaved = 0;
+    qint64 msSaved = 0;
+
+signals:
+    void readyRead();
+    void finished();
+    void restarted(); // the reply broke the schema and is being generated again
+
+private slots:
+    void onReplyReadyRead();
+    void onReplyFinished();
+
+private:
+    void decodeBuffered();
+    bool pull();
+    void appendText(const QString &text);
+    void stopEarly(const char *reason, qsizetype cut);
+    void armStopConditions();
+    bool validateCompleted();
+    void rejectReply();
+    void detachReply();
+
+    bool paused = false;
+    std::unique_ptr<StopMatcher> stopMatcher;
+    std::unique_ptr<RepetitionDetector> repetition;
+    QStringList stopSequences;
+    bool stopOnRepetition = false;
+    QString heldBack; // decoded text that may be the start of a stop string
+    int maxTokens = 0;
+
+    std::unique_ptr<JsonStreamValidator> validator;
+    QJsonObject schema;
+    int retriesLeft = 0;
+    int attempt = 0;
+    std::function<QNetworkReply *()> resend;
+};
+
+// One consumer of a streamed completion. Incoming bytes are only buffered;
+// they are parsed when a consumer calls readText() (or once MaxRawBytes are
+// waiting), and a consumer that stops reading eventually pauses the reply.
+// One that is not rendering (e.g. a hidden overlay) calls keepReceiving()
+// instead, so the reply still completes and frees its connection. Identical requests
+// in flight at the same time share one InFlightReply, and a subscriber that
+// joins late first reads everything already received.
+class ChatStream : public QObject
+{
+    Q_OBJECT
+
+public:
+    ~ChatStream() override;
+
+    const ChatRequest &request() const { return chatRequest; }
+
+    // Parses everything buffered and returns the text received since the last call
+    QString readText();
+    // With a responseSchema: the fields validated since the last call
+    QList<JsonField> readFields();
+    // Lets the reply run on without reading it: what arrives is parsed into
+    // the reply and readText() returns it later
+    void keepReceiving();
+    // All text read so far
+    QString text() const { return shared->received.left(readPosition); }
+
+    bool isFinished() const { return cancelled || shared->done; }
+    bool hasError() const { return cancelled || !shared->error.isEmpty(); }
+    QString errorString() const;
+    QNetworkReply::NetworkError networkError() const;
+    // Tools the reply asked for; complete once the stream is finished and read
+    const QList<ToolCall> &toolCalls() const { return shared->toolCalls; }
+    // True when this request joined one that was already in flight
+    bool isCoalesced() const { return coalesced; }
+
+    // Complete once the stream is finished and its text has been read
+    StreamMetrics metrics() const;
+
+    // Detaches this consumer; the reply itself is aborted once no consumer is left
+    void abort();
+
+signals:
+    void readyRead();
+    void finished();
+    // The reply broke responseSchema and is being generated again: text and
+    // fields start over from the beginning
+    void restarted();
+
+private:
+    friend class ChatClient;
+    ChatStream(const ChatRequest &request, std::shared_ptr<InFlightReply> shared, bool coalesced, QObject *parent);
+
+    ChatRequest chatRequest;
+    std::shared_ptr<InFlightReply> shared;
+    int readPosition = 0;
+    int fieldPosition = 0;
+    bool coalesced;
+    bool cancelled = false;
+};
+
+// Sends completion requests for every overlay. All requests go through one
+// QNetworkAccessManager, so concurrent requests share its connection pool
+// (and HTTP/2 sessions) instead of each overlay opening its own.
+// Background requests go through RequestBatcher and reach the server
+// several at a time (D0_BATCH=0 sends them one by one).
+// Requests that normalize to the same body while one is still in flight are
+// coalesced onto it (single-flight); see the chat.singleflight.* stats.
+// Completed text answers go to ResponseCache, so every instance on the
+// machine can answer a repeated request without the network
+// (D0_RESPONSE_CACHE=0 turns that off).
+class ChatClient : public QObject
+{
+    Q_OBJECT
+
+public:
+    static ChatClient *instance();
+
+    // The returned stream is owned by parent; delete it once consumed
+    ChatStream *send(const ChatRequest &request, QObject *parent);
+
+    QUrl endpoint() const { return defaultEndpoint; }
+    void setEndpoint(const QUrl &url) { defaultEndpoint = url; }
+    QNetworkAccessManager *networkManager() const { return manager; }
+    // True if background requests to endpoint (default: endpoint()) are sent in batches
+    bool isBatching(const QUrl &endpoint = QUrl()) const;
+
+    // Trims, unifies line endings and applies NFC so trivially different prompts coalesce
+    static QString normalizedPrompt(const QString &prompt);
+
+private:
+    explicit ChatClient(QObject *parent = nullptr);
+    QByteArray requestBody(const ChatRequest &request) const;
+    QNetworkReply *post(const QUrl &url, const QByteArray &body);
+
+    QNetworkAccessManager *manager;
+    RequestBatcher *batcher = nullptr;
+    QUrl defaultEndpoint;
+    QByteArray apiKey;
+    QHash<QByteArray, std::weak_ptr<InFlightReply>> inFlight;
+};
+
+#endif // CHATCLIENT_H
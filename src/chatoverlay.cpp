@@ -1,16 +1,63 @@
-#include "ChatOverlay.h"
+#include "chatoverlay.h"
 #include <QLabel>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonArray> // Add this line
-#include <QNetworkRequest>
 #include <QKeyEvent>
+#include <QHBoxLayout>
+#include <QStandardPaths>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include "asynclog.h"
+#include "outboundqueue.h"
+#include "screencapture.h"
+#include "toolexecutor.h"
+#include "filesummarizer.h"
+#include "historyview.h"
+#include "replyview.h"
+#include "stats.h"
+#include <QApplication>
+#include <QScreen>
+#include <QDebug>
+#include <QTimer>
+#include <QPainter>
+#include <QPaintEvent>
+#include <QScrollBar>
+#include <QScroller>
+#include <QWheelEvent>
 
-ChatOverlay::ChatOverlay(QWidget *parent) : QWidget(parent), networkManager(new QNetworkAccessManager(this))
+// Streamed text is rendered at most this often; one coarse timer serves every reply
+static const int FlushIntervalMs = 50;
+// History rows near the view are rasterized once scrolling pauses this long,
+// a few milliseconds per event loop pass
+static const int PrerenderDelayMs = 100;
+static const int PrerenderBudgetMs = 4;
+static const int WheelScrollMs = 180;
+
+ChatOverlay::ChatOverlay(QWidget *parent)
+    : QWidget(parent), flushTimer(new QTimer(this)), idle(true), conversationId(QUuid::createUuid()),
+      screenCapture(new ScreenCapture(this)), toolExecutor(new ToolExecutor(this)), summarizer(new FileSummarizer(this)),
+      prerenderTimer(new QTimer(this))
 {
     setupUI();
+    prerenderTimer->setSingleShot(true);
+    prerenderTimer->setInterval(PrerenderDelayMs);
+    connect(prerenderTimer, &QTimer::timeout, this, &ChatOverlay::prerenderHistory);
+    flushTimer->setTimerType(Qt::CoarseTimer);
+    flushTimer->setInterval(FlushIntervalMs);
+    connect(flushTimer, &QTimer::timeout, this, &ChatOverlay::flushPendingStreams);
     connect(inputField, &QLineEdit::returnPressed, this, &ChatOverlay::onMessageSubmitted);
-    connect(networkManager, &QNetworkAccessManager::finished, this, &ChatOverlay::onApiResponse);
+    connect(OutboundQueue::instance(), &OutboundQueue::started, this, &ChatOverlay::onQueuedPromptStarted);
+    connect(screenCapture, &ScreenCapture::captured, this, &ChatOverlay::onCaptured);
+    connect(screenCapture, &ScreenCapture::cancelled, this, &QWidget::show);
+    connect(toolExecutor, &ToolExecutor::toolFinished, this, &ChatOverlay::onToolFinished);
+    connect(toolExecutor, &ToolExecutor::batchFinished, this, &ChatOverlay::onToolBatchFinished);
+    connect(summarizer, &FileSummarizer::progress, this, &ChatOverlay::onSummaryProgress);
+    connect(summarizer, &FileSummarizer::finished, this, &ChatOverlay::onSummaryFinished);
+    connect(scrollArea->verticalScrollBar(), &QScrollBar::valueChanged, this, &ChatOverlay::onScrolled);
+    connect(scrollArea->verticalScrollBar(), &QScrollBar::rangeChanged, this, &ChatOverlay::onScrollRangeChanged);
+    SessionStore::instance()->track(this);
 }
 
 void ChatOverlay::setupUI()
@@ -20,74 +67,755 @@ void ChatOverlay::setupUI()
 
     QWidget *scrollWidget = new QWidget;
     chatLayout = new QVBoxLayout();
+    chatLayout->setObjectName("chatLayout");
     scrollWidget->setLayout(chatLayout);
 
-    scrollWidget->setLayout(chatLayout);
     inputField = new QLineEdit(this);
+    inputField->setObjectName("inputField");
     chatLayout->addWidget(inputField);
+    attachmentLabel = new QLabel(this);
+    attachmentLabel->hide();
+    chatLayout->addWidget(attachmentLabel);
+    history = new HistoryView(this);
+    chatLayout->addWidget(history);
 
-    QScrollArea *scrollArea = new QScrollArea();
+    scrollArea = new QScrollArea();
     scrollArea->setWidget(scrollWidget);
     scrollArea->setWidgetResizable(true);
 
+    // Flicks keep moving and slow down; wheel steps glide instead of jumping
+    QScroller::grabGesture(scrollArea->viewport(), QScroller::TouchGesture);
+    QScrollerProperties properties = QScroller::scroller(scrollArea->viewport())->scrollerProperties();
+    properties.setScrollMetric(QScrollerProperties::VerticalOvershootPolicy, QScrollerProperties::OvershootAlwaysOff);
+    QScroller::scroller(scrollArea->viewport())->setScrollerProperties(properties);
+    connect(QScroller::scroller(scrollArea->viewport()), &QScroller::stateChanged, this, [this](QScroller::State state)
+            {
+                if (state == QScroller::Inactive)
+                {
+                    wheelTarget = -1;
+                }
+            });
+    scrollArea->viewport()->installEventFilter(this);
+
+    // Only the overlay paints a background (from chromeCache); the scroll area
+    // and its contents stay transparent so a changed label repaints just its own rect
+    scrollArea->setFrameShape(QFrame::NoFrame);
+    scrollArea->viewport()->setAutoFillBackground(false);
+    scrollWidget->setAutoFillBackground(false);
+
     QVBoxLayout *mainlayout = new QVBoxLayout;
     mainlayout->addWidget(scrollArea);
     setLayout(mainlayout);
 }
 
+bool ChatOverlay::eventFilter(QObject *watched, QEvent *event)
+{
+    if (watched == scrollArea->viewport() && event->type() == QEvent::Wheel)
+    {
+        // Trackpads send pixel deltas with their own momentum; only smooth
+        // the coarse steps of a mouse wheel
+        QWheelEvent *wheel = static_cast<QWheelEvent *>(event);
+        if (wheel->pixelDelta().isNull() && wheel->angleDelta().y() != 0)
+        {
+            QScrollBar *bar = scrollArea->verticalScrollBar();
+            double from = wheelTarget >= 0 ? wheelTarget : bar->value();
+            double steps = wheel->angleDelta().y() / 120.0 * QApplication::wheelScrollLines();
+            wheelTarget = qBound<double>(bar->minimum(), from - steps * bar->singleStep(), bar->maximum());
+            QScroller::scroller(scrollArea->viewport())->scrollTo(QPointF(0, wheelTarget), WheelScrollMs);
+            return true;
+        }
+    }
+    return QWidget::eventFilter(watched, event);
+}
+
 void ChatOverlay::keyPressEvent(QKeyEvent *event)
 {
     if (event->key() == Qt::Key_Escape)
     {
         hide();
     }
+    else if (event->key() == Qt::Key_S && event->modifiers() == (Qt::ControlModifier | Qt::ShiftModifier))
+    {
+        startCapture();
+    }
     else
     {
         QWidget::keyPressEvent(event);
     }
 }
 
+void ChatOverlay::startCapture()
+{
+    QScreen *target = screen();
+    hide(); // keep the overlay itself out of the screenshot
+    // Give the window system a moment to unmap the overlay before grabbing
+    QTimer::singleShot(150, this, [this, target]()
+                       { screenCapture->start(target); });
+}
+
+void ChatOverlay::onCaptured(const ImageAttachment &attachment, qint64 latencyMs)
+{
+    show();
+    if (attachment.data.isEmpty())
+    {
+        return;
+    }
+    Stats::instance()->set("capture.last_ms", latencyMs);
+    Stats::instance()->add("capture.count");
+    AsyncLog::info("capture attached in {} ms", latencyMs);
+
+    pendingAttachments.append(attachment);
+    attachmentLabel->setText(QString("%1 image(s) attached, last %2x%3 %4 KB")
+                                 .arg(pendingAttachments.size())
+                                 .arg(attachment.size.width())
+                                 .arg(attachment.size.height())
+                                 .arg(attachment.data.size() / 1024));
+    attachmentLabel->show();
+}
+
+void ChatOverlay::showEvent(QShowEvent *event)
+{
+    QWidget::showEvent(event);
+    leaveIdleMode();
+    SessionStore::instance()->markDirty(this);
+}
+
+void ChatOverlay::hideEvent(QHideEvent *event)
+{
+    QWidget::hideEvent(event);
+    enterIdleMode();
+    SessionStore::instance()->markDirty(this);
+}
+
+void ChatOverlay::resizeEvent(QResizeEvent *event)
+{
+    QWidget::resizeEvent(event);
+    chromeCache = QPixmap();
+    SessionStore::instance()->markDirty(this);
+}
+
+void ChatOverlay::moveEvent(QMoveEvent *event)
+{
+    QWidget::moveEvent(event);
+    SessionStore::instance()->markDirty(this);
+}
+
+OverlayState ChatOverlay::sessionState() const
+{
+    OverlayState state;
+    state.conversation = conversationId;
+    state.geometry = geometry();
+    state.visible = isVisible();
+    state.scrollValue = scrollArea->verticalScrollBar()->value();
+    state.totalMessages = messageCount;
+    state.recent = recentMessages;
+    return state;
+}
+
+void ChatOverlay::restoreSession(const OverlayState &state)
+{
+    conversationId = state.conversation;
+    messageCount = state.totalMessages;
+    recentMessages = state.recent;
+    firstLoadedMessage = messageCount - recentMessages.size();
+    for (const ChatMessage &message : recentMessages)
+    {
+        history->appendMessage(message);
+    }
+    setGeometry(state.geometry);
+    if (state.visible)
+    {
+        show();
+    }
+    // Applied once the rows are laid out and the scroll range is known
+    int scrollValue = state.scrollValue;
+    QTimer::singleShot(0, this, [this, scrollValue]()
+                       { scrollArea->verticalScrollBar()->setValue(scrollValue); });
+}
+
+void ChatOverlay::recordMessage(const QString &role, const QString &text)
+{
+    // Only the tail stays in memory; everything is in the transcript store
+    static const int RecentMessages = 50;
+    ChatMessage message;
+    message.id = TranscriptStore::instance()->append(conversationId, role, text);
+    message.conversation = conversationId;
+    message.role = role;
+    message.text = text;
+    recentMessages.append(message);
+    while (recentMessages.size() > RecentMessages)
+    {
+        recentMessages.removeFirst();
+    }
+    ++messageCount;
+    SessionStore::instance()->markDirty(this);
+}
+
+void ChatOverlay::onScrolled(int value)
+{
+    SessionStore::instance()->markDirty(this);
+    prerenderTimer->start();
+    if (value == scrollArea->verticalScrollBar()->minimum() && firstLoadedMessage > 0)
+    {
+        loadOlderMessages();
+    }
+}
+
+void ChatOverlay::loadOlderMessages()
+{
+    static const int PageSize = 50;
+    TranscriptStore *store = TranscriptStore::instance();
+    if (!store->isIndexed() || scrollAdjustFrom >= 0)
+    {
+        return;
+    }
+    int first = qMax(0, firstLoadedMessage - PageSize);
+    QList<ChatMessage> older = store->messages(conversationId, first, firstLoadedMessage - first);
+    if (older.isEmpty())
+    {
+        firstLoadedMessage = 0;
+        return;
+    }
+    firstLoadedMessage = first;
+
+    // Rows go right below the input area; keep the view on what the user was reading
+    scrollAdjustFrom = scrollArea->verticalScrollBar()->maximum();
+    history->prependMessages(older);
+}
+
+void ChatOverlay::prerenderHistory()
+{
+    QRect visible = history->visibleRegion().boundingRect();
+    if (idle || visible.isEmpty())
+    {
+        return;
+    }
+    int heightBefore = history->sizeHint().height();
+    int shiftAbove = 0;
+    bool more = history->prerender(visible.top(), visible.bottom(), scrollArea->viewport()->height(), PrerenderBudgetMs, &shiftAbove);
+    if (shiftAbove != 0)
+    {
+        // Rows above the view changed height; keep the visible ones in place
+        if (history->sizeHint().height() == heightBefore)
+        {
+            QScrollBar *bar = scrollArea->verticalScrollBar();
+            bar->setValue(bar->value() + shiftAbove);
+        }
+        else
+        {
+            scrollShift += shiftAbove;
+        }
+    }
+    if (more)
+    {
+        QTimer::singleShot(0, this, &ChatOverlay::prerenderHistory);
+    }
+}
+
+void ChatOverlay::onScrollRangeChanged(int, int maximum)
+{
+    QScrollBar *bar = scrollArea->verticalScrollBar();
+    if (scrollAdjustFrom >= 0)
+    {
+        bar->setValue(bar->value() + maximum - scrollAdjustFrom);
+        scrollAdjustFrom = -1;
+    }
+    else if (scrollShift != 0)
+    {
+        bar->setValue(bar->value() + scrollShift);
+    }
+    scrollShift = 0;
+}
+
+void ChatOverlay::renderChrome()
+{
+    chromeCache = QPixmap(size() * devicePixelRatioF());
+    chromeCache.setDevicePixelRatio(devicePixelRatioF());
+    chromeCache.fill(Qt::transparent);
+
+    QPainter painter(&chromeCache);
+    painter.setRenderHint(QPainter::Antialiasing);
+    painter.setPen(QColor(255, 255, 255, 60));
+    painter.setBrush(QColor(30, 30, 30, 200));
+    painter.drawRoundedRect(QRectF(rect()).adjusted(0.5, 0.5, -0.5, -0.5), 10, 10);
+}
+
+void ChatOverlay::paintEvent(QPaintEvent *event)
+{
+    if (chromeCache.isNull() || chromeCache.devicePixelRatio() != devicePixelRatioF())
+    {
+        renderChrome();
+    }
+
+    // Copy just the dirty part of the cached chrome; Source avoids blending
+    // the alpha background over whatever the backing store held before
+    QPainter painter(this);
+    painter.setCompositionMode(QPainter::CompositionMode_Source);
+    for (const QRect &rect : event->region())
+    {
+        painter.drawPixmap(rect, chromeCache, QRectF(rect.topLeft() * chromeCache.devicePixelRatio(), rect.size() * chromeCache.devicePixelRatio()));
+    }
+}
+
+void ChatOverlay::enterIdleMode()
+{
+    // Replies keep arriving while hidden and are parsed as they come, so they
+    // complete and free their connection and queue slot. Nothing is rendered
+    // and no timer is left running, so a silent hidden overlay costs no wakeups.
+    idle = true;
+    flushTimer->stop();
+    for (ChatStream *stream : pendingReplies.keys())
+    {
+        stream->keepReceiving(); // one may have paused since the last flush
+    }
+}
+
+void ChatOverlay::leaveIdleMode()
+{
+    idle = false;
+    flushPendingStreams();
+}
+
+void ChatOverlay::scheduleFlush()
+{
+    if (idle)
+    {
+        if (ChatStream *stream = qobject_cast<ChatStream *>(sender()))
+        {
+            stream->keepReceiving(); // rendered in one go on leaveIdleMode()
+        }
+        return;
+    }
+    if (!flushTimer->isActive())
+    {
+        flushTimer->start();
+    }
+}
+
 void ChatOverlay::onMessageSubmitted()
 {
     QString message = inputField->text();
-    if (!message.isEmpty())
+    if (message.startsWith("/compare"))
+    {
+        setCompareMode(message.mid(8));
+        inputField->clear();
+    }
+    else if (message.startsWith("/stoprepeats"))
+    {
+        setStopOnRepetition(message.mid(12));
+        inputField->clear();
+    }
+    else if (message.startsWith("/summarize"))
+    {
+        summarizeOpenFile(message.mid(10));
+        inputField->clear();
+    }
+    else if (!message.isEmpty())
     {
         QLabel *userMessage = new QLabel("You: " + message, this);
         chatLayout->addWidget(userMessage);
-        sendMessageToChatGPT(message);
+        recordMessage("user", message);
+        if (compareBackends.isEmpty())
+        {
+            sendMessageToChatGPT(message);
+        }
+        else
+        {
+            sendComparison(message);
+        }
         inputField->clear();
     }
 }
 
+void ChatOverlay::summarizeOpenFile(const QString &instructions)
+{
+    // "/summarize [what to focus on]" - the file open in the main window
+    QString path = ToolExecutor::openFilePath();
+    if (path.isEmpty())
+    {
+        chatLayout->addWidget(new QLabel("Open a file in the main window first", this));
+        return;
+    }
+    // A running summary is cancelled first; its row reports that
+    summarizer->cancel();
+    QString request = "Summarize " + QFileInfo(path).fileName() + (instructions.trimmed().isEmpty() ? "" : ":" + instructions);
+    chatLayout->addWidget(new QLabel("You: " + request, this));
+    recordMessage("user", request);
+    summaryLabel = new QLabel("ChatGPT: reading the file...", this);
+    summaryLabel->setWordWrap(true);
+    chatLayout->addWidget(summaryLabel);
+    summarizer->start(path, instructions);
+}
+
+void ChatOverlay::onSummaryProgress(int requests, int total, int cached)
+{
+    if (summaryLabel)
+    {
+        summaryLabel->setText(QString("ChatGPT: summarizing... %1 of %2 parts (%3 from cache)").arg(requests).arg(total).arg(cached));
+    }
+}
+
+void ChatOverlay::onSummaryFinished(const QString &summary, const QString &error)
+{
+    if (!summaryLabel)
+    {
+        return;
+    }
+    if (!summary.isEmpty())
+    {
+        summaryLabel->setText("ChatGPT: " + summary);
+        recordMessage("assistant", summary);
+    }
+    else
+    {
+        summaryLabel->setText(error.isEmpty() ? "Summary cancelled" : "Summary failed: " + error);
+    }
+    summaryLabel = nullptr;
+}
+
+void ChatOverlay::setStopOnRepetition(const QString &arguments)
+{
+    // "/stoprepeats on|off" - tables and hex dumps repeat too, so it is off by default
+    QString setting = arguments.trimmed().toLower();
+    if (setting == "on" || setting == "off")
+    {
+        stopOnRepetition = setting == "on";
+        summarizer->setStopOnRepetition(stopOnRepetition);
+    }
+    chatLayout->addWidget(new QLabel(stopOnRepetition ? "Replies that repeat themselves are cut off"
+                                                      : "Replies are not cut off when they repeat",
+                                     this));
+}
+
+void ChatOverlay::setCompareMode(const QString &arguments)
+{
+    // "/compare model[@endpoint], model[@endpoint], ..." - no arguments turns it off
+    compareBackends.clear();
+    QStringList names;
+    for (const QString &entry : arguments.split(',', Qt::SkipEmptyParts))
+    {
+        QString spec = entry.trimmed();
+        if (spec.isEmpty())
+        {
+            continue;
+        }
+        ModelBackend backend;
+        int at = spec.indexOf('@');
+        backend.model = at < 0 ? spec : spec.left(at);
+        if (at >= 0)
+        {
+            backend.endpoint = QUrl(spec.mid(at + 1));
+        }
+        compareBackends.append(backend);
+        names.append(backend.model);
+    }
+
+    QString status = compareBackends.isEmpty() ? "Compare mode off" : "Comparing: " + names.join(", ");
+    chatLayout->addWidget(new QLabel(status, this));
+}
+
+void ChatOverlay::trackStream(ChatStream *stream, const PendingReply &pending)
+{
+    pendingReplies.insert(stream, pending);
+    connect(stream, &ChatStream::readyRead, this, &ChatOverlay::scheduleFlush);
+    connect(stream, &ChatStream::finished, this, &ChatOverlay::scheduleFlush);
+}
+
 void ChatOverlay::sendMessageToChatGPT(const QString &message)
 {
-    QNetworkRequest request(QUrl("https://api.openai.com/v1/engines/davinci-codex/completions"));
-    request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
-    request.setRawHeader("Authorization", "Bearer YOUR_API_KEY");
+    ChatRequest request;
+    request.conversation = conversationId;
+    request.prompt = message;
+    request.attachments = pendingAttachments;
+    request.stopOnRepetition = stopOnRepetition;
+    // Tools only reach the directory of the open file, so without one there is nothing to offer
+    request.tools = !ToolExecutor::openFilePath().isEmpty();
+    pendingAttachments.clear();
+    attachmentLabel->hide();
 
-    QJsonObject json;
-    json["prompt"] = message;
-    json["max_tokens"] = 150;
+    if (OutboundQueue::instance()->hasPending(conversationId))
+    {
+        // Earlier prompts of this conversation are still waiting; keep the order
+        OutboundQueue::instance()->enqueue(request);
+        chatLayout->addWidget(new QLabel("Queued until the service is reachable", this));
+        return;
+    }
 
-    QNetworkReply *reply = networkManager->post(request, QJsonDocument(json).toJson());
+    PendingReply pending;
+    pending.prefix = "ChatGPT: ";
+    trackStream(ChatClient::instance()->send(request, this), pending);
 }
 
-void ChatOverlay::onApiResponse(QNetworkReply *reply)
+void ChatOverlay::onQueuedPromptStarted(const ChatRequest &request, ChatStream *stream)
 {
-    if (reply->error() == QNetworkReply::NoError)
+    if (request.conversation != conversationId)
     {
-        QByteArray response = reply->readAll();
-        QJsonDocument jsonResponse = QJsonDocument::fromJson(response);
-        QJsonObject jsonObject = jsonResponse.object();
-        QString chatGPTResponse = jsonObject["choices"].toArray().at(0).toObject()["text"].toString();
+        return;
+    }
+    stream->setParent(this);
+    PendingReply pending;
+    pending.prefix = "ChatGPT: ";
+    pending.fromQueue = true;
+    trackStream(stream, pending);
+}
+
+void ChatOverlay::sendComparison(const QString &message)
+{
+    // All columns are sent at once; they share ChatClient's connection pool
+    auto comparison = std::make_shared<Comparison>();
+    comparison->prompt = message;
+    comparison->remaining = compareBackends.size();
 
-        QLabel *responseLabel = new QLabel("ChatGPT: " + chatGPTResponse, this);
-        chatLayout->addWidget(responseLabel);
+    QWidget *row = new QWidget(this);
+    QHBoxLayout *columns = new QHBoxLayout(row);
+    columns->setContentsMargins(0, 0, 0, 0);
+    chatLayout->addWidget(row);
+
+    for (const ModelBackend &backend : compareBackends)
+    {
+        QWidget *column = new QWidget(row);
+        QVBoxLayout *columnLayout = new QVBoxLayout(column);
+        columnLayout->setContentsMargins(0, 0, 0, 0);
+
+        PendingReply pending;
+        pending.prefix = backend.model + ": ";
+        pending.label = new QLabel(pending.prefix, column);
+        pending.label->setWordWrap(true);
+        pending.label->setAlignment(Qt::AlignLeft | Qt::AlignTop);
+        pending.metricsLabel = new QLabel(column);
+        pending.comparison = comparison;
+        columnLayout->addWidget(pending.label, 1);
+        columnLayout->addWidget(pending.metricsLabel);
+        columns->addWidget(column, 1);
+
+        ChatRequest request;
+        request.prompt = message;
+        request.model = backend.model;
+        request.endpoint = backend.endpoint;
+        request.attachments = pendingAttachments;
+        request.stopOnRepetition = stopOnRepetition;
+        trackStream(ChatClient::instance()->send(request, this), pending);
+    }
+    pendingAttachments.clear();
+    attachmentLabel->hide();
+}
+
+void ChatOverlay::runTools(ChatStream *stream)
+{
+    // Bounded, so a model that keeps asking for tools cannot loop forever
+    static const int MaxToolResults = 16;
+    const ChatRequest &request = stream->request();
+    if (!request.tools)
+    {
+        chatLayout->addWidget(new QLabel("Error: the reply asked for tools that were not offered", this));
+        return;
+    }
+    if (request.toolResults.size() >= MaxToolResults)
+    {
+        chatLayout->addWidget(new QLabel("Error: too many tool rounds", this));
+        return;
+    }
+
+    QStringList names;
+    for (const ToolCall &call : stream->toolCalls())
+    {
+        names.append(call.name);
+    }
+    chatLayout->addWidget(new QLabel("Running tools: " + names.join(", "), this));
+
+    ChatRequest followUp = request;
+    followUp.toolCalls += stream->toolCalls();
+    toolBatches.insert(toolExecutor->run(stream->toolCalls()), followUp);
+}
+
+void ChatOverlay::onToolFinished(int batch, const ToolResult &result)
+{
+    if (!toolBatches.contains(batch))
+    {
+        return;
+    }
+    QString preview = result.output.section('\n', 0, 0).left(120);
+    chatLayout->addWidget(new QLabel(QString("[%1 %2, %3 ms] %4")
+                                         .arg(result.name, result.ok ? "ok" : "failed")
+                                         .arg(result.latencyMs)
+                                         .arg(preview),
+                                     this));
+}
+
+void ChatOverlay::onToolBatchFinished(int batch, const QList<ToolResult> &results)
+{
+    if (!toolBatches.contains(batch))
+    {
+        return;
+    }
+    // Send the outputs back so the model can continue from them
+    ChatRequest followUp = toolBatches.take(batch);
+    followUp.toolResults += results;
+
+    PendingReply pending;
+    pending.prefix = "ChatGPT: ";
+    trackStream(ChatClient::instance()->send(followUp, this), pending);
+}
+
+void ChatOverlay::recordComparison(ChatStream *stream, PendingReply &pending)
+{
+    StreamMetrics metrics = stream->metrics();
+    QJsonObject result;
+    result["model"] = stream->request().model;
+    if (stream->hasError())
+    {
+        result["error"] = stream->errorString();
     }
     else
     {
-        QLabel *errorLabel = new QLabel("Error: " + reply->errorString(), this);
-        chatLayout->addWidget(errorLabel);
+        QString text = QString("TTFT %1 ms | %2 tok/s | %3 ms total")
+                           .arg(metrics.timeToFirstTokenMs)
+                           .arg(metrics.tokensPerSecond(), 0, 'f', 1)
+                           .arg(metrics.totalMs);
+        if (!metrics.stopReason.isEmpty())
+        {
+            text += QString(" | stopped: %1, ~%2 tokens saved").arg(metrics.stopReason).arg(metrics.tokensSaved);
+        }
+        pending.metricsLabel->setText(text);
+        result["ttft_ms"] = metrics.timeToFirstTokenMs;
+        result["tokens_per_second"] = metrics.tokensPerSecond();
+        result["total_ms"] = metrics.totalMs;
+        result["tokens"] = metrics.tokens;
+        if (!metrics.stopReason.isEmpty())
+        {
+            result["stop_reason"] = metrics.stopReason;
+            result["tokens_saved"] = metrics.tokensSaved;
+            result["ms_saved"] = metrics.msSaved;
+        }
+    }
+    pending.comparison->results.append(result);
+
+    if (--pending.comparison->remaining > 0)
+    {
+        return;
+    }
+
+    // Every column is done: append the comparison as one JSON line
+    QString dir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+    QDir().mkpath(dir);
+    QFile log(dir + "/comparisons.jsonl");
+    if (log.open(QIODevice::WriteOnly | QIODevice::Append))
+    {
+        QJsonObject record;
+        record["prompt"] = pending.comparison->prompt;
+        record["results"] = pending.comparison->results;
+        log.write(QJsonDocument(record).toJson(QJsonDocument::Compact) + '\n');
+    }
+}
+
+void ChatOverlay::flushPendingStreams()
+{
+    if (idle)
+    {
+        flushTimer->stop();
+        return;
+    }
+
+    for (auto it = pendingReplies.begin(); it != pendingReplies.end();)
+    {
+        ChatStream *stream = it.key();
+        PendingReply &pending = it.value();
+        QString fresh = stream->readText();
+        bool finished = stream->isFinished();
+
+        if (finished && stream->hasError() && !pending.comparison && OutboundQueue::isRetryableError(stream->networkError()))
+        {
+            // Not lost: the queue resends it once the service answers again
+            delete pending.label;
+            delete pending.hugeView;
+            if (!pending.fromQueue)
+            {
+                OutboundQueue::instance()->enqueue(stream->request());
+                chatLayout->addWidget(new QLabel("Queued until the service is reachable", this));
+            }
+        }
+        else if (finished && stream->hasError())
+        {
+            QString errorText = "Error: " + stream->errorString();
+            if (pending.metricsLabel)
+            {
+                pending.metricsLabel->setText(errorText);
+            }
+            else
+            {
+                chatLayout->addWidget(new QLabel(errorText, this));
+            }
+        }
+        else if (pending.hugeView)
+        {
+            pending.hugeView->appendText(fresh);
+        }
+        else if (!pending.label && (finished || !fresh.isEmpty()))
+        {
+            QString text = pending.prefix + stream->text();
+            if (ReplyView::isHuge(text))
+            {
+                pending.hugeView = new ReplyView(this);
+                pending.hugeView->setText(text);
+                chatLayout->addWidget(pending.hugeView);
+            }
+            else
+            {
+                pending.label = new QLabel(text, this);
+                chatLayout->addWidget(pending.label);
+            }
+        }
+        else if (pending.label && !fresh.isEmpty())
+        {
+            QString text = pending.prefix + stream->text();
+            if (ReplyView::isHuge(text))
+            {
+                // Re-shaping the whole label on every flush grows with the reply.
+                // In compare mode the label sits in its column, not in chatLayout.
+                QWidget *owner = pending.label->parentWidget();
+                pending.hugeView = new ReplyView(owner);
+                pending.hugeView->setText(text);
+                delete owner->layout()->replaceWidget(pending.label, pending.hugeView);
+                delete pending.label;
+                pending.label = nullptr;
+            }
+            else
+            {
+                pending.label->setText(text);
+            }
+        }
+
+        if (finished)
+        {
+            if (pending.comparison)
+            {
+                recordComparison(stream, pending);
+            }
+            else if (!stream->hasError() && !stream->toolCalls().isEmpty())
+            {
+                runTools(stream);
+            }
+            else if (!stream->hasError())
+            {
+                recordMessage("assistant", stream->text());
+                StreamMetrics metrics = stream->metrics();
+                if (metrics.stopReason == "repetition")
+                {
+                    // Never cut silently; the reply may have been a legitimately repetitive table
+                    chatLayout->addWidget(new QLabel(QString("[stopped: repetition, ~%1 tokens saved]").arg(metrics.tokensSaved), this));
+                }
+            }
+            stream->deleteLater();
+            it = pendingReplies.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    if (pendingReplies.isEmpty())
+    {
+        flushTimer->stop();
     }
-    reply->deleteLater();
 }
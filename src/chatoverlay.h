@@ -5,10 +5,22 @@
 #include <QLineEdit>
 #include <QVBoxLayout>
 #include <QScrollArea>
-#include <QNetworkAccessManager>
-#include <QNetworkReply>
+#include <QHash>
+#include <QPixmap>
+#include <QJsonArray>
+#include <QUuid>
+#include <memory>
+#include "chatclient.h"
+#include "sessionstore.h"
 
 class QKeyEvent;
+class QLabel;
+class QTimer;
+class ScreenCapture;
+class ToolExecutor;
+class FileSummarizer;
+class HistoryView;
+class ReplyView;
 
 class ChatOverlay : public QWidget
 {
@@ -17,19 +29,97 @@ class ChatOverlay : public QWidget
 public:
     explicit ChatOverlay(QWidget *parent = nullptr);
 
+    // True while the overlay is hidden: streams are buffered but not rendered
+    bool isIdle() const { return idle; }
+
+    OverlayState sessionState() const;
+    void restoreSession(const OverlayState &state);
+
 protected:
+    bool eventFilter(QObject *watched, QEvent *event) override;
     void keyPressEvent(QKeyEvent *event) override;
+    void showEvent(QShowEvent *event) override;
+    void hideEvent(QHideEvent *event) override;
+    void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+    void moveEvent(QMoveEvent *event) override;
 
 private slots:
     void onMessageSubmitted();
-    void onApiResponse(QNetworkReply *reply);
+    void flushPendingStreams();
+    void onQueuedPromptStarted(const ChatRequest &request, ChatStream *stream);
+    void onCaptured(const ImageAttachment &attachment, qint64 latencyMs);
+    void onToolFinished(int batch, const ToolResult &result);
+    void onToolBatchFinished(int batch, const QList<ToolResult> &results);
+    void onScrolled(int value);
+    void onScrollRangeChanged(int minimum, int maximum);
+    void onSummaryProgress(int requests, int total, int cached);
+    void onSummaryFinished(const QString &summary, const QString &error);
+    void prerenderHistory();
 
 private:
+    // One prompt fanned out to several models; recorded once every column is done
+    struct Comparison
+    {
+        QString prompt;
+        QJsonArray results;
+        int remaining = 0;
+    };
+
+    struct PendingReply
+    {
+        QLabel *label = nullptr;
+        ReplyView *hugeView = nullptr; // takes over from label once the text is huge
+        QString prefix;
+        QLabel *metricsLabel = nullptr; // compare mode only
+        std::shared_ptr<Comparison> comparison;
+        bool fromQueue = false; // resent by OutboundQueue, which retries it on its own
+    };
+
     QLineEdit *inputField;
     QVBoxLayout *chatLayout;
-    QNetworkAccessManager *networkManager;
+    QScrollArea *scrollArea;
+    QTimer *flushTimer;
+    bool idle;
+    QPixmap chromeCache; // translucent background, rebuilt only on resize or DPR change
+    QHash<ChatStream *, PendingReply> pendingReplies;
+    QList<ModelBackend> compareBackends; // non-empty: compare mode
+    bool stopOnRepetition = false;        // "/stoprepeats on": cut replies that loop
+    QUuid conversationId;
+    ScreenCapture *screenCapture;
+    QList<ImageAttachment> pendingAttachments; // sent with the next message
+    QLabel *attachmentLabel;
+    ToolExecutor *toolExecutor;
+    QHash<int, ChatRequest> toolBatches; // request whose reply asked for each running batch
+    FileSummarizer *summarizer;
+    QLabel *summaryLabel = nullptr; // row of the running /summarize
+
+    // Transcript window: messages [firstLoadedMessage, messageCount) have rows
+    int messageCount = 0;
+    int firstLoadedMessage = 0;
+    QList<ChatMessage> recentMessages; // tail kept for the session snapshot
+    int scrollAdjustFrom = -1;         // old scroll maximum while older rows are inserted
+    int scrollShift = 0;               // applied with the next range change
+    HistoryView *history;              // restored and older messages
+    QTimer *prerenderTimer;
+    double wheelTarget = -1;           // end of the running smooth wheel scroll
+
+    void renderChrome();
     void setupUI();
     void sendMessageToChatGPT(const QString &message);
+    void sendComparison(const QString &message);
+    void setCompareMode(const QString &arguments);
+    void setStopOnRepetition(const QString &arguments);
+    void summarizeOpenFile(const QString &instructions);
+    void trackStream(ChatStream *stream, const PendingReply &pending);
+    void recordComparison(ChatStream *stream, PendingReply &pending);
+    void startCapture();
+    void runTools(ChatStream *stream);
+    void enterIdleMode();
+    void leaveIdleMode();
+    void scheduleFlush();
+    void recordMessage(const QString &role, const QString &text);
+    void loadOlderMessages();
 };
 
 #endif // CHATOVERLAY_H
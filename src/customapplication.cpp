@@ -1,23 +1,87 @@
 
 #include "customapplication.h"
+#include "alloctracker.h"
+#include "asynclog.h"
 #include "chatoverlay.h"
+#include "eventrecorder.h"
+#include "paintprofiler.h"
 #include <QKeyEvent>
+#include <QPaintEvent>
+#include <QWidget>
+
+#ifdef D0_ALLOC_TRACKING
+// Nested notify calls take the innermost tag and restore the outer one
+static AllocTracker::Tag allocationTag(QObject *receiver, QEvent *event)
+{
+    if (event->type() == QEvent::Paint || event->type() == QEvent::UpdateRequest)
+    {
+        return AllocTracker::Rendering;
+    }
+    if (receiver->isWidgetType() && qobject_cast<ChatOverlay *>(static_cast<QWidget *>(receiver)->window()))
+    {
+        return AllocTracker::Overlay;
+    }
+    return AllocTracker::Untagged;
+}
+#endif
 
 bool CustomApplication::notify(QObject *receiver, QEvent *event)
 {
+#ifdef D0_ALLOC_TRACKING
+    AllocScope scope(allocationTag(receiver, event));
+#endif
+    if (EventRecorder *recorder = EventRecorder::instance())
+    {
+        recorder->record(receiver, event);
+    }
+    EventReplayer *replayer = EventReplayer::instance();
+    if (replayer)
+    {
+        replayer->observe(receiver, event);
+    }
     if (event->type() == QEvent::KeyPress)
     {
         QKeyEvent *keyEvent = static_cast<QKeyEvent *>(event);
         if (keyEvent->key() == Qt::Key_Space &&
             keyEvent->modifiers() == (Qt::ShiftModifier | Qt::AltModifier))
         {
-            qDebug() << "Shift + Option + Space detected globally!";
+            AsyncLog::debug("Shift + Option + Space detected globally");
 
             ChatOverlay *chatOverlay = new ChatOverlay();
             chatOverlay->show(); // Initially hide the chat overlay
             return true;         // Event is handled, stop propagation
         }
     }
+    PaintProfiler *profiler = PaintProfiler::instance();
+    // A frame is one UpdateRequest; every paint event it triggers is delivered synchronously inside it
+    if (event->type() == QEvent::UpdateRequest && (profiler || replayer))
+    {
+        if (profiler)
+        {
+            profiler->beginFrame();
+        }
+        if (replayer)
+        {
+            replayer->beginFrame();
+        }
+        bool handled = QApplication::notify(receiver, event);
+        if (profiler)
+        {
+            profiler->endFrame();
+        }
+        if (replayer)
+        {
+            replayer->endFrame();
+        }
+        return handled;
+    }
+    if (profiler)
+    {
+        if (event->type() == QEvent::Paint && receiver->isWidgetType())
+        {
+            profiler->addDirtyRegion(static_cast<QWidget *>(receiver), static_cast<QPaintEvent *>(event)->region());
+        }
+    }
     // Call the base class implementation for default behavior
     return QApplication::notify(receiver, event);
 }
\ No newline at end of file
@@ -0,0 +1,623 @@
+#include "eventrecorder.h"
+#include <QApplication>
+#include <QDebug>
+#include <QGuiApplication>
+#include <QKeyEvent>
+#include <QMouseEvent>
+#include <QTimer>
+#include <QWheelEvent>
+#include <QWidget>
+#include <QWindow>
+#include <algorithm>
+
+// File layout: magic, version, then records of
+// [kind u8][ms since previous record, varint][fields, varints or strings]
+static const quint32 Magic = 0x44304556; // "D0EV"
+static const quint8 Version = 1;
+static const double StallMs = 50;
+static const int DrainMs = 1000; // frames still counted after the last event
+
+enum RecordKind : quint8
+{
+    WindowDefinition = 1, // id, class name, object name, ordinal
+    MousePress,           // window, x, y, button, buttons, modifiers
+    MouseRelease,
+    MouseDoubleClick,
+    MouseMove,
+    Wheel,      // window, x, y, angle x, angle y, buttons, modifiers
+    KeyPress,   // window, key, modifiers, text, auto-repeat
+    KeyRelease,
+};
+
+static void writeVarint(QByteArray &out, quint64 value)
+{
+    while (value >= 0x80)
+    {
+        out.append(char(value | 0x80));
+        value >>= 7;
+    }
+    out.append(char(value));
+}
+
+static void writeSigned(QByteArray &out, qint64 value)
+{
+    writeVarint(out, (quint64(value) << 1) ^ quint64(value >> 63));
+}
+
+static void writeString(QByteArray &out, const QString &text)
+{
+    QByteArray utf8 = text.toUtf8();
+    writeVarint(out, utf8.size());
+    out.append(utf8);
+}
+
+struct RecordReader
+{
+    const QByteArray &data;
+    qsizetype pos = 0;
+    bool ok = true;
+
+    quint64 varint()
+    {
+        quint64 value = 0;
+        for (int shift = 0; shift < 64; shift += 7)
+        {
+            if (pos >= data.size())
+            {
+                break;
+            }
+            quint8 byte = quint8(data.at(pos++));
+            value |= quint64(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+            {
+                return value;
+            }
+        }
+        ok = false;
+        return 0;
+    }
+
+    qint64 signedVarint()
+    {
+        quint64 value = varint();
+        return qint64(value >> 1) ^ -qint64(value & 1);
+    }
+
+    QString string()
+    {
+        quint64 size = varint();
+        if (size > quint64(data.size() - pos))
+        {
+            ok = false;
+            return QString();
+        }
+        QString text = QString::fromUtf8(data.constData() + pos, qsizetype(size));
+        pos += qsizetype(size);
+        return text;
+    }
+};
+
+static bool isMouseKind(quint8 kind)
+{
+    return kind >= MousePress && kind <= MouseMove;
+}
+
+static QEvent::Type eventType(quint8 kind)
+{
+    switch (kind)
+    {
+    case MousePress:
+        return QEvent::MouseButtonPress;
+    case MouseRelease:
+        return QEvent::MouseButtonRelease;
+    case MouseDoubleClick:
+        return QEvent::MouseButtonDblClick;
+    case MouseMove:
+        return QEvent::MouseMove;
+    case Wheel:
+        return QEvent::Wheel;
+    case KeyPress:
+        return QEvent::KeyPress;
+    case KeyRelease:
+        return QEvent::KeyRelease;
+    }
+    return QEvent::None;
+}
+
+static quint8 recordKind(QEvent::Type type)
+{
+    switch (type)
+    {
+    case QEvent::MouseButtonPress:
+        return MousePress;
+    case QEvent::MouseButtonRelease:
+        return MouseRelease;
+    case QEvent::MouseButtonDblClick:
+        return MouseDoubleClick;
+    case QEvent::MouseMove:
+        return MouseMove;
+    case QEvent::Wheel:
+        return Wheel;
+    case QEvent::KeyPress:
+        return KeyPress;
+    case QEvent::KeyRelease:
+        return KeyRelease;
+    default:
+        return 0;
+    }
+}
+
+void WindowRegistry::noteShown(QWidget *window)
+{
+    for (const Entry &entry : shown)
+    {
+        if (entry.widget == window)
+        {
+            return;
+        }
+    }
+    // Destroyed windows keep their place so later ordinals stay put
+    Entry entry{window, {window->metaObject()->className(), window->objectName(), 0}};
+    for (const Entry &earlier : shown)
+    {
+        if (earlier.key.className == entry.key.className && earlier.key.objectName == entry.key.objectName)
+        {
+            ++entry.key.ordinal;
+        }
+    }
+    shown.append(entry);
+}
+
+QWidget *WindowRegistry::widgetFor(QWindow *window) const
+{
+    for (const Entry &entry : shown)
+    {
+        if (entry.widget && entry.widget->windowHandle() == window)
+        {
+            return entry.widget;
+        }
+    }
+    return nullptr;
+}
+
+WindowRegistry::Key WindowRegistry::keyOf(QWidget *window) const
+{
+    for (const Entry &entry : shown)
+    {
+        if (entry.widget == window)
+        {
+            return entry.key;
+        }
+    }
+    return Key();
+}
+
+QWidget *WindowRegistry::find(const Key &key) const
+{
+    for (const Entry &entry : shown)
+    {
+        if (entry.key.ordinal == key.ordinal && entry.key.className == key.className && entry.key.objectName == key.objectName)
+        {
+            return entry.widget;
+        }
+    }
+    return nullptr;
+}
+
+EventRecorder *EventRecorder::instance()
+{
+    static EventRecorder *recorder = []() -> EventRecorder *
+    {
+        QString path = qEnvironmentVariable("D0_RECORD_EVENTS");
+        if (path.isEmpty())
+        {
+            return nullptr;
+        }
+        EventRecorder *r = new EventRecorder(path);
+        if (!r->file.isOpen())
+        {
+            delete r;
+            return nullptr;
+        }
+        return r;
+    }();
+    return recorder;
+}
+
+EventRecorder::EventRecorder(const QString &path) : file(path)
+{
+    // Unbuffered: input arrives at human rates and a crash keeps the session
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Unbuffered))
+    {
+        qWarning() << "EventRecorder: cannot open" << path;
+        return;
+    }
+    QByteArray header;
+    for (int shift = 24; shift >= 0; shift -= 8)
+    {
+        header.append(char(Magic >> shift));
+    }
+    header.append(char(Version));
+    file.write(header);
+    clock.start();
+}
+
+void EventRecorder::record(QObject *receiver, QEvent *event)
+{
+    if (event->type() == QEvent::Show)
+    {
+        if (receiver->isWidgetType() && static_cast<QWidget *>(receiver)->isWindow())
+        {
+            windows.noteShown(static_cast<QWidget *>(receiver));
+        }
+        return;
+    }
+
+    // Input reaches the QWindow first and is then routed to widgets; recording
+    // it there keeps one record per user action and replays the routing too
+    quint8 kind = recordKind(event->type());
+    if (!kind || !event->spontaneous() || !receiver->isWindowType())
+    {
+        return;
+    }
+    QWidget *window = windows.widgetFor(static_cast<QWindow *>(receiver));
+    if (!window)
+    {
+        return; // a QWindow with no widget behind it
+    }
+
+    QByteArray record;
+    qint64 nowMs = clock.elapsed();
+    auto header = [&](quint8 recordKind)
+    {
+        record.append(char(recordKind));
+        writeVarint(record, quint64(nowMs - lastMs));
+        lastMs = nowMs;
+    };
+
+    WindowRegistry::Key key = windows.keyOf(window);
+    QString name = QString("%1/%2#%3").arg(QString::fromLatin1(key.className), key.objectName).arg(key.ordinal);
+    int id = windowIds.value(name, -1);
+    if (id < 0)
+    {
+        id = windowIds.size();
+        windowIds.insert(name, id);
+        header(WindowDefinition);
+        writeVarint(record, id);
+        writeString(record, QString::fromLatin1(key.className));
+        writeString(record, key.objectName);
+        writeVarint(record, key.ordinal);
+    }
+
+    header(kind);
+    writeVarint(record, id);
+    if (isMouseKind(kind))
+    {
+        QMouseEvent *mouse = static_cast<QMouseEvent *>(event);
+        QPoint pos = mouse->position().toPoint();
+        writeSigned(record, pos.x());
+        writeSigned(record, pos.y());
+        writeVarint(record, mouse->button());
+        writeVarint(record, mouse->buttons().toInt());
+        writeVarint(record, mouse->modifiers().toInt());
+    }
+    else if (kind == Wheel)
+    {
+        QWheelEvent *wheel = static_cast<QWheelEvent *>(event);
+        QPoint pos = wheel->position().toPoint();
+        writeSigned(record, pos.x());
+        writeSigned(record, pos.y());
+        writeSigned(record, wheel->angleDelta().x());
+        writeSigned(record, wheel->angleDelta().y());
+        writeVarint(record, wheel->buttons().toInt());
+        writeVarint(record, wheel->modifiers().toInt());
+    }
+    else
+    {
+        QKeyEvent *key = static_cast<QKeyEvent *>(event);
+        writeVarint(record, quint64(key->key()));
+        writeVarint(record, key->modifiers().toInt());
+        writeString(record, key->text());
+        record.append(char(key->isAutoRepeat()));
+    }
+    file.write(record);
+}
+
+EventReplayer *EventReplayer::instance()
+{
+    static EventReplayer *replayer = []() -> EventReplayer *
+    {
+        QString path = qEnvironmentVariable("D0_REPLAY_EVENTS");
+        return path.isEmpty() ? nullptr : new EventReplayer(path);
+    }();
+    return replayer;
+}
+
+EventReplayer::EventReplayer(const QString &path)
+    : path(path), csvPath(qEnvironmentVariable("D0_REPLAY_REPORT"))
+{
+    bool ok = false;
+    double factor = qEnvironmentVariable("D0_REPLAY_SPEED").toDouble(&ok);
+    if (ok && factor >= 0)
+    {
+        speed = factor;
+    }
+}
+
+bool EventReplayer::load()
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        qWarning() << "EventReplayer: cannot open" << path;
+        return false;
+    }
+    QByteArray data = file.readAll();
+    quint32 magic = 0;
+    for (int i = 0; i < 4 && i < data.size(); ++i)
+    {
+        magic = (magic << 8) | quint8(data.at(i));
+    }
+    if (data.size() < 5 || magic != Magic || quint8(data.at(4)) != Version)
+    {
+        qWarning() << "EventReplayer: not an event recording:" << path;
+        return false;
+    }
+
+    RecordReader in{data, 5};
+    qint64 atMs = 0;
+    while (in.ok && in.pos < data.size())
+    {
+        Input input;
+        input.kind = quint8(data.at(in.pos++));
+        atMs += qint64(in.varint());
+        input.atMs = atMs;
+        if (input.kind == WindowDefinition)
+        {
+            int id = int(in.varint());
+            WindowRegistry::Key key;
+            key.className = in.string().toLatin1();
+            key.objectName = in.string();
+            key.ordinal = int(in.varint());
+            windowKeys.insert(id, key);
+            continue;
+        }
+        input.window = int(in.varint());
+        if (isMouseKind(input.kind) || input.kind == Wheel)
+        {
+            input.pos.setX(int(in.signedVarint()));
+            input.pos.setY(int(in.signedVarint()));
+            if (input.kind == Wheel)
+            {
+                input.angleDelta.setX(int(in.signedVarint()));
+                input.angleDelta.setY(int(in.signedVarint()));
+            }
+            else
+            {
+                input.button = int(in.varint());
+            }
+            input.buttons = int(in.varint());
+            input.modifiers = int(in.varint());
+        }
+        else if (input.kind == KeyPress || input.kind == KeyRelease)
+        {
+            input.key = int(in.varint());
+            input.modifiers = int(in.varint());
+            input.text = in.string();
+            input.autoRepeat = in.pos < data.size() && data.at(in.pos++);
+        }
+        else
+        {
+            in.ok = false;
+        }
+        if (in.ok)
+        {
+            inputs.append(input);
+        }
+    }
+    if (!in.ok)
+    {
+        // A recording cut short by a crash still replays up to the damage
+        qWarning() << "EventReplayer: corrupt record after" << inputs.size() << "events in" << path;
+    }
+    return true;
+}
+
+void EventReplayer::start()
+{
+    if (!load())
+    {
+        QTimer::singleShot(0, qApp, []()
+                           { qApp->exit(1); });
+        return;
+    }
+    clock.start();
+    scheduleNext();
+}
+
+void EventReplayer::scheduleNext()
+{
+    if (next >= inputs.size())
+    {
+        QTimer::singleShot(DrainMs, qApp, [this]()
+                           { finish(); });
+        return;
+    }
+    // Lateness is measured against the later of the recorded time and now,
+    // so a slow recording does not count as a stall on replay
+    double nowMs = clock.nsecsElapsed() / 1e6;
+    plannedMs = qMax(nowMs, inputs.at(next).atMs * speed);
+    QTimer::singleShot(int(plannedMs - nowMs), Qt::PreciseTimer, qApp, [this]()
+                       {
+                           double lateMs = clock.nsecsElapsed() / 1e6 - plannedMs;
+                           if (lateMs > StallMs)
+                           {
+                               stallMs.append(lateMs);
+                           }
+                           dispatch(inputs.at(next++));
+                           scheduleNext();
+                       });
+}
+
+void EventReplayer::dispatch(const Input &input)
+{
+    QWidget *widget = windows.find(windowKeys.value(input.window));
+    QWindow *window = widget ? widget->windowHandle() : nullptr;
+    if (!window)
+    {
+        ++skipped;
+        return;
+    }
+
+    Qt::KeyboardModifiers modifiers(input.modifiers);
+    Qt::MouseButtons buttons(input.buttons);
+    QEvent::Type type = eventType(input.kind);
+    QElapsedTimer handler;
+    handler.start();
+    if (isMouseKind(input.kind))
+    {
+        QMouseEvent event(type, input.pos, window->mapToGlobal(input.pos), Qt::MouseButton(input.button), buttons, modifiers);
+        QApplication::sendEvent(window, &event);
+    }
+    else if (input.kind == Wheel)
+    {
+        QWheelEvent event(input.pos, window->mapToGlobal(input.pos), QPoint(), input.angleDelta,
+                          buttons, modifiers, Qt::NoScrollPhase, false);
+        QApplication::sendEvent(window, &event);
+    }
+    else
+    {
+        QKeyEvent event(type, input.key, modifiers, input.text, input.autoRepeat);
+        QApplication::sendEvent(window, &event);
+    }
+
+    // Moves and releases follow from the action that started them; only
+    // time the ones a user waits on
+    if (input.kind == MousePress || input.kind == MouseDoubleClick || input.kind == Wheel || input.kind == KeyPress)
+    {
+        Interaction interaction;
+        interaction.kind = input.kind;
+        interaction.handlerMs = handler.nsecsElapsed() / 1e6;
+        interaction.sentMs = clock.nsecsElapsed() / 1e6 - interaction.handlerMs;
+        if (awaitingFrame < 0)
+        {
+            awaitingFrame = interactions.size();
+        }
+        interactions.append(interaction);
+    }
+}
+
+void EventReplayer::observe(QObject *receiver, QEvent *event)
+{
+    if (event->type() == QEvent::Show && receiver->isWidgetType() && static_cast<QWidget *>(receiver)->isWindow())
+    {
+        windows.noteShown(static_cast<QWidget *>(receiver));
+    }
+    else if (event->type() == QEvent::Paint)
+    {
+        if (inFrame)
+        {
+            paintedInFrame = true;
+        }
+        else if (receiver->isWidgetType())
+        {
+            framePainted(); // synchronous repaint() outside an UpdateRequest
+        }
+    }
+}
+
+void EventReplayer::beginFrame()
+{
+    inFrame = true;
+    paintedInFrame = false;
+    frameTimer.start();
+}
+
+void EventReplayer::endFrame()
+{
+    if (!inFrame)
+    {
+        return;
+    }
+    inFrame = false;
+    if (paintedInFrame)
+    {
+        frameMs.append(frameTimer.nsecsElapsed() / 1e6);
+        framePainted();
+    }
+}
+
+void EventReplayer::framePainted()
+{
+    if (awaitingFrame < 0)
+    {
+        return;
+    }
+    double nowMs = clock.nsecsElapsed() / 1e6;
+    for (int i = awaitingFrame; i < interactions.size(); ++i)
+    {
+        interactions[i].latencyMs = nowMs - interactions.at(i).sentMs;
+    }
+    awaitingFrame = -1;
+}
+
+static QString summary(QVector<double> values)
+{
+    if (values.isEmpty())
+    {
+        return "none";
+    }
+    std::sort(values.begin(), values.end());
+    auto percentile = [&values](double p)
+    { return values.at(qMin(values.size() - 1, int(p * values.size()))); };
+    return QString("%1, p50 %2 ms, p95 %3 ms, max %4 ms")
+        .arg(values.size())
+        .arg(percentile(0.50), 0, 'f', 2)
+        .arg(percentile(0.95), 0, 'f', 2)
+        .arg(values.last(), 0, 'f', 2);
+}
+
+void EventReplayer::finish()
+{
+    QVector<double> handlerMs;
+    QVector<double> latencyMs;
+    for (const Interaction &interaction : interactions)
+    {
+        handlerMs.append(interaction.handlerMs);
+        if (interaction.latencyMs >= 0)
+        {
+            latencyMs.append(interaction.latencyMs);
+        }
+    }
+    int longFrames = int(std::count_if(frameMs.cbegin(), frameMs.cend(), [](double ms)
+                                       { return ms > StallMs; }));
+
+    qDebug().noquote() << QString("EventReplayer [%1]: %2 events (%3 skipped) in %4 ms")
+                              .arg(QGuiApplication::platformName())
+                              .arg(inputs.size())
+                              .arg(skipped)
+                              .arg(clock.elapsed());
+    qDebug().noquote() << "  handler:" << summary(handlerMs);
+    qDebug().noquote() << "  input to frame:" << summary(latencyMs);
+    qDebug().noquote() << "  frames:" << summary(frameMs) << QString("(%1 over %2 ms)").arg(longFrames).arg(StallMs);
+    qDebug().noquote() << "  stalls:" << summary(stallMs);
+
+    if (!csvPath.isEmpty())
+    {
+        QFile csv(csvPath);
+        if (csv.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+        {
+            csv.write("kind,sent_ms,handler_ms,latency_ms\n");
+            for (const Interaction &interaction : interactions)
+            {
+                csv.write(QByteArray::number(interaction.kind) + ',' + QByteArray::number(interaction.sentMs, 'f', 3) + ',' +
+                          QByteArray::number(interaction.handlerMs, 'f', 3) + ',' + QByteArray::number(interaction.latencyMs, 'f', 3) + '\n');
+            }
+        }
+        else
+        {
+            qWarning() << "EventReplayer: cannot write" << csvPath;
+        }
+    }
+    qApp->exit(0);
+}
@@ -0,0 +1,132 @@
+#ifndef EVENTRECORDER_H
+#define EVENTRECORDER_H
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QPoint>
+#include <QPointer>
+#include <QString>
+#include <QVector>
+
+class QEvent;
+class QWidget;
+class QWindow;
+
+// Input recording and replay for UI performance regression tests. Both hook
+// CustomApplication::notify and are switched on by environment variables:
+//
+//   D0_RECORD_EVENTS=session.d0ev   record spontaneous input to the file
+//   D0_REPLAY_EVENTS=session.d0ev   replay it, print a report and quit
+//   D0_REPLAY_SPEED=0               (optional) no pauses between events
+//   D0_REPLAY_REPORT=out.csv        (optional) one line per interaction
+//
+// Replay runs on the offscreen platform unless QT_QPA_PLATFORM is set.
+// Windows are identified by class, object name and the order in which they
+// were first shown, so a session that opens overlays replays into the
+// overlays the replay opens.
+
+// Identity of top-level widgets that is stable across runs
+class WindowRegistry
+{
+public:
+    struct Key
+    {
+        QByteArray className;
+        QString objectName;
+        int ordinal = 0;
+    };
+
+    void noteShown(QWidget *window);
+    QWidget *widgetFor(QWindow *window) const;
+    Key keyOf(QWidget *window) const;
+    QWidget *find(const Key &key) const;
+
+private:
+    struct Entry
+    {
+        QPointer<QWidget> widget; // null once destroyed
+        Key key;
+    };
+    QVector<Entry> shown; // in order of first show
+};
+
+class EventRecorder
+{
+public:
+    // nullptr unless D0_RECORD_EVENTS is set
+    static EventRecorder *instance();
+
+    void record(QObject *receiver, QEvent *event);
+
+private:
+    explicit EventRecorder(const QString &path);
+
+    QFile file;
+    QElapsedTimer clock;
+    qint64 lastMs = 0;
+    WindowRegistry windows;
+    QHash<QString, int> windowIds; // window keys already defined in the file
+};
+
+class EventReplayer
+{
+public:
+    // nullptr unless D0_REPLAY_EVENTS is set
+    static EventReplayer *instance();
+
+    void start();
+    void observe(QObject *receiver, QEvent *event);
+    void beginFrame();
+    void endFrame(); // after an UpdateRequest has been delivered
+
+private:
+    struct Input
+    {
+        quint8 kind = 0;
+        qint64 atMs = 0; // since the start of the recording
+        int window = 0;
+        QPoint pos;
+        QPoint angleDelta;
+        int button = 0;
+        int buttons = 0;
+        int modifiers = 0;
+        int key = 0;
+        QString text;
+        bool autoRepeat = false;
+    };
+    struct Interaction
+    {
+        quint8 kind = 0;
+        double sentMs = 0;
+        double handlerMs = 0;  // inside notify
+        double latencyMs = -1; // until the next frame has been painted
+    };
+
+    explicit EventReplayer(const QString &path);
+    bool load();
+    void scheduleNext();
+    void dispatch(const Input &input);
+    void framePainted();
+    void finish();
+
+    QString path;
+    QString csvPath;
+    QVector<Input> inputs;
+    QHash<int, WindowRegistry::Key> windowKeys;
+    int next = 0;
+    double speed = 1.0;
+    QElapsedTimer clock;
+    double plannedMs = 0; // when the pending dispatch should run
+    QElapsedTimer frameTimer;
+    bool inFrame = false;
+    bool paintedInFrame = false;
+    WindowRegistry windows;
+    QVector<Interaction> interactions;
+    int awaitingFrame = -1; // first interaction waiting for a frame
+    QVector<double> frameMs;
+    QVector<double> stallMs; // dispatches that ran late by more than StallMs
+    int skipped = 0;         // events for windows that never appeared
+};
+
+#endif // EVENTRECORDER_H
@@ -0,0 +1,403 @@
+#include "filesearch.h"
+#include "bytescan.h"
+#include "stats.h"
+#include <QCoreApplication>
+#include <QPointer>
+#include <QThread>
+#include <algorithm>
+#include <cstring>
+
+static const int MaxHits = 100000;
+static const int BatchHits = 256;
+static const int BatchIntervalMs = 50;
+
+struct FileSearch::Job
+{
+    QFile file;
+    const char *data = nullptr;
+    qint64 size = 0;
+    QByteArray literal; // lower-cased when the search ignores case
+    int rareIndex = 0;
+    uchar rareLower = 0;
+    uchar rareUpper = 0; // == rareLower unless it is a letter and case is ignored
+    bool caseInsensitive = false;
+    bool literalIsMatch = false; // a case-sensitive literal search needs no regex
+    QString pattern;
+    QRegularExpression::PatternOptions options;
+    std::atomic<bool> cancelled{false};
+    std::atomic<int> hits{0};
+    QPointer<FileSearch> owner;
+    int generation = 0;
+
+    ~Job()
+    {
+        if (data)
+        {
+            file.unmap(reinterpret_cast<uchar *>(const_cast<char *>(data)));
+        }
+    }
+};
+
+FileSearch::FileSearch(QObject *parent) : QObject(parent)
+{
+    pool.setMaxThreadCount(QThread::idealThreadCount());
+}
+
+FileSearch::~FileSearch()
+{
+    cancel();
+    pool.waitForDone();
+}
+
+void FileSearch::cancel()
+{
+    if (job)
+    {
+        job->cancelled = true;
+    }
+    ++generation;
+    remaining = 0;
+}
+
+// Rough frequency of each byte in text and logs; lower is rarer
+static int byteFrequency(uchar c)
+{
+    static const char english[] = "etaoinsrhldcumfpgwybvkxjqz";
+    if (c == ' ')
+    {
+        return 255;
+    }
+    if (c >= 'a' && c <= 'z')
+    {
+        return 220 - 5 * int(strchr(english, c) - english);
+    }
+    if (c >= 'A' && c <= 'Z')
+    {
+        return 100 - 2 * int(strchr(english, c - 'A' + 'a') - english);
+    }
+    if (c >= '0' && c <= '9')
+    {
+        return 120;
+    }
+    if (strchr(".,-_:/=\"'()[]", c) && c)
+    {
+        return 110;
+    }
+    if (c >= 0x80)
+    {
+        return 40;
+    }
+    return c < 0x20 ? 20 : 60;
+}
+
+int FileSearch::rarestByte(const QByteArray &literal)
+{
+    int best = 0;
+    for (int i = 1; i < literal.size(); ++i)
+    {
+        if (byteFrequency(uchar(literal[i])) < byteFrequency(uchar(literal[best])))
+        {
+            best = i;
+        }
+    }
+    return best;
+}
+
+QByteArray FileSearch::requiredLiteral(const QString &pattern, bool caseInsensitive)
+{
+    // Inline options and lookarounds can change what is required; stay safe
+    if (pattern.contains("(?"))
+    {
+        return QByteArray();
+    }
+
+    QByteArray best;
+    QByteArray run;
+    int lastBytes = 0; // size of the last character in run, 0 if it can't be dropped
+    int depth = 0;
+    auto endRun = [&]()
+    {
+        if (run.size() > best.size())
+        {
+            best = run;
+        }
+        run.clear();
+        lastBytes = 0;
+    };
+
+    for (int i = 0; i < pattern.size(); ++i)
+    {
+        QChar c = pattern.at(i);
+        if (c == '\\' && i + 1 < pattern.size())
+        {
+            c = pattern.at(++i);
+            if (c.isLetterOrNumber())
+            {
+                endRun(); // \d, \w, \b, back-references...
+                continue;
+            }
+        }
+        else if (c == '|')
+        {
+            return QByteArray(); // any branch may match instead
+        }
+        else if (c == '[')
+        {
+            endRun();
+            int j = i + 1;
+            if (j < pattern.size() && pattern.at(j) == '^')
+            {
+                ++j;
+            }
+            if (j < pattern.size() && pattern.at(j) == ']')
+            {
+                ++j;
+            }
+            while (j < pattern.size() && pattern.at(j) != ']')
+            {
+                j += pattern.at(j) == '\\' ? 2 : 1;
+            }
+            i = j;
+            continue;
+        }
+        else if (c == '(' || c == ')')
+        {
+            depth += c == '(' ? 1 : -1;
+            endRun();
+            continue;
+        }
+        else if (c == '.' || c == '^' || c == '$')
+        {
+            endRun();
+            continue;
+        }
+        else if (c == '?' || c == '*' || c == '{')
+        {
+            // The previous character may be absent
+            run.chop(lastBytes);
+            endRun();
+            if (c == '{')
+            {
+                while (i < pattern.size() && pattern.at(i) != '}')
+                {
+                    ++i;
+                }
+            }
+            continue;
+        }
+        else if (c == '+')
+        {
+            endRun();
+            continue;
+        }
+
+        if (depth > 0)
+        {
+            continue; // a group may be optional or repeated as a whole
+        }
+        if (caseInsensitive && c.unicode() >= 0x80)
+        {
+            endRun(); // only ASCII case folding is done in the prefilter
+            continue;
+        }
+        QByteArray bytes = QString(c).toUtf8();
+        run += caseInsensitive ? bytes.toLower() : bytes;
+        lastBytes = bytes.size();
+    }
+    endRun();
+    return best;
+}
+
+void FileSearch::start(const QString &path, const QString &pattern, bool regex, Qt::CaseSensitivity cs)
+{
+    cancel();
+    hitCount = 0;
+    clock.start();
+
+    job = std::make_shared<Job>();
+    job->owner = this;
+    job->generation = generation;
+    job->caseInsensitive = cs == Qt::CaseInsensitive;
+    job->pattern = regex ? pattern : QRegularExpression::escape(pattern);
+    job->options = job->caseInsensitive ? QRegularExpression::CaseInsensitiveOption : QRegularExpression::NoPatternOption;
+    if (regex)
+    {
+        job->literal = requiredLiteral(pattern, job->caseInsensitive);
+    }
+    else
+    {
+        QByteArray bytes = pattern.toUtf8();
+        bool ascii = std::all_of(bytes.begin(), bytes.end(), [](char c)
+                                 { return uchar(c) < 0x80; });
+        job->literal = !job->caseInsensitive ? bytes : ascii ? bytes.toLower() : QByteArray();
+        job->literalIsMatch = !job->caseInsensitive && !bytes.isEmpty();
+    }
+    if (!job->literal.isEmpty())
+    {
+        job->rareIndex = rarestByte(job->literal);
+        job->rareLower = uchar(job->literal.at(job->rareIndex));
+        job->rareUpper = job->caseInsensitive ? (job->rareLower >= 'a' && job->rareLower <= 'z' ? job->rareLower - 32 : job->rareLower) : job->rareLower;
+    }
+
+    job->file.setFileName(path);
+    job->size = job->file.open(QIODevice::ReadOnly) ? job->file.size() : 0;
+    job->data = job->size > 0 ? reinterpret_cast<const char *>(job->file.map(0, job->size)) : nullptr;
+    if (!job->data || pattern.isEmpty())
+    {
+        emit finished(0, 0, 0);
+        return;
+    }
+
+    // Cut at line starts so every line is searched by exactly one worker
+    int parts = pool.maxThreadCount();
+    QVector<qint64> bounds{0};
+    for (int i = 1; i < parts; ++i)
+    {
+        qint64 nominal = qMax(bounds.last(), job->size * i / parts);
+        const char *newline = ByteScan::find(job->data + nominal, job->data + job->size, '\n');
+        bounds.append(qMin(job->size, qint64(newline - job->data) + 1));
+    }
+    bounds.append(job->size);
+
+    remaining = parts;
+    for (int i = 0; i < parts; ++i)
+    {
+        std::shared_ptr<Job> shared = job;
+        qint64 begin = bounds[i];
+        qint64 end = bounds[i + 1];
+        pool.start([shared, begin, end]()
+                   {
+                       searchRange(shared, begin, end);
+                       QMetaObject::invokeMethod(qApp, [owner = shared->owner, forGeneration = shared->generation]()
+                                                 {
+                                                     if (owner)
+                                                     {
+                                                         owner->onRangeDone(forGeneration);
+                                                     }
+                                                 }, Qt::QueuedConnection);
+                   });
+    }
+}
+
+void FileSearch::searchRange(const std::shared_ptr<Job> &job, qint64 begin, qint64 end)
+{
+    const char *rangeStart = job->data + begin;
+    const char *rangeEnd = job->data + end;
+    QRegularExpression expression(job->pattern, job->options);
+    const QByteArray &literal = job->literal;
+
+    QVector<SearchHit> batch;
+    QElapsedTimer sinceFlush;
+    sinceFlush.start();
+    auto flush = [&]()
+    {
+        if (batch.isEmpty())
+        {
+            return;
+        }
+        QMetaObject::invokeMethod(qApp, [owner = job->owner, forGeneration = job->generation, batch]()
+                                  {
+                                      if (owner && owner->generation == forGeneration)
+                                      {
+                                          owner->hitCount += batch.size();
+                                          emit owner->hitsFound(batch);
+                                      }
+                                  }, Qt::QueuedConnection);
+        batch.clear();
+        sinceFlush.restart();
+    };
+    auto stopped = [&]()
+    {
+        return job->cancelled.load(std::memory_order_relaxed) || job->hits.load(std::memory_order_relaxed) >= MaxHits;
+    };
+    // Checks one line and records it if it matches
+    auto consider = [&](const char *lineStart, const char *lineEnd)
+    {
+        const char *textEnd = lineEnd > lineStart && lineEnd[-1] == '\r' ? lineEnd - 1 : lineEnd;
+        if (!job->literalIsMatch && !expression.match(QString::fromUtf8(lineStart, textEnd - lineStart)).hasMatch())
+        {
+            return;
+        }
+        job->hits.fetch_add(1, std::memory_order_relaxed);
+        batch.append(SearchHit{lineStart - job->data, QString::fromUtf8(lineStart, qMin<qint64>(textEnd - lineStart, MaxLineBytes))});
+        if (batch.size() >= BatchHits || sinceFlush.elapsed() >= BatchIntervalMs)
+        {
+            flush();
+        }
+    };
+    auto literalAt = [&](const char *p)
+    {
+        if (!job->caseInsensitive)
+        {
+            return memcmp(p, literal.constData(), literal.size()) == 0;
+        }
+        for (int i = 0; i < literal.size(); ++i)
+        {
+            uchar c = uchar(p[i]);
+            if ((c >= 'A' && c <= 'Z' ? c + 32 : c) != uchar(literal[i]))
+            {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    int checks = 0;
+    if (literal.isEmpty())
+    {
+        // No prefilter: every line goes through the expression
+        for (const char *line = rangeStart; line < rangeEnd && !((++checks & 1023) == 0 && stopped());)
+        {
+            const char *lineEnd = ByteScan::find(line, rangeEnd, '\n');
+            consider(line, lineEnd);
+            line = lineEnd + 1;
+        }
+        flush();
+        return;
+    }
+
+    const int rareIndex = job->rareIndex;
+    const char *scan = rangeStart + rareIndex;
+    while (scan < rangeEnd && !((++checks & 1023) == 0 && stopped()))
+    {
+        // glibc memchr is vectorized; two candidate bytes use the SWAR scan
+        const char *candidate = job->rareLower == job->rareUpper
+                                    ? static_cast<const char *>(memchr(scan, job->rareLower, rangeEnd - scan))
+                                    : ByteScan::findEither(scan, rangeEnd, job->rareLower, job->rareUpper);
+        if (!candidate || candidate >= rangeEnd)
+        {
+            break;
+        }
+        const char *start = candidate - rareIndex;
+        if (start + literal.size() > rangeEnd || !literalAt(start))
+        {
+            scan = candidate + 1;
+            continue;
+        }
+        const char *lineStart = start;
+        while (lineStart > rangeStart && lineStart[-1] != '\n')
+        {
+            --lineStart;
+        }
+        const char *lineEnd = ByteScan::find(start + literal.size(), rangeEnd, '\n');
+        consider(lineStart, lineEnd);
+        scan = lineEnd + 1 + rareIndex; // one hit per line
+    }
+    flush();
+}
+
+void FileSearch::onRangeDone(int forGeneration)
+{
+    if (forGeneration != generation || remaining == 0)
+    {
+        return;
+    }
+    if (--remaining == 0)
+    {
+        qint64 elapsed = clock.elapsed();
+        Stats::instance()->add("search.runs");
+        Stats::instance()->set("search.mb_per_s", elapsed > 0 ? job->size / 1000 / elapsed : 0);
+        emit finished(hitCount, job->size, elapsed);
+        job.reset();
+    }
+}
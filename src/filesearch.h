@@ -0,0 +1,63 @@
+#ifndef FILESEARCH_H
+#define FILESEARCH_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QRegularExpression>
+#include <QThreadPool>
+#include <QVector>
+#include <atomic>
+#include <memory>
+
+struct SearchHit
+{
+    qint64 offset = 0; // where the matching line starts
+    QString text;      // the line, cut at MaxLineBytes
+};
+
+// Finds the lines of a memory-mapped file that match a literal or a regular
+// expression. The file is cut at line boundaries into one range per core.
+// Each worker looks for a literal the match must contain, using a SWAR or
+// memchr search for its rarest byte, and runs the expression only on lines
+// with a candidate. Hits are streamed out in small batches while the search
+// runs.
+class FileSearch : public QObject
+{
+    Q_OBJECT
+
+public:
+    static constexpr int MaxLineBytes = 512;
+
+    explicit FileSearch(QObject *parent = nullptr);
+    ~FileSearch() override;
+
+    // Cancels any search still running
+    void start(const QString &path, const QString &pattern, bool regex, Qt::CaseSensitivity cs);
+    void cancel();
+    bool isRunning() const { return remaining > 0; }
+
+    // A literal every match of pattern contains, or empty if none is obvious
+    static QByteArray requiredLiteral(const QString &pattern, bool caseInsensitive);
+    // The byte of literal least likely to occur in text, by a fixed table
+    static int rarestByte(const QByteArray &literal);
+
+signals:
+    void hitsFound(const QVector<SearchHit> &hits);
+    void finished(qint64 hits, qint64 bytes, qint64 elapsedMs);
+
+private:
+    struct Job; // shared by the workers of one search
+
+    void onRangeDone(int forGeneration);
+    static void searchRange(const std::shared_ptr<Job> &job, qint64 begin, qint64 end);
+
+    QThreadPool pool;
+    std::shared_ptr<Job> job;
+    int generation = 0;
+    int remaining = 0;
+    qint64 hitCount = 0;
+    QElapsedTimer clock;
+};
+
+#endif // FILESEARCH_H
@@ -0,0 +1,390 @@
+#include "filesummarizer.h"
+#include "bytescan.h"
+#include "chatclient.h"
+#include "requestbatcher.h"
+#include "stats.h"
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+static const int MaxConcurrent = 4;        // same as the outbound queue
+static const int SummaryTokens = 400;      // per summary request
+static const int ReduceFanIn = 8;          // summaries combined per request
+static const qint64 MaxFileBytes = 64LL * 1024 * 1024;
+static const int MaxCacheEntries = 20000;
+static const quint32 CacheMagic = 0x44305343;
+
+struct SummaryError
+{
+    QString message;
+};
+
+struct FileSummarizer::Level
+{
+    quint64 runId;
+    QStringList prompts;
+    QStringList results;
+    int next = 0;
+    int active = 0;
+    QString error;
+};
+
+// FNV-1a; decides where content-defined cuts fall
+static quint32 lineHash(const char *data, qint64 length)
+{
+    quint32 hash = 2166136261u;
+    for (qint64 i = 0; i < length; ++i)
+    {
+        hash = (hash ^ uchar(data[i])) * 16777619u;
+    }
+    return hash;
+}
+
+QVector<FileSummarizer::Chunk> FileSummarizer::chunkBoundaries(const char *data, qint64 size, int targetBytes)
+{
+    // A chunk ends after a line whose hash has its low bits clear, once it is
+    // at least half the target. With ~1/64 lines qualifying, typical text
+    // lands near the target; an edit moves only the cuts next to it.
+    const qint64 minBytes = targetBytes / 2;
+    const qint64 maxBytes = targetBytes * 4 / 3;
+    const quint32 cutMask = 63;
+
+    QVector<Chunk> chunks;
+    qint64 start = 0;
+    while (start < size)
+    {
+        qint64 limit = qMin(size, start + maxBytes);
+        qint64 cut = -1;
+        qint64 line = start;
+        while (line < limit)
+        {
+            qint64 lineEnd = ByteScan::find(data + line, data + limit, '\n') - data;
+            if (lineEnd >= limit)
+            {
+                break;
+            }
+            if (lineEnd + 1 - start >= minBytes && (lineHash(data + line, lineEnd - line) & cutMask) == 0)
+            {
+                cut = lineEnd + 1;
+                break;
+            }
+            line = lineEnd + 1;
+        }
+
+        if (cut < 0 && limit == size)
+        {
+            cut = size;
+        }
+        else if (cut < 0 && line > start)
+        {
+            cut = line; // last complete line that fits
+        }
+        else if (cut < 0)
+        {
+            // One huge line: break at a space, else between UTF-8 sequences
+            cut = limit;
+            while (cut > start + minBytes && data[cut - 1] != ' ' && data[cut - 1] != '\t')
+            {
+                --cut;
+            }
+            if (cut <= start + minBytes)
+            {
+                cut = limit;
+                while (cut > start + 1 && (uchar(data[cut]) & 0xc0) == 0x80)
+                {
+                    --cut;
+                }
+            }
+        }
+        chunks.append(Chunk{start, cut - start});
+        start = cut;
+    }
+    return chunks;
+}
+
+FileSummarizer::FileSummarizer(QObject *parent) : QObject(parent)
+{
+}
+
+FileSummarizer::~FileSummarizer()
+{
+    // Cancelling resumes the waiting coroutines right away. The owner may be
+    // half destroyed by now (the overlay deletes us from ~QWidget), so none
+    // of them may report: the run is no longer current and signals are off.
+    ++generation;
+    blockSignals(true);
+    cancel();
+}
+
+void FileSummarizer::cancel()
+{
+    cancellation.cancel();
+}
+
+void FileSummarizer::start(const QString &path, const QString &instructions)
+{
+    cancel();
+    cancellation = CancellationSource();
+    running = true;
+    requestsDone = 0;
+    requestsTotal = 0;
+    cachedCount = 0;
+    usedKeys.clear();
+    loadCache();
+    run(path, instructions, ++generation).start(cancellation.token());
+}
+
+Task<void> FileSummarizer::run(QString path, QString instructions, quint64 runId)
+{
+    QString name = QFileInfo(path).fileName();
+    QString focus = instructions.trimmed().isEmpty() ? QString() : "\nPay particular attention to: " + instructions.trimmed();
+    try
+    {
+        // Chunking reads the whole file, so it runs off the GUI thread
+        QStringList chunks = co_await runInPool([path]()
+                                                {
+                                                    QStringList texts;
+                                                    QFile file(path);
+                                                    if (!file.open(QIODevice::ReadOnly) || file.size() > MaxFileBytes)
+                                                    {
+                                                        return texts;
+                                                    }
+                                                    qint64 size = file.size();
+                                                    const uchar *data = size > 0 ? file.map(0, size) : nullptr;
+                                                    if (!data)
+                                                    {
+                                                        return texts;
+                                                    }
+                                                    const char *bytes = reinterpret_cast<const char *>(data);
+                                                    for (const Chunk &chunk : chunkBoundaries(bytes, size))
+                                                    {
+                                                        texts.append(QString::fromUtf8(bytes + chunk.offset, chunk.length));
+                                                    }
+                                                    return texts;
+                                                });
+        if (chunks.isEmpty())
+        {
+            throw SummaryError{tr("%1 is empty, unreadable or larger than %2 MB").arg(name).arg(MaxFileBytes >> 20)};
+        }
+
+        // The prompt leaves out the chunk's position so moved chunks still hit the cache
+        QStringList prompts;
+        for (const QString &chunk : chunks)
+        {
+            prompts.append(QString("Summarize this excerpt of the file %1. Keep names, numbers, errors and "
+                                   "decisions; leave out filler.%2\n\n%3")
+                               .arg(name, focus, chunk));
+        }
+        for (int n = prompts.size();; n = (n + ReduceFanIn - 1) / ReduceFanIn)
+        {
+            requestsTotal += n;
+            if (n == 1)
+            {
+                break;
+            }
+        }
+        emit progress(0, requestsTotal, 0);
+
+        QStringList summaries = co_await runLevel(prompts, runId);
+        while (summaries.size() > 1)
+        {
+            QStringList reducePrompts;
+            for (int i = 0; i < summaries.size(); i += ReduceFanIn)
+            {
+                QStringList group = summaries.mid(i, ReduceFanIn);
+                reducePrompts.append(QString("These are summaries of consecutive parts of the file %1, in order. "
+                                             "Combine them into one summary without repeating yourself.%2\n\n%3")
+                                         .arg(name, focus, group.join("\n\n---\n\n")));
+            }
+            summaries = co_await runLevel(reducePrompts, runId);
+        }
+
+        saveCache();
+        running = false;
+        Stats::instance()->add("summarize.runs");
+        emit finished(summaries.first(), QString());
+    }
+    catch (const TaskCancelled &)
+    {
+        // A run replaced by start() resumes after the new one began; the new one reports
+        if (runId == generation)
+        {
+            running = false;
+            emit finished(QString(), QString());
+        }
+    }
+    catch (const SummaryError &error)
+    {
+        saveCache(); // keep what was done for the next attempt
+        if (runId == generation)
+        {
+            running = false;
+            emit finished(QString(), error.message);
+        }
+    }
+}
+
+Task<QStringList> FileSummarizer::runLevel(QStringList prompts, quint64 runId)
+{
+    // Shared with the workers, which may outlive this frame when cancelled
+    auto level = std::make_shared<Level>();
+    level->runId = runId;
+    level->prompts = prompts;
+    for (int i = 0; i < prompts.size(); ++i)
+    {
+        level->results.append(QString());
+    }
+    // Batched requests share one HTTP request, so a whole batch can be waiting at once
+    int workers = ChatClient::instance()->isBatching() ? RequestBatcher::MaxRequests : MaxConcurrent;
+    for (int i = 0; i < qMin(workers, int(prompts.size())); ++i)
+    {
+        ++level->active;
+        levelWorker(level).start(cancellation.token());
+    }
+    while (level->active > 0)
+    {
+        co_await awaitSignal(this, &FileSummarizer::levelFinished);
+    }
+    if (!level->error.isEmpty())
+    {
+        throw SummaryError{level->error};
+    }
+    co_return level->results;
+}
+
+Task<void> FileSummarizer::levelWorker(std::shared_ptr<Level> level)
+{
+    try
+    {
+        while (level->next < level->prompts.size() && level->error.isEmpty())
+        {
+            // The endpoint may turn out not to take batches; the extra workers then retire
+            if (level->active > MaxConcurrent && !ChatClient::instance()->isBatching())
+            {
+                break;
+            }
+            int index = level->next++;
+            level->results[index] = co_await summarize(level->prompts.at(index));
+            if (!isCurrent(level->runId))
+            {
+                break; // a cached summary returns without noticing the cancel
+            }
+            ++requestsDone;
+            emit progress(requestsDone, requestsTotal, cachedCount);
+        }
+    }
+    catch (const TaskCancelled &)
+    {
+    }
+    catch (const SummaryError &error)
+    {
+        level->error = error.message;
+    }
+    if (--level->active == 0 && level->runId == generation)
+    {
+        emit levelFinished();
+    }
+}
+
+Task<QString> FileSummarizer::summarize(QString prompt)
+{
+    QByteArray key = QCryptographicHash::hash(prompt.toUtf8(), QCryptographicHash::Sha256);
+    usedKeys.insert(key);
+    auto cached = cache.constFind(key);
+    if (cached != cache.constEnd())
+    {
+        ++cachedCount;
+        Stats::instance()->add("summarize.cached");
+        co_return cached.value();
+    }
+
+    ChatRequest request;
+    request.prompt = prompt;
+    request.maxTokens = SummaryTokens;
+    request.background = true; // batched with the other requests of its level
+    request.stopOnRepetition = stopOnRepetition;
+    ChatStream *stream = ChatClient::instance()->send(request, this);
+    try
+    {
+        if (!stream->isFinished())
+        {
+            co_await awaitSignal(stream, &ChatStream::finished);
+        }
+    }
+    catch (const TaskCancelled &)
+    {
+        stream->abort();
+        stream->deleteLater();
+        throw;
+    }
+
+    stream->readText();
+    QString summary = stream->text().trimmed();
+    QString error = stream->hasError() ? stream->errorString() : QString();
+    stream->deleteLater();
+    if (!error.isEmpty())
+    {
+        throw SummaryError{error};
+    }
+    Stats::instance()->add("summarize.requests");
+    cache.insert(key, summary);
+    co_return summary;
+}
+
+static QString cachePath()
+{
+    QString dir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+    QDir().mkpath(dir);
+    return dir + "/summaries.cache";
+}
+
+void FileSummarizer::loadCache()
+{
+    if (cacheLoaded)
+    {
+        return;
+    }
+    cacheLoaded = true;
+    QFile file(cachePath());
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        return;
+    }
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_6_0);
+    quint32 magic = 0;
+    in >> magic;
+    if (magic == CacheMagic)
+    {
+        in >> cache;
+    }
+    if (in.status() != QDataStream::Ok)
+    {
+        cache.clear();
+    }
+}
+
+void FileSummarizer::saveCache()
+{
+    // Over the limit, keep only what the latest run used
+    if (cache.size() > MaxCacheEntries)
+    {
+        for (auto it = cache.begin(); it != cache.end();)
+        {
+            it = usedKeys.contains(it.key()) ? std::next(it) : cache.erase(it);
+        }
+    }
+    QSaveFile file(cachePath());
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        return;
+    }
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_6_0);
+    out << CacheMagic << cache;
+    file.commit();
+}
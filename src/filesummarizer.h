@@ -0,0 +1,71 @@
+#ifndef FILESUMMARIZER_H
+#define FILESUMMARIZER_H
+
+#include <QObject>
+#include <QHash>
+#include <QSet>
+#include <QVector>
+#include <memory>
+#include "task.h"
+
+// Summarizes a file too large for one request: the file is cut into chunks
+// at line ends, every chunk is summarized (several requests at a time), and
+// the summaries are combined in groups until one is left. Chunk boundaries
+// depend only on nearby content, so after an edit most chunks are the same
+// bytes as before and their summaries come from an on-disk cache.
+class FileSummarizer : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Chunk
+    {
+        qint64 offset;
+        qint64 length;
+    };
+
+    static const int ChunkBytes = 12000; // about 3000 tokens
+
+    explicit FileSummarizer(QObject *parent = nullptr);
+    ~FileSummarizer() override;
+
+    // instructions (may be empty) steer what the summary keeps
+    void start(const QString &path, const QString &instructions);
+    void cancel();
+    bool isRunning() const { return running; }
+    // Cut summaries that start looping (ChatRequest::stopOnRepetition); off by default
+    void setStopOnRepetition(bool enabled) { stopOnRepetition = enabled; }
+
+    static QVector<Chunk> chunkBoundaries(const char *data, qint64 size, int targetBytes = ChunkBytes);
+
+signals:
+    // requests counts model calls, done or cached, over an estimate of all of them
+    void progress(int requests, int total, int cached);
+    void finished(const QString &summary, const QString &error); // both empty when cancelled
+    void levelFinished(); // internal: the last worker of a level is done
+
+private:
+    struct Level; // the requests of one map or reduce round
+
+    Task<void> run(QString path, QString instructions, quint64 runId);
+    Task<QStringList> runLevel(QStringList prompts, quint64 runId);
+    Task<void> levelWorker(std::shared_ptr<Level> level);
+    Task<QString> summarize(QString prompt);
+    void loadCache();
+    void saveCache();
+    // False for a run that was cancelled, so its signals do not reach a newer one
+    bool isCurrent(quint64 runId) const { return runId == generation && !cancellation.isCancelled(); }
+
+    CancellationSource cancellation;
+    quint64 generation = 0; // id of the latest run
+    bool running = false;
+    bool stopOnRepetition = false;
+    int requestsDone = 0;
+    int requestsTotal = 0;
+    int cachedCount = 0;
+    QHash<QByteArray, QString> cache; // prompt hash -> summary
+    QSet<QByteArray> usedKeys;        // kept when the cache is trimmed
+    bool cacheLoaded = false;
+};
+
+#endif // FILESUMMARIZER_H
@@ -0,0 +1,270 @@
+#include "fileview.h"
+#include "bytescan.h"
+#include "stats.h"
+#include <QCoreApplication>
+#include <QFileInfo>
+#include <QFileSystemWatcher>
+#include <QFontDatabase>
+#include <QPainter>
+#include <QPointer>
+#include <QScrollBar>
+#include <QThreadPool>
+#include <algorithm>
+
+static const qint64 ScanBytes = 64 * 1024 * 1024; // per background scan
+static const int HeadBytes = 64;
+static const int MaxLineBytes = 4096; // drawn per line
+
+FileView::FileView(QWidget *parent)
+    : QAbstractScrollArea(parent), watcher(new QFileSystemWatcher(this))
+{
+    setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+    viewport()->setAttribute(Qt::WA_OpaquePaintEvent);
+    lineStarts.append(0);
+
+    connect(watcher, &QFileSystemWatcher::fileChanged, this, &FileView::onFileChanged);
+    connect(watcher, &QFileSystemWatcher::directoryChanged, this, &FileView::onDirectoryChanged);
+}
+
+void FileView::open(const QString &path)
+{
+    if (!watcher->files().isEmpty() || !watcher->directories().isEmpty())
+    {
+        watcher->removePaths(watcher->files() + watcher->directories());
+    }
+    file.close();
+    file.setFileName(path);
+    if (following)
+    {
+        watcher->addPath(path);
+        watcher->addPath(QFileInfo(path).absolutePath());
+    }
+    restart();
+}
+
+qint64 FileView::lineCount() const
+{
+    // The last line counts once it has any bytes, terminated or not
+    return indexedSize > lineStarts.last() ? lineStarts.size() : lineStarts.size() - 1;
+}
+
+void FileView::scrollToOffset(qint64 offset)
+{
+    qint64 line = std::upper_bound(lineStarts.cbegin(), lineStarts.cend(), offset) - lineStarts.cbegin() - 1;
+    QScrollBar *bar = verticalScrollBar();
+    bar->setValue(int(qBound<qint64>(0, line - bar->pageStep() / 2, bar->maximum())));
+}
+
+void FileView::setFollowing(bool enabled)
+{
+    if (following == enabled)
+    {
+        return;
+    }
+    following = enabled;
+    if (file.fileName().isEmpty())
+    {
+        return;
+    }
+    if (following)
+    {
+        // Watching the directory too catches the file being replaced
+        watcher->addPath(file.fileName());
+        watcher->addPath(QFileInfo(file.fileName()).absolutePath());
+        onFileChanged();
+        verticalScrollBar()->setValue(verticalScrollBar()->maximum());
+    }
+    else if (!watcher->files().isEmpty() || !watcher->directories().isEmpty())
+    {
+        watcher->removePaths(watcher->files() + watcher->directories());
+    }
+}
+
+void FileView::indexLines(const char *data, qint64 base, qint64 length, QVector<qint64> &starts)
+{
+    const char *end = data + length;
+    for (const char *p = ByteScan::find(data, end, '\n'); p < end; p = ByteScan::find(p + 1, end, '\n'))
+    {
+        starts.append(base + (p - data) + 1);
+    }
+}
+
+void FileView::onFileChanged()
+{
+    QString path = file.fileName();
+    if (!QFileInfo::exists(path))
+    {
+        return; // moved away or deleted; onDirectoryChanged sees the successor
+    }
+    // inotify drops the watch when the file is replaced
+    if (!watcher->files().contains(path))
+    {
+        watcher->addPath(path);
+    }
+    if (QFileInfo(path).size() < indexedSize || !isSameFile())
+    {
+        restart();
+        return;
+    }
+    scheduleIndex();
+}
+
+void FileView::onDirectoryChanged()
+{
+    if (QFileInfo::exists(file.fileName()))
+    {
+        onFileChanged();
+    }
+}
+
+// Rotation usually renames the file and creates a new one under the same
+// name; the new file's first bytes differ from the ones seen before
+bool FileView::isSameFile()
+{
+    if (head.isEmpty())
+    {
+        return true;
+    }
+    QFile current(file.fileName());
+    return current.open(QIODevice::ReadOnly) && current.read(head.size()) == head;
+}
+
+void FileView::restart()
+{
+    ++generation;
+    indexing = false;
+    lineStarts.clear();
+    lineStarts.append(0);
+    indexedSize = 0;
+    head.clear();
+    file.close();
+    file.open(QIODevice::ReadOnly);
+    updateScrollBar();
+    verticalScrollBar()->setValue(0);
+    viewport()->update();
+    emit lineCountChanged(0);
+    scheduleIndex();
+}
+
+void FileView::scheduleIndex()
+{
+    if (indexing || !file.isOpen())
+    {
+        return;
+    }
+    qint64 size = QFileInfo(file.fileName()).size();
+    if (size <= indexedSize)
+    {
+        return;
+    }
+
+    // One scan at a time keeps the offsets in file order
+    indexing = true;
+    QString path = file.fileName();
+    qint64 from = indexedSize;
+    qint64 to = qMin(size, from + ScanBytes);
+    int forGeneration = generation;
+    QPointer<FileView> guard(this);
+    QThreadPool::globalInstance()->start([guard, path, from, to, forGeneration]()
+                                         {
+                                             QVector<qint64> starts;
+                                             QFile input(path);
+                                             const uchar *data = input.open(QIODevice::ReadOnly) ? input.map(from, to - from) : nullptr;
+                                             qint64 scanned = from;
+                                             if (data)
+                                             {
+                                                 indexLines(reinterpret_cast<const char *>(data), from, to - from, starts);
+                                                 scanned = to;
+                                             }
+                                             QMetaObject::invokeMethod(qApp, [guard, forGeneration, scanned, starts]()
+                                                                       {
+                                                                           if (guard)
+                                                                           {
+                                                                               guard->onIndexed(forGeneration, scanned, starts);
+                                                                           }
+                                                                       }, Qt::QueuedConnection);
+                                         });
+}
+
+void FileView::onIndexed(int forGeneration, qint64 to, const QVector<qint64> &starts)
+{
+    if (forGeneration != generation)
+    {
+        return;
+    }
+    indexing = false;
+    if (to == indexedSize)
+    {
+        return; // the file could not be mapped; the next change retries
+    }
+
+    Stats::instance()->add("fileview.indexed_bytes", to - indexedSize);
+    QScrollBar *bar = verticalScrollBar();
+    bool atBottom = bar->value() == bar->maximum();
+    lineStarts += starts;
+    indexedSize = to;
+    if (head.size() < HeadBytes && file.seek(0))
+    {
+        head = file.read(HeadBytes);
+    }
+
+    updateScrollBar();
+    if (following && atBottom)
+    {
+        bar->setValue(bar->maximum());
+    }
+    viewport()->update();
+    emit lineCountChanged(lineCount());
+    scheduleIndex();
+}
+
+void FileView::updateScrollBar()
+{
+    int rows = qMax(1, viewport()->height() / fontMetrics().height());
+    verticalScrollBar()->setPageStep(rows);
+    verticalScrollBar()->setRange(0, int(qBound<qint64>(0, lineCount() - rows, INT_MAX)));
+}
+
+QByteArray FileView::lineAt(qint64 line)
+{
+    qint64 start = lineStarts.at(line);
+    qint64 end = line + 1 < lineStarts.size() ? lineStarts.at(line + 1) : indexedSize;
+    if (!file.seek(start))
+    {
+        return QByteArray();
+    }
+    QByteArray bytes = file.read(qMin<qint64>(end - start, MaxLineBytes));
+    while (bytes.endsWith('\n') || bytes.endsWith('\r'))
+    {
+        bytes.chop(1);
+    }
+    return bytes;
+}
+
+void FileView::paintEvent(QPaintEvent *)
+{
+    QPainter painter(viewport());
+    painter.fillRect(viewport()->rect(), palette().base());
+    painter.setPen(palette().text().color());
+
+    int lineHeight = fontMetrics().height();
+    int ascent = fontMetrics().ascent();
+    qint64 first = verticalScrollBar()->value();
+    qint64 last = qMin(lineCount(), first + viewport()->height() / lineHeight + 1);
+    for (qint64 line = first; line < last; ++line)
+    {
+        int y = int(line - first) * lineHeight;
+        painter.drawText(4, y + ascent, QString::fromUtf8(lineAt(line)));
+    }
+}
+
+void FileView::resizeEvent(QResizeEvent *event)
+{
+    QAbstractScrollArea::resizeEvent(event);
+    updateScrollBar();
+}
+
+void FileView::scrollContentsBy(int, int)
+{
+    viewport()->update();
+}
@@ -0,0 +1,61 @@
+#ifndef FILEVIEW_H
+#define FILEVIEW_H
+
+#include <QAbstractScrollArea>
+#include <QFile>
+#include <QVector>
+
+class QFileSystemWatcher;
+
+// Read-only view of a (possibly multi-GB) text file. Only an index of line
+// start offsets is kept in memory; visible lines are read on paint. In
+// follow mode the file is watched and the index is extended over appended
+// bytes only; truncation and rotation restart it from the beginning.
+class FileView : public QAbstractScrollArea
+{
+    Q_OBJECT
+
+public:
+    explicit FileView(QWidget *parent = nullptr);
+
+    void open(const QString &path);
+    QString path() const { return file.fileName(); }
+    qint64 lineCount() const;
+    // Shows the line containing a byte offset, once it is indexed
+    void scrollToOffset(qint64 offset);
+
+    bool isFollowing() const { return following; }
+    void setFollowing(bool enabled);
+
+    // Appends the offset just past every '\n' in data, which starts at base
+    static void indexLines(const char *data, qint64 base, qint64 length, QVector<qint64> &starts);
+
+signals:
+    void lineCountChanged(qint64 lines);
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+    void scrollContentsBy(int dx, int dy) override;
+
+private:
+    void onFileChanged();
+    void onDirectoryChanged();
+    void scheduleIndex();
+    void onIndexed(int forGeneration, qint64 to, const QVector<qint64> &starts);
+    void restart();
+    bool isSameFile();
+    void updateScrollBar();
+    QByteArray lineAt(qint64 line);
+
+    QFileSystemWatcher *watcher;
+    QFile file;
+    QVector<qint64> lineStarts; // lineStarts[i] is where line i begins
+    qint64 indexedSize = 0;
+    bool indexing = false;
+    int generation = 0; // bumped on restart so stale scans are dropped
+    QByteArray head;    // first bytes of the file, to recognise a replacement
+    bool following = false;
+};
+
+#endif // FILEVIEW_H
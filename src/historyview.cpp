@@ -0,0 +1,329 @@
+#include "historyview.h"
+#include "replyview.h"
+#include "stats.h"
+#include <QCache>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QPaintEvent>
+#include <QPainter>
+#include <QTimer>
+#include <algorithm>
+
+static const int RowSpacing = 6;
+static const qint64 DefaultCacheBytes = 64 * 1024 * 1024;
+
+struct RowKey
+{
+    quint64 id;
+    int width;
+    int dpr; // percent
+
+    bool operator==(const RowKey &other) const
+    {
+        return id == other.id && width == other.width && dpr == other.dpr;
+    }
+};
+
+static size_t qHash(const RowKey &key, size_t seed = 0)
+{
+    return qHashMulti(seed, key.id, key.width, key.dpr);
+}
+
+// Shared by every overlay; the cost of an entry is its size in bytes.
+// QPixmaps must go before QApplication does, so the cache is emptied on
+// aboutToQuit and never destroyed with the other statics.
+static QCache<RowKey, QPixmap> &rowCache()
+{
+    static QCache<RowKey, QPixmap> *cache = []()
+    {
+        auto *created = new QCache<RowKey, QPixmap>(DefaultCacheBytes);
+        QObject::connect(qApp, &QCoreApplication::aboutToQuit, qApp, [created]()
+                         { created->clear(); });
+        return created;
+    }();
+    return *cache;
+}
+
+static qint64 pixmapBytes(const QSize &size, qreal dpr)
+{
+    return qint64(size.width() * dpr) * qint64(size.height() * dpr) * 4;
+}
+
+HistoryView::HistoryView(QWidget *parent) : QWidget(parent)
+{
+    setSizePolicy(QSizePolicy::Preferred, QSizePolicy::Fixed);
+}
+
+HistoryView::Row HistoryView::makeRow(const ChatMessage &message)
+{
+    Row row;
+    row.id = message.id;
+    row.text = (message.role == "user" ? "You: " : "ChatGPT: ") + message.text;
+    // A dump of thousands of lines would be shaped and rasterized whole;
+    // history keeps its head and tail, the transcript store keeps the rest
+    if (ReplyView::isHuge(row.text))
+    {
+        row.text = ReplyView::collapsedPreview(row.text);
+    }
+    return row;
+}
+
+void HistoryView::prependMessages(const QList<ChatMessage> &messages)
+{
+    QVector<Row> older;
+    older.reserve(messages.size() + rows.size());
+    for (const ChatMessage &message : messages)
+    {
+        older.append(makeRow(message));
+        measure(older.last());
+    }
+    older += rows;
+    rows = std::move(older);
+    heightsChanged();
+}
+
+void HistoryView::appendMessage(const ChatMessage &message)
+{
+    rows.append(makeRow(message));
+    measure(rows.last());
+    if (topsDirty)
+    {
+        heightsChanged();
+        return;
+    }
+    // Restoring appends one row at a time; extend the offsets instead of redoing them
+    tops.append(tops.last() + rows.last().height);
+    updateTotalHeight();
+}
+
+int HistoryView::measure(Row &row) const
+{
+    int old = row.height;
+    int w = width();
+    if (w <= 0)
+    {
+        // Not laid out yet: one line each until the width is known
+        row.height = fontMetrics().height() + RowSpacing;
+        row.measured = false;
+        return row.height - old;
+    }
+    row.height = fontMetrics().boundingRect(QRect(0, 0, w, INT_MAX), Qt::TextWordWrap, row.text).height() + RowSpacing;
+    row.measured = true;
+    return row.height - old;
+}
+
+void HistoryView::heightsChanged()
+{
+    topsDirty = true;
+    updateTotalHeight();
+}
+
+void HistoryView::updateTotalHeight()
+{
+    int total = rowTops().last();
+    if (total != totalHeight)
+    {
+        totalHeight = total;
+        updateGeometry();
+    }
+    update();
+}
+
+const QVector<int> &HistoryView::rowTops() const
+{
+    if (topsDirty)
+    {
+        tops.resize(rows.size() + 1);
+        int y = 0;
+        for (int i = 0; i < rows.size(); ++i)
+        {
+            tops[i] = y;
+            y += rows.at(i).height;
+        }
+        tops[rows.size()] = y;
+        topsDirty = false;
+    }
+    return tops;
+}
+
+int HistoryView::rowAt(int y) const
+{
+    const QVector<int> &top = rowTops();
+    int index = int(std::upper_bound(top.cbegin(), top.cend() - 1, y) - top.cbegin()) - 1;
+    return qBound(0, index, qMax(0, rows.size() - 1));
+}
+
+QSize HistoryView::sizeHint() const
+{
+    return QSize(200, totalHeight);
+}
+
+QSize HistoryView::minimumSizeHint() const
+{
+    return QSize(0, totalHeight);
+}
+
+bool HistoryView::cachedPixmap(const Row &row, bool render, QPixmap *pixmap) const
+{
+    qreal dpr = devicePixelRatioF();
+    RowKey key{row.id, width(), int(dpr * 100)};
+    if (QPixmap *cached = rowCache().object(key))
+    {
+        *pixmap = *cached;
+        return true;
+    }
+    QSize size(width(), row.height);
+    qint64 bytes = pixmapBytes(size, dpr);
+    // A row bigger than an eighth of the cache would only evict everything else
+    if (!render || row.id == 0 || size.isEmpty() || bytes > rowCache().maxCost() / 8)
+    {
+        return false;
+    }
+
+    QPixmap rendered(size * dpr);
+    rendered.setDevicePixelRatio(dpr);
+    rendered.fill(Qt::transparent);
+    QPainter painter(&rendered);
+    painter.setFont(font());
+    painter.setPen(palette().color(QPalette::WindowText));
+    painter.drawText(QRect(0, 0, size.width(), size.height() - RowSpacing), Qt::TextWordWrap, row.text);
+    painter.end();
+
+    rowCache().insert(key, new QPixmap(rendered), bytes);
+    Stats::instance()->add("history.row_cache.misses");
+    Stats::instance()->set("history.row_cache.bytes", rowCache().totalCost());
+    *pixmap = rendered;
+    return true;
+}
+
+void HistoryView::drawRow(QPainter &painter, const Row &row, int top) const
+{
+    QPixmap pixmap;
+    if (cachedPixmap(row, true, &pixmap))
+    {
+        painter.drawPixmap(0, top, pixmap);
+        return;
+    }
+    // Too large to cache: shaped on every paint, clipped to what is exposed
+    painter.drawText(QRect(0, top, width(), row.height - RowSpacing), Qt::TextWordWrap, row.text);
+}
+
+void HistoryView::paintEvent(QPaintEvent *event)
+{
+    if (rows.isEmpty())
+    {
+        return;
+    }
+    QPainter painter(this);
+    painter.setPen(palette().color(QPalette::WindowText));
+    QRect dirty = event->rect();
+    bool remeasured = false;
+    const QVector<int> &top = rowTops();
+    for (int i = rowAt(dirty.top()); i < rows.size() && top.at(i) <= dirty.bottom(); ++i)
+    {
+        Row &row = rows[i];
+        if (!row.measured)
+        {
+            // Left estimated by a resize; fixed up after this frame
+            remeasured |= measure(row) != 0;
+        }
+        drawRow(painter, row, top.at(i));
+    }
+    if (remeasured && !remeasureQueued)
+    {
+        remeasureQueued = true;
+        QTimer::singleShot(0, this, [this]()
+                           {
+                               remeasureQueued = false;
+                               heightsChanged();
+                           });
+    }
+}
+
+void HistoryView::resizeEvent(QResizeEvent *event)
+{
+    QWidget::resizeEvent(event);
+    if (event->oldSize().width() == width() || width() <= 0)
+    {
+        return;
+    }
+    // Re-measuring thousands of rows would stall the resize; scale the old
+    // heights instead and let painting and prerender() correct them
+    int oldWidth = event->oldSize().width();
+    int line = fontMetrics().height();
+    for (Row &row : rows)
+    {
+        if (oldWidth > 0)
+        {
+            int lines = qMax(1, qRound(double(row.height - RowSpacing) / line * oldWidth / width()));
+            row.height = lines * line + RowSpacing;
+        }
+        row.measured = false;
+    }
+    heightsChanged();
+}
+
+bool HistoryView::prerender(int top, int bottom, int margin, int budgetMs, int *shiftAbove)
+{
+    *shiftAbove = 0;
+    if (rows.isEmpty() || width() <= 0)
+    {
+        return false;
+    }
+    QElapsedTimer timer;
+    timer.start();
+
+    // Visible rows first, then below (where scrolling usually continues), then above
+    int firstVisible = rowAt(top);
+    int lastBelow = rowAt(bottom + margin);
+    int firstAbove = rowAt(top - margin);
+    QVector<int> order;
+    for (int i = firstVisible; i <= lastBelow; ++i)
+    {
+        order.append(i);
+    }
+    for (int i = firstVisible - 1; i >= firstAbove; --i)
+    {
+        order.append(i);
+    }
+
+    bool changed = false;
+    for (int i : order)
+    {
+        if (timer.elapsed() >= budgetMs)
+        {
+            if (changed)
+            {
+                heightsChanged();
+            }
+            return true;
+        }
+        Row &row = rows[i];
+        if (!row.measured)
+        {
+            int delta = measure(row);
+            changed |= delta != 0;
+            if (i < firstVisible)
+            {
+                *shiftAbove += delta;
+            }
+        }
+        QPixmap pixmap;
+        cachedPixmap(row, true, &pixmap);
+    }
+    if (changed)
+    {
+        heightsChanged();
+    }
+    return false;
+}
+
+qint64 HistoryView::cacheBytes()
+{
+    return rowCache().totalCost();
+}
+
+void HistoryView::setCacheLimit(qint64 bytes)
+{
+    rowCache().setMaxCost(bytes);
+}
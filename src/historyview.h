@@ -0,0 +1,64 @@
+#ifndef HISTORYVIEW_H
+#define HISTORYVIEW_H
+
+#include <QWidget>
+#include <QVector>
+#include "transcriptstore.h"
+
+// Earlier messages of a ChatOverlay conversation, painted as one widget.
+// Every row is laid out and rasterized once per width and device pixel
+// ratio into a shared pixmap cache with a memory cap, so scrolling only
+// copies pixmaps and never re-shapes text. The overlay calls prerender()
+// while scrolling is idle to fill the cache for rows just off screen.
+class HistoryView : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit HistoryView(QWidget *parent = nullptr);
+
+    void prependMessages(const QList<ChatMessage> &messages);
+    void appendMessage(const ChatMessage &message);
+    int rowCount() const { return rows.size(); }
+
+    // Measures and caches rows within margin of the visible band [top, bottom],
+    // nearest first, for at most budgetMs. Returns true if rows are left.
+    // *shiftAbove receives the change in height of rows above the band.
+    bool prerender(int top, int bottom, int margin, int budgetMs, int *shiftAbove);
+
+    QSize sizeHint() const override;
+    QSize minimumSizeHint() const override;
+
+    static qint64 cacheBytes();
+    static void setCacheLimit(qint64 bytes);
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+
+private:
+    struct Row
+    {
+        quint64 id = 0;
+        QString text;
+        int height = 0;
+        bool measured = false; // height is exact for the current width
+    };
+
+    static Row makeRow(const ChatMessage &message);
+    int measure(Row &row) const; // returns the change in height
+    bool cachedPixmap(const Row &row, bool render, QPixmap *pixmap) const;
+    void drawRow(QPainter &painter, const Row &row, int top) const;
+    const QVector<int> &rowTops() const;
+    int rowAt(int y) const;
+    void heightsChanged();
+    void updateTotalHeight();
+
+    QVector<Row> rows;
+    mutable QVector<int> tops; // rows.size() + 1 entries
+    mutable bool topsDirty = true;
+    int totalHeight = 0;
+    bool remeasureQueued = false;
+};
+
+#endif // HISTORYVIEW_H
@@ -0,0 +1,488 @@
+#include "jsonstreamvalidator.h"
+#include <QJsonArray>
+#include <algorithm>
+#include <cmath>
+
+static bool isSpace(QChar c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static bool isDigit(QChar c)
+{
+    return c.unicode() >= '0' && c.unicode() <= '9';
+}
+
+static int hexDigit(QChar c)
+{
+    char16_t lower = c.unicode() | 0x20;
+    if (isDigit(c))
+    {
+        return c.unicode() - '0';
+    }
+    return lower >= 'a' && lower <= 'f' ? lower - 'a' + 10 : -1;
+}
+
+static QString label(const QString &path)
+{
+    return path.isEmpty() ? QStringLiteral("document") : path;
+}
+
+JsonStreamValidator::JsonStreamValidator(const QJsonObject &schema) : valueSchema(schema)
+{
+}
+
+bool JsonStreamValidator::feed(QStringView text)
+{
+    if (isFailed())
+    {
+        return false;
+    }
+    for (QChar c : text)
+    {
+        if (!step(c))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool JsonStreamValidator::finish()
+{
+    if (isFailed())
+    {
+        return false;
+    }
+    if (token == Token::Number && !endNumber())
+    {
+        return false; // a number at the top level only ends with the text
+    }
+    if (expect != Expect::Nothing || token != Token::None)
+    {
+        return fail(QStringLiteral("the reply ends before the document does"));
+    }
+    return true;
+}
+
+bool JsonStreamValidator::fail(const QString &message)
+{
+    errorText = message;
+    return false;
+}
+
+bool JsonStreamValidator::allows(const QJsonObject &schema, const QString &type)
+{
+    QJsonValue types = schema.value("type");
+    if (types.isUndefined())
+    {
+        return true;
+    }
+    if (types.isArray())
+    {
+        return types.toArray().contains(type);
+    }
+    return types.toString() == type;
+}
+
+QJsonObject JsonStreamValidator::propertySchema(const QJsonObject &objectSchema, const QString &key, bool *allowed)
+{
+    *allowed = true;
+    QJsonObject properties = objectSchema.value("properties").toObject();
+    if (properties.contains(key))
+    {
+        return properties.value(key).toObject();
+    }
+    QJsonValue additional = objectSchema.value("additionalProperties");
+    if (additional.isBool())
+    {
+        *allowed = additional.toBool();
+    }
+    return additional.toObject(); // empty: anything goes
+}
+
+bool JsonStreamValidator::step(QChar c)
+{
+    switch (token)
+    {
+    case Token::String:
+    case Token::Key:
+        return stringChar(c);
+    case Token::Literal:
+        tokenText += c;
+        if (!literal.startsWith(tokenText))
+        {
+            return fail(QString("%1: invalid literal").arg(label(valuePath)));
+        }
+        return tokenText.size() < literal.size() || endLiteral();
+    case Token::Number:
+        if (isDigit(c) || c == '.' || c == 'e' || c == 'E' || c == '+' || c == '-')
+        {
+            tokenText += c;
+            return true;
+        }
+        if (!endNumber())
+        {
+            return false;
+        }
+        break; // c follows the number
+    case Token::None:
+        break;
+    }
+
+    if (isSpace(c))
+    {
+        return true;
+    }
+    switch (expect)
+    {
+    case Expect::Value:
+        return beginValue(c);
+    case Expect::KeyOrEnd:
+        if (c == '}')
+        {
+            return closeObject();
+        }
+        [[fallthrough]];
+    case Expect::Key:
+        if (c != '"')
+        {
+            return fail(QString("%1: expected a property name").arg(label(stack.last().path)));
+        }
+        token = Token::Key;
+        tokenText.clear();
+        return true;
+    case Expect::Colon:
+        if (c != ':')
+        {
+            return fail(QString("%1: expected ':'").arg(label(valuePath)));
+        }
+        expect = Expect::Value;
+        return true;
+    case Expect::MemberEnd:
+        if (c == ',')
+        {
+            expect = Expect::Key;
+            return true;
+        }
+        if (c == '}')
+        {
+            return closeObject();
+        }
+        return fail(QString("%1: expected ',' or '}'").arg(label(stack.last().path)));
+    case Expect::ItemOrEnd:
+        if (c == ']')
+        {
+            return closeArray();
+        }
+        return beginItem() && beginValue(c);
+    case Expect::ItemEnd:
+        if (c == ',')
+        {
+            expect = Expect::Value;
+            return beginItem();
+        }
+        if (c == ']')
+        {
+            return closeArray();
+        }
+        return fail(QString("%1: expected ',' or ']'").arg(label(stack.last().path)));
+    case Expect::Nothing:
+        return fail(QStringLiteral("text after the document"));
+    }
+    return true;
+}
+
+bool JsonStreamValidator::beginValue(QChar c)
+{
+    QString type;
+    if (c == '{')
+    {
+        type = "object";
+    }
+    else if (c == '[')
+    {
+        type = "array";
+    }
+    else if (c == '"')
+    {
+        type = "string";
+    }
+    else if (c == '-' || isDigit(c))
+    {
+        type = allows(valueSchema, "integer") ? "integer" : "number";
+    }
+    else if (c == 't' || c == 'f')
+    {
+        type = "boolean";
+    }
+    else if (c == 'n')
+    {
+        type = "null";
+    }
+    else
+    {
+        return fail(QString("%1: not a JSON value").arg(label(valuePath)));
+    }
+    if (!allows(valueSchema, type))
+    {
+        return fail(QString("%1: %2 is not allowed here").arg(label(valuePath), type));
+    }
+
+    if (c == '{' || c == '[')
+    {
+        stack.append(Frame{c == '{', valueSchema, valuePath});
+        expect = c == '{' ? Expect::KeyOrEnd : Expect::ItemOrEnd;
+        return true;
+    }
+    tokenText.clear();
+    if (c == '"')
+    {
+        token = Token::String;
+        return true;
+    }
+    tokenText += c;
+    if (type == "integer" || type == "number")
+    {
+        token = Token::Number;
+        return true;
+    }
+    token = Token::Literal;
+    literal = c == 't' ? QStringLiteral("true") : c == 'f' ? QStringLiteral("false") : QStringLiteral("null");
+    return true;
+}
+
+bool JsonStreamValidator::beginItem()
+{
+    Frame &array = stack.last();
+    valueSchema = array.schema.value("items").toObject();
+    valuePath = array.path + '[' + QString::number(array.items) + ']';
+    ++array.items;
+    if (array.schema.contains("maxItems") && array.items > array.schema.value("maxItems").toInt())
+    {
+        return fail(QString("%1: more than %2 items").arg(label(array.path)).arg(array.schema.value("maxItems").toInt()));
+    }
+    return true;
+}
+
+bool JsonStreamValidator::stringChar(QChar c)
+{
+    if (hexDigits >= 0)
+    {
+        int digit = hexDigit(c);
+        if (digit < 0)
+        {
+            return fail(QString("%1: invalid \\u escape").arg(label(valuePath)));
+        }
+        hexValue = char16_t(hexValue * 16 + digit);
+        if (++hexDigits < 4)
+        {
+            return true;
+        }
+        hexDigits = -1;
+        return addChar(QChar(hexValue));
+    }
+    if (escaped)
+    {
+        escaped = false;
+        switch (c.unicode())
+        {
+        case '"':
+        case '\\':
+        case '/':
+            return addChar(c);
+        case 'b':
+            return addChar('\b');
+        case 'f':
+            return addChar('\f');
+        case 'n':
+            return addChar('\n');
+        case 'r':
+            return addChar('\r');
+        case 't':
+            return addChar('\t');
+        case 'u':
+            hexDigits = 0;
+            hexValue = 0;
+            return true;
+        default:
+            return fail(QString("%1: invalid escape").arg(label(valuePath)));
+        }
+    }
+    if (c == '\\')
+    {
+        escaped = true;
+        return true;
+    }
+    if (c == '"')
+    {
+        return endString();
+    }
+    if (c.unicode() < 0x20)
+    {
+        return fail(QString("%1: control character in a string").arg(label(valuePath)));
+    }
+    return addChar(c);
+}
+
+bool JsonStreamValidator::addChar(QChar c)
+{
+    tokenText += c;
+    if (token == Token::Key)
+    {
+        // A closed object: the name so far must begin one of its properties
+        const Frame &object = stack.last();
+        if (object.schema.value("additionalProperties") == QJsonValue(false))
+        {
+            const QStringList names = object.schema.value("properties").toObject().keys();
+            if (std::none_of(names.begin(), names.end(), [this](const QString &name)
+                             { return name.startsWith(tokenText); }))
+            {
+                return fail(QString("%1: property \"%2\" is not allowed").arg(label(object.path), tokenText));
+            }
+        }
+        return true;
+    }
+
+    if (valueSchema.contains("maxLength") && tokenText.size() > valueSchema.value("maxLength").toInt())
+    {
+        return fail(QString("%1: longer than %2 characters").arg(label(valuePath)).arg(valueSchema.value("maxLength").toInt()));
+    }
+    if (valueSchema.contains("enum"))
+    {
+        const QJsonArray values = valueSchema.value("enum").toArray();
+        if (std::none_of(values.begin(), values.end(), [this](const QJsonValue &value)
+                         { return value.isString() && value.toString().startsWith(tokenText); }))
+        {
+            return fail(QString("%1: not one of the allowed values").arg(label(valuePath)));
+        }
+    }
+    return true;
+}
+
+bool JsonStreamValidator::endString()
+{
+    bool key = token == Token::Key;
+    token = Token::None;
+    if (!key)
+    {
+        if (valueSchema.contains("minLength") && tokenText.size() < valueSchema.value("minLength").toInt())
+        {
+            return fail(QString("%1: shorter than %2 characters").arg(label(valuePath)).arg(valueSchema.value("minLength").toInt()));
+        }
+        if (!checkEnum(tokenText))
+        {
+            return false;
+        }
+        validated.append(JsonField{valuePath, tokenText});
+        return endValue();
+    }
+
+    Frame &object = stack.last();
+    bool allowed;
+    valueSchema = propertySchema(object.schema, tokenText, &allowed);
+    if (!allowed)
+    {
+        return fail(QString("%1: property \"%2\" is not allowed").arg(label(object.path), tokenText));
+    }
+    object.keys.insert(tokenText);
+    valuePath = object.path.isEmpty() ? tokenText : object.path + '.' + tokenText;
+    expect = Expect::Colon;
+    return true;
+}
+
+bool JsonStreamValidator::endNumber()
+{
+    token = Token::None;
+    bool ok = false;
+    double value = tokenText.toDouble(&ok);
+    if (!ok || tokenText.startsWith('+'))
+    {
+        return fail(QString("%1: invalid number").arg(label(valuePath)));
+    }
+    bool integral = std::isfinite(value) && std::floor(value) == value;
+    if (!allows(valueSchema, "number") && !integral)
+    {
+        return fail(QString("%1: not an integer").arg(label(valuePath)));
+    }
+    if (valueSchema.contains("minimum") && value < valueSchema.value("minimum").toDouble())
+    {
+        return fail(QString("%1: below the minimum").arg(label(valuePath)));
+    }
+    if (valueSchema.contains("maximum") && value > valueSchema.value("maximum").toDouble())
+    {
+        return fail(QString("%1: above the maximum").arg(label(valuePath)));
+    }
+    QJsonValue json = integral && std::abs(value) < 9007199254740992.0 ? QJsonValue(qint64(value)) : QJsonValue(value);
+    if (!checkEnum(json))
+    {
+        return false;
+    }
+    validated.append(JsonField{valuePath, json});
+    return endValue();
+}
+
+bool JsonStreamValidator::endLiteral()
+{
+    token = Token::None;
+    QJsonValue value = literal == "null" ? QJsonValue(QJsonValue::Null) : QJsonValue(literal == "true");
+    if (!checkEnum(value))
+    {
+        return false;
+    }
+    validated.append(JsonField{valuePath, value});
+    return endValue();
+}
+
+bool JsonStreamValidator::checkEnum(const QJsonValue &value)
+{
+    if (!valueSchema.contains("enum"))
+    {
+        return true;
+    }
+    const QJsonArray values = valueSchema.value("enum").toArray();
+    for (const QJsonValue &allowed : values)
+    {
+        // Integers and doubles compare by value
+        if (allowed == value || (allowed.isDouble() && value.isDouble() && allowed.toDouble() == value.toDouble()))
+        {
+            return true;
+        }
+    }
+    return fail(QString("%1: not one of the allowed values").arg(label(valuePath)));
+}
+
+bool JsonStreamValidator::endValue()
+{
+    if (stack.isEmpty())
+    {
+        expect = Expect::Nothing;
+        return true;
+    }
+    expect = stack.last().object ? Expect::MemberEnd : Expect::ItemEnd;
+    return true;
+}
+
+bool JsonStreamValidator::closeObject()
+{
+    Frame object = stack.takeLast();
+    const QJsonArray required = object.schema.value("required").toArray();
+    for (const QJsonValue &name : required)
+    {
+        if (!object.keys.contains(name.toString()))
+        {
+            return fail(QString("%1: missing required property \"%2\"").arg(label(object.path), name.toString()));
+        }
+    }
+    return endValue();
+}
+
+bool JsonStreamValidator::closeArray()
+{
+    Frame array = stack.takeLast();
+    if (array.schema.contains("minItems") && array.items < array.schema.value("minItems").toInt())
+    {
+        return fail(QString("%1: fewer than %2 items").arg(label(array.path)).arg(array.schema.value("minItems").toInt()));
+    }
+    return endValue();
+}
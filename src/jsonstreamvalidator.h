@@ -0,0 +1,107 @@
+#ifndef JSONSTREAMVALIDATOR_H
+#define JSONSTREAMVALIDATOR_H
+
+#include <QJsonObject>
+#include <QJsonValue>
+#include <QList>
+#include <QSet>
+#include <QString>
+
+// A scalar of a JSON reply that is complete and matches its own schema
+struct JsonField
+{
+    QString path; // "user.name", "items[2].id"
+    QJsonValue value;
+};
+
+// Checks a JSON document against a schema while it is still arriving. The
+// text is parsed one character at a time, so a reply that can no longer
+// become valid is caught at the first character that rules it out: a value
+// of the wrong type, a property the schema does not allow, a string that
+// no longer prefixes any enum entry or is past maxLength, an array past
+// maxItems. Missing required properties are caught when the object closes.
+//
+// Supported keywords: type, properties, required, additionalProperties,
+// items, enum, minimum, maximum, minLength, maxLength, minItems, maxItems.
+// Anything else is ignored.
+class JsonStreamValidator
+{
+public:
+    explicit JsonStreamValidator(const QJsonObject &schema);
+
+    // False once the text fed so far cannot start a valid document
+    bool feed(QStringView text);
+    // Call at the end of the reply; false unless a whole valid document was fed
+    bool finish();
+
+    bool isFailed() const { return !errorText.isEmpty(); }
+    QString error() const { return errorText; }
+
+    // Scalars validated so far, in document order
+    const QList<JsonField> &fields() const { return validated; }
+
+private:
+    enum class Expect
+    {
+        Value,
+        KeyOrEnd,  // just after {
+        Key,       // after , in an object
+        Colon,
+        MemberEnd, // , or }
+        ItemOrEnd, // just after [
+        ItemEnd,   // , or ]
+        Nothing,   // the document is complete
+    };
+
+    struct Frame
+    {
+        bool object;
+        QJsonObject schema;
+        QString path;
+        QSet<QString> keys;
+        int items = 0;
+    };
+
+    enum class Token
+    {
+        None,
+        String,
+        Key,
+        Number,
+        Literal,
+    };
+
+    bool step(QChar c);
+    bool beginValue(QChar c);
+    bool stringChar(QChar c);
+    bool addChar(QChar c);
+    bool endString();
+    bool endNumber();
+    bool endLiteral();
+    bool endValue();
+    bool beginItem();
+    bool closeObject();
+    bool closeArray();
+    bool fail(const QString &message);
+    bool checkEnum(const QJsonValue &value);
+
+    static bool allows(const QJsonObject &schema, const QString &type);
+    static QJsonObject propertySchema(const QJsonObject &objectSchema, const QString &key, bool *allowed);
+
+    QList<Frame> stack;
+    Expect expect = Expect::Value;
+    QJsonObject valueSchema; // for the value about to start
+    QString valuePath;
+
+    Token token = Token::None;
+    QString tokenText;
+    QString literal; // "true", "false" or "null" while one is read
+    bool escaped = false;
+    int hexDigits = -1; // >= 0 while reading \uXXXX
+    char16_t hexValue = 0;
+
+    QString errorText;
+    QList<JsonField> validated;
+};
+
+#endif // JSONSTREAMVALIDATOR_H
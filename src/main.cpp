@@ -1,13 +1,25 @@
 #include <QApplication>
 #include <QShortcut>
-#include "ChatOverlay.h"
+#include "chatoverlay.h"
 #include "mainwindow.h"
 #include "customapplication.h"
+#include "eventrecorder.h"
+#include "sessionstore.h"
 
 int main(int argc, char *argv[])
 {
+    // Replays measure the app, not the window system
+    if (qEnvironmentVariableIsSet("D0_REPLAY_EVENTS") && !qEnvironmentVariableIsSet("QT_QPA_PLATFORM"))
+    {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
     CustomApplication app(argc, argv);
     MainWindow mainwindow;
     mainwindow.show();
+    SessionStore::instance()->restore();
+    if (EventReplayer *replayer = EventReplayer::instance())
+    {
+        replayer->start();
+    }
     return app.exec();
 }
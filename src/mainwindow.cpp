@@ -8,11 +8,27 @@
 #include <QFileDialog>
 #include <QMessageBox>
 #include <QKeyEvent>
+#include <QProgressDialog>
+#include "asynclog.h"
 #include "chatoverlay.h"
+#include "fileview.h"
+#include "searchpanel.h"
+#include "statspanel.h"
+#include "toolexecutor.h"
+#include "transcriptexporter.h"
+#include "transcriptimporter.h"
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
 {
+    statsPanel = new StatsPanel(this);
+    addDockWidget(Qt::RightDockWidgetArea, statsPanel);
+    statsPanel->hide();
+    fileView = new FileView(this);
+    searchPanel = new SearchPanel(fileView, this);
+    addDockWidget(Qt::BottomDockWidgetArea, searchPanel);
+    searchPanel->hide();
+
     createActions();
     createMenus();
 
@@ -20,6 +36,7 @@ MainWindow::MainWindow(QWidget *parent)
     toolBar->addAction(newAction);
     toolBar->addAction(openAction);
     toolBar->addAction(saveAction);
+    toolBar->addAction(followAction);
 
     QWidget *centralWidget = new QWidget(this);
     QVBoxLayout *mainLayout = new QVBoxLayout();
@@ -33,6 +50,8 @@ MainWindow::MainWindow(QWidget *parent)
     QPushButton *button = new QPushButton("Click Me");
     mainLayout->addWidget(button);
 
+    mainLayout->addWidget(fileView, 1);
+
     centralWidget->setLayout(mainLayout);
     setCentralWidget(centralWidget);
 }
@@ -48,7 +67,7 @@ void MainWindow::keyPressEvent(QKeyEvent *event)
     {
         if (event->key() == Qt::Key_Space)
         {
-            qDebug() << "Shift + Option + Space detected!";
+            AsyncLog::debug("Shift + Option + Space detected");
         }
     }
     // Handle your logic here
@@ -66,22 +85,87 @@ void MainWindow::openFile()
 {
     // Implement the Open action
     QString fileName = QFileDialog::getOpenFileName(this, tr("Open File"), "", tr("All Files (*)"));
-    if (!fileName.isEmpty())
+    if (fileName.isEmpty())
     {
-        // Process opening the file
-        QMessageBox::information(this, tr("Open File"), tr("File opened: ") + fileName);
+        return;
     }
+    if (!TranscriptImporter::canImport(fileName))
+    {
+        // Only a file shown in the view becomes the tools' root and the /summarize target
+        fileView->open(fileName);
+        ToolExecutor::setOpenFilePath(fileName);
+        return;
+    }
+
+    // Chat-history exports are loaded into the transcript store
+    TranscriptImporter *importer = new TranscriptImporter(fileName, this);
+    QProgressDialog *progress = new QProgressDialog(tr("Importing conversations..."), tr("Cancel"), 0, 1000, this);
+    progress->setWindowModality(Qt::WindowModal);
+    progress->setMinimumDuration(500);
+    progress->setAttribute(Qt::WA_DeleteOnClose);
+
+    connect(progress, &QProgressDialog::canceled, importer, &TranscriptImporter::cancel);
+    connect(importer, &TranscriptImporter::progress, progress, [progress](qint64 done, qint64 total)
+            { progress->setValue(total > 0 ? int(done * 1000 / total) : 1000); });
+    connect(importer, &TranscriptImporter::finished, this, [this, importer, progress, fileName](bool ok, const QString &error)
+            {
+                progress->close();
+                importer->deleteLater();
+                if (ok)
+                {
+                    QMessageBox::information(this, tr("Open File"),
+                                             tr("Imported %1 messages from %2 (%3 skipped lines)\n"
+                                                "%4 MB/s on %5 threads, %6 MB/s per core")
+                                                 .arg(importer->importedMessages())
+                                                 .arg(fileName)
+                                                 .arg(importer->skippedLines())
+                                                 .arg(importer->megabytesPerSecond(), 0, 'f', 0)
+                                                 .arg(importer->threadCount())
+                                                 .arg(importer->megabytesPerSecondPerCore(), 0, 'f', 0));
+                }
+                else if (!error.isEmpty())
+                {
+                    QMessageBox::warning(this, tr("Open File"), tr("Could not import %1: %2").arg(fileName, error));
+                } });
+    importer->start();
 }
 
 void MainWindow::saveFile()
 {
-    // Implement the Save action
-    QString fileName = QFileDialog::getSaveFileName(this, tr("Save File"), "", tr("All Files (*)"));
-    if (!fileName.isEmpty())
+    // Export every stored conversation; the format follows the chosen suffix
+    QString fileName = QFileDialog::getSaveFileName(this, tr("Save File"), "",
+                                                    tr("Markdown (*.md);;JSON Lines (*.jsonl);;HTML (*.html)"));
+    if (fileName.isEmpty())
     {
-        // Process saving the file
-        QMessageBox::information(this, tr("Save File"), tr("File saved: ") + fileName);
+        return;
     }
+
+    TranscriptExporter *exporter = new TranscriptExporter(fileName, this);
+    QProgressDialog *progress = new QProgressDialog(tr("Exporting transcripts..."), tr("Cancel"), 0, 0, this);
+    progress->setWindowModality(Qt::WindowModal);
+    progress->setMinimumDuration(500);
+    progress->setAttribute(Qt::WA_DeleteOnClose);
+
+    connect(progress, &QProgressDialog::canceled, exporter, &TranscriptExporter::cancel);
+    connect(exporter, &TranscriptExporter::progress, progress, [progress](qint64 done, qint64 total)
+            {
+                // Counts can exceed int range on very large histories
+                progress->setMaximum(1000);
+                progress->setValue(total > 0 ? int(done * 1000 / total) : 1000);
+            });
+    connect(exporter, &TranscriptExporter::finished, this, [this, exporter, progress, fileName](bool ok, const QString &error)
+            {
+                progress->close();
+                exporter->deleteLater();
+                if (ok)
+                {
+                    QMessageBox::information(this, tr("Save File"), tr("File saved: ") + fileName);
+                }
+                else if (!error.isEmpty())
+                {
+                    QMessageBox::warning(this, tr("Save File"), tr("Could not save %1: %2").arg(fileName, error));
+                } });
+    exporter->start();
 }
 
 void MainWindow::createActions()
@@ -94,6 +178,15 @@ void MainWindow::createActions()
 
     saveAction = new QAction(tr("&Save"), this);
     connect(saveAction, &QAction::triggered, this, &MainWindow::saveFile);
+
+    followAction = new QAction(tr("&Follow"), this);
+    followAction->setCheckable(true);
+    followAction->setToolTip(tr("Show lines as they are appended to the open file"));
+    connect(followAction, &QAction::toggled, fileView, &FileView::setFollowing);
+
+    findAction = new QAction(tr("&Find in File"), this);
+    findAction->setShortcut(QKeySequence::Find);
+    connect(findAction, &QAction::triggered, searchPanel, &SearchPanel::focusQuery);
 }
 
 void MainWindow::createMenus()
@@ -102,4 +195,10 @@ void MainWindow::createMenus()
     fileMenu->addAction(newAction);
     fileMenu->addAction(openAction);
     fileMenu->addAction(saveAction);
+
+    viewMenu = menuBar()->addMenu(tr("&View"));
+    viewMenu->addAction(statsPanel->toggleViewAction());
+    viewMenu->addAction(followAction);
+    viewMenu->addAction(searchPanel->toggleViewAction());
+    viewMenu->addAction(findAction);
 }
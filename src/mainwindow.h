@@ -4,6 +4,9 @@
 class QTcpServer;
 class QTcpSocket;
 class QKeyEvent;
+class StatsPanel;
+class FileView;
+class SearchPanel;
 
 class MainWindow : public QMainWindow
 {
@@ -26,7 +29,13 @@ private:
     void createActions();
 
     QMenu *fileMenu;
+    QMenu *viewMenu;
+    StatsPanel *statsPanel;
+    FileView *fileView;
+    SearchPanel *searchPanel;
     QAction *newAction;
     QAction *openAction;
     QAction *saveAction;
+    QAction *followAction;
+    QAction *findAction;
 };
@@ -0,0 +1,452 @@
+#include "outboundqueue.h"
+#include "stats.h"
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QDir>
+#include <QJsonDocument>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QTimer>
+#include <QtEndian>
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#endif
+
+static const int MaxConcurrent = 4;
+static const int InitialBackoffMs = 1000;
+static const int MaxBackoffMs = 60000;
+
+enum JournalRecordType : quint8
+{
+    EnqueueRecord = 1,
+    AckRecord = 2
+};
+
+static QByteArray encodeEnqueue(const QUuid &id, const ChatRequest &request)
+{
+    QByteArray record;
+    QDataStream out(&record, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_6_0);
+    out << quint8(EnqueueRecord) << id << request.conversation << request.prompt
+        << request.model << request.endpoint << qint32(request.maxTokens);
+    out << quint32(request.attachments.size());
+    for (const ImageAttachment &attachment : request.attachments)
+    {
+        out << attachment.mimeType << attachment.data << attachment.size;
+    }
+    out << quint32(request.toolCalls.size());
+    for (const ToolCall &call : request.toolCalls)
+    {
+        out << call.id << call.name << call.arguments;
+    }
+    out << quint32(request.toolResults.size());
+    for (const ToolResult &result : request.toolResults)
+    {
+        out << result.callId << result.name << result.output << result.ok;
+    }
+    out << request.stopSequences << request.stopOnRepetition;
+    out << QJsonDocument(request.responseSchema).toJson(QJsonDocument::Compact) << qint32(request.schemaRetries);
+    out << request.tools;
+    return record;
+}
+
+static QByteArray encodeAck(const QUuid &id)
+{
+    QByteArray record;
+    QDataStream out(&record, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_6_0);
+    out << quint8(AckRecord) << id;
+    return record;
+}
+
+static QByteArray frame(const QByteArray &record)
+{
+    // Length-prefixed so a record torn by a crash is detected and dropped on load
+    quint32 length = qToBigEndian<quint32>(record.size());
+    return QByteArray(reinterpret_cast<const char *>(&length), sizeof(length)) + record;
+}
+
+JournalWriter::JournalWriter(const QString &path) : file(path, this)
+{
+}
+
+void JournalWriter::load()
+{
+    QList<QByteArray> records;
+    if (file.open(QIODevice::ReadOnly))
+    {
+        QByteArray data = file.readAll();
+        file.close();
+        qsizetype offset = 0;
+        while (offset + qsizetype(sizeof(quint32)) <= data.size())
+        {
+            quint32 length = qFromBigEndian<quint32>(data.constData() + offset);
+            offset += sizeof(quint32);
+            if (offset + qsizetype(length) > data.size())
+            {
+                break; // torn tail
+            }
+            records.append(data.mid(offset, length));
+            offset += length;
+        }
+    }
+    file.open(QIODevice::WriteOnly | QIODevice::Append);
+    emit loaded(records);
+}
+
+void JournalWriter::append(const QByteArray &record)
+{
+    pending += frame(record);
+    if (!flushScheduled)
+    {
+        // Runs after every append already queued to this thread, so a burst is one write and one sync
+        flushScheduled = true;
+        QTimer::singleShot(0, this, &JournalWriter::flushPending);
+    }
+}
+
+void JournalWriter::flushPending()
+{
+    flushScheduled = false;
+    if (pending.isEmpty() || !file.isOpen())
+    {
+        return;
+    }
+    file.write(pending);
+    file.flush();
+#ifdef Q_OS_UNIX
+    ::fdatasync(file.handle());
+#endif
+    pending.clear();
+}
+
+void JournalWriter::rewrite(const QList<QByteArray> &records)
+{
+    // Compaction: replace the journal with just the live records, atomically
+    pending.clear();
+    file.close();
+    QSaveFile compacted(file.fileName());
+    if (compacted.open(QIODevice::WriteOnly))
+    {
+        for (const QByteArray &record : records)
+        {
+            compacted.write(frame(record));
+        }
+        compacted.commit();
+    }
+    file.open(QIODevice::WriteOnly | QIODevice::Append);
+}
+
+OutboundQueue *OutboundQueue::instance()
+{
+    static OutboundQueue *queue = new OutboundQueue(qApp);
+    return queue;
+}
+
+OutboundQueue::OutboundQueue(QObject *parent)
+    : QObject(parent), backoffMs(InitialBackoffMs), retryTimer(new QTimer(this))
+{
+    retryTimer->setSingleShot(true);
+    retryTimer->setTimerType(Qt::VeryCoarseTimer);
+    connect(retryTimer, &QTimer::timeout, this, &OutboundQueue::drain);
+
+    QString dir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+    QDir().mkpath(dir);
+    journal = new JournalWriter(dir + "/outbound.journal");
+    journal->moveToThread(&journalThread);
+    connect(&journalThread, &QThread::finished, journal, &QObject::deleteLater);
+    connect(journal, &JournalWriter::loaded, this, &OutboundQueue::onJournalLoaded);
+    journalThread.setObjectName("outbound-journal");
+    journalThread.start();
+    QMetaObject::invokeMethod(journal, &JournalWriter::load, Qt::QueuedConnection);
+}
+
+OutboundQueue::~OutboundQueue()
+{
+    // Appends and acks still queued to the journal thread run before this
+    // call does, so nothing enqueued just before exit is lost
+    QMetaObject::invokeMethod(journal, &JournalWriter::flushPending, Qt::BlockingQueuedConnection);
+    journalThread.quit();
+    journalThread.wait();
+}
+
+bool OutboundQueue::isConnectivityError(QNetworkReply::NetworkError error)
+{
+    switch (error)
+    {
+    case QNetworkReply::ConnectionRefusedError:
+    case QNetworkReply::RemoteHostClosedError:
+    case QNetworkReply::HostNotFoundError:
+    case QNetworkReply::TimeoutError:
+    case QNetworkReply::TemporaryNetworkFailureError:
+    case QNetworkReply::NetworkSessionFailedError:
+    case QNetworkReply::UnknownNetworkError:
+    case QNetworkReply::ProxyConnectionRefusedError:
+    case QNetworkReply::ProxyTimeoutError:
+    case QNetworkReply::ServiceUnavailableError:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool OutboundQueue::isRetryableError(QNetworkReply::NetworkError error)
+{
+    switch (error)
+    {
+    case QNetworkReply::InternalServerError:
+    case QNetworkReply::UnknownServerError:
+        return true;
+    default:
+        return isConnectivityError(error);
+    }
+}
+
+bool OutboundQueue::hasPending(const QUuid &conversation) const
+{
+    return conversations.contains(conversation);
+}
+
+void OutboundQueue::push(const QueuedPrompt &prompt)
+{
+    const QUuid &conversation = prompt.request.conversation;
+    if (!conversations.contains(conversation))
+    {
+        order.append(conversation);
+    }
+    conversations[conversation].enqueue(prompt);
+    ++queuedCount;
+}
+
+void OutboundQueue::enqueue(const ChatRequest &request)
+{
+    QueuedPrompt prompt{QUuid::createUuid(), request};
+    push(prompt);
+    QByteArray record = encodeEnqueue(prompt.id, request);
+    QMetaObject::invokeMethod(journal, [writer = journal, record]()
+                              { writer->append(record); });
+
+    // Something failed to connect: probe with a single request until one succeeds
+    online = false;
+    if (inFlight == 0 && !retryTimer->isActive())
+    {
+        retryTimer->start(backoffMs);
+    }
+    updateStats();
+}
+
+void OutboundQueue::onJournalLoaded(const QList<QByteArray> &records)
+{
+    QHash<QUuid, QueuedPrompt> live;
+    QList<QUuid> sequence;
+    for (const QByteArray &record : records)
+    {
+        QDataStream in(record);
+        in.setVersion(QDataStream::Qt_6_0);
+        quint8 type;
+        QUuid id;
+        in >> type >> id;
+        if (type == EnqueueRecord)
+        {
+            QueuedPrompt prompt;
+            prompt.id = id;
+            qint32 maxTokens;
+            in >> prompt.request.conversation >> prompt.request.prompt >> prompt.request.model >> prompt.request.endpoint >> maxTokens;
+            prompt.request.maxTokens = maxTokens;
+            quint32 attachments = 0;
+            if (!in.atEnd())
+            {
+                in >> attachments;
+            }
+            for (quint32 i = 0; i < attachments && in.status() == QDataStream::Ok; ++i)
+            {
+                ImageAttachment attachment;
+                in >> attachment.mimeType >> attachment.data >> attachment.size;
+                prompt.request.attachments.append(attachment);
+            }
+            quint32 calls = 0;
+            if (!in.atEnd())
+            {
+                in >> calls;
+            }
+            for (quint32 i = 0; i < calls && in.status() == QDataStream::Ok; ++i)
+            {
+                ToolCall call;
+                in >> call.id >> call.name >> call.arguments;
+                prompt.request.toolCalls.append(call);
+            }
+            quint32 results = 0;
+            if (!in.atEnd())
+            {
+                in >> results;
+            }
+            for (quint32 i = 0; i < results && in.status() == QDataStream::Ok; ++i)
+            {
+                ToolResult result;
+                in >> result.callId >> result.name >> result.output >> result.ok;
+                prompt.request.toolResults.append(result);
+            }
+            if (!in.atEnd())
+            {
+                in >> prompt.request.stopSequences >> prompt.request.stopOnRepetition;
+            }
+            if (!in.atEnd())
+            {
+                QByteArray schema;
+                qint32 schemaRetries = 0;
+                in >> schema >> schemaRetries;
+                prompt.request.responseSchema = QJsonDocument::fromJson(schema).object();
+                prompt.request.schemaRetries = schemaRetries;
+            }
+            if (!in.atEnd())
+            {
+                in >> prompt.request.tools;
+            }
+            live.insert(id, prompt);
+            sequence.append(id);
+        }
+        else if (type == AckRecord)
+        {
+            live.remove(id);
+        }
+    }
+
+    // Prompts from the journal are older than anything queued since startup, so they go first
+    QHash<QUuid, QQueue<QueuedPrompt>> queuedSinceStartup;
+    queuedSinceStartup.swap(conversations);
+    QList<QUuid> orderSinceStartup = order;
+    order.clear();
+    queuedCount = 0;
+    for (const QUuid &id : sequence)
+    {
+        if (live.contains(id))
+        {
+            push(live.value(id));
+        }
+    }
+    for (const QUuid &conversation : orderSinceStartup)
+    {
+        for (const QueuedPrompt &prompt : queuedSinceStartup.value(conversation))
+        {
+            push(prompt);
+        }
+    }
+    loaded = true;
+
+    QList<QByteArray> liveRecords;
+    liveRecords.reserve(queuedCount);
+    for (const QUuid &conversation : order)
+    {
+        for (const QueuedPrompt &prompt : conversations.value(conversation))
+        {
+            liveRecords.append(encodeEnqueue(prompt.id, prompt.request));
+        }
+    }
+    QMetaObject::invokeMethod(journal, [writer = journal, liveRecords]()
+                              { writer->rewrite(liveRecords); });
+
+    if (queuedCount > 0)
+    {
+        online = false;
+        retryTimer->start(0);
+    }
+    updateStats();
+}
+
+void OutboundQueue::drain()
+{
+    if (!loaded)
+    {
+        return; // onJournalLoaded() drains once the backlog is known
+    }
+
+    // While the service looks down only one prompt probes it
+    int limit = online ? MaxConcurrent : 1;
+    for (int scanned = 0; scanned < order.size() && inFlight < limit; ++scanned)
+    {
+        cursor %= order.size();
+        const QUuid conversation = order.at(cursor++);
+        if (busy.contains(conversation))
+        {
+            continue;
+        }
+
+        // Only the head of each conversation is sent, which keeps per-conversation order
+        ChatRequest request = conversations[conversation].head().request;
+        busy.insert(conversation);
+        ++inFlight;
+
+        ChatStream *stream = ChatClient::instance()->send(request, this);
+        auto handled = std::make_shared<bool>(false);
+        connect(stream, &ChatStream::finished, this, [this, stream, conversation, handled]()
+                {
+                    *handled = true;
+                    onDispatchFinished(stream, conversation);
+                });
+        connect(stream, &QObject::destroyed, this, [this, conversation, handled]()
+                {
+                    // A listener deleted the stream before it finished: the service got the prompt
+                    if (!*handled)
+                    {
+                        *handled = true;
+                        onDispatchFinished(nullptr, conversation);
+                    }
+                });
+        emit started(request, stream);
+    }
+    updateStats();
+}
+
+void OutboundQueue::onDispatchFinished(ChatStream *stream, const QUuid &conversation)
+{
+    busy.remove(conversation);
+    --inFlight;
+
+    if (stream && stream->hasError() && isRetryableError(stream->networkError()))
+    {
+        // Still unreachable or failing: keep the prompt at the head and back off
+        online = false;
+        retryTimer->start(backoffMs);
+        backoffMs = qMin(backoffMs * 2, MaxBackoffMs);
+    }
+    else
+    {
+        online = true;
+        backoffMs = InitialBackoffMs;
+
+        QQueue<QueuedPrompt> &queue = conversations[conversation];
+        QUuid id = queue.dequeue().id;
+        --queuedCount;
+        if (queue.isEmpty())
+        {
+            conversations.remove(conversation);
+            order.removeOne(conversation);
+        }
+
+        if (queuedCount == 0)
+        {
+            QMetaObject::invokeMethod(journal, [writer = journal]()
+                                      { writer->rewrite(QList<QByteArray>()); });
+        }
+        else
+        {
+            QByteArray record = encodeAck(id);
+            QMetaObject::invokeMethod(journal, [writer = journal, record]()
+                                      { writer->append(record); });
+        }
+        Stats::instance()->add(stream && stream->hasError() ? "outbound.rejected" : "outbound.delivered");
+        QTimer::singleShot(0, this, &OutboundQueue::drain);
+    }
+
+    if (stream && stream->parent() == this)
+    {
+        stream->deleteLater();
+    }
+    updateStats();
+}
+
+void OutboundQueue::updateStats()
+{
+    Stats::instance()->set("outbound.queued", queuedCount);
+    Stats::instance()->set("outbound.in_flight", inFlight);
+}
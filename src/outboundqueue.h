@@ -0,0 +1,94 @@
+#ifndef OUTBOUNDQUEUE_H
+#define OUTBOUNDQUEUE_H
+
+#include <QObject>
+#include <QFile>
+#include <QHash>
+#include <QQueue>
+#include <QSet>
+#include <QThread>
+#include "chatclient.h"
+
+class QTimer;
+
+// Appends journal records on a background thread. Records appended while the
+// thread is busy are written and flushed together (group commit).
+class JournalWriter : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit JournalWriter(const QString &path);
+
+public slots:
+    void load();
+    void append(const QByteArray &record);
+    void rewrite(const QList<QByteArray> &records);
+    // Writes and syncs what is buffered now instead of on the next pass
+    void flushPending();
+
+signals:
+    void loaded(const QList<QByteArray> &records);
+
+private:
+    QFile file;
+    QByteArray pending;
+    bool flushScheduled = false;
+};
+
+// Prompts that could not reach the service. They are kept in a write-ahead
+// journal so they survive a restart, and are resent once the service answers
+// again: in order within a conversation, with bounded concurrency across them.
+class OutboundQueue : public QObject
+{
+    Q_OBJECT
+
+public:
+    static OutboundQueue *instance();
+    ~OutboundQueue() override;
+
+    // Errors worth queueing for: the service was not reached at all
+    static bool isConnectivityError(QNetworkReply::NetworkError error);
+    // Errors a later resend may not hit: connectivity, or a 5xx from the service
+    static bool isRetryableError(QNetworkReply::NetworkError error);
+
+    void enqueue(const ChatRequest &request);
+    // While a conversation has queued prompts, new ones must queue behind them
+    bool hasPending(const QUuid &conversation) const;
+    int size() const { return queuedCount; }
+
+signals:
+    // A queued prompt was resent; a listener may take ownership of the stream
+    void started(const ChatRequest &request, ChatStream *stream);
+
+private slots:
+    void onJournalLoaded(const QList<QByteArray> &records);
+    void drain();
+
+private:
+    struct QueuedPrompt
+    {
+        QUuid id;
+        ChatRequest request;
+    };
+
+    explicit OutboundQueue(QObject *parent = nullptr);
+    void push(const QueuedPrompt &prompt);
+    void onDispatchFinished(ChatStream *stream, const QUuid &conversation);
+    void updateStats();
+
+    QHash<QUuid, QQueue<QueuedPrompt>> conversations;
+    QList<QUuid> order; // round-robin order of conversations with queued prompts
+    QSet<QUuid> busy;   // conversations with a prompt in flight
+    int cursor = 0;
+    int queuedCount = 0;
+    int inFlight = 0;
+    bool online = true;
+    bool loaded = false;
+    int backoffMs;
+    QTimer *retryTimer;
+    QThread journalThread;
+    JournalWriter *journal;
+};
+
+#endif // OUTBOUNDQUEUE_H
@@ -0,0 +1,124 @@
+#include "paintprofiler.h"
+#include <QCoreApplication>
+#include <QGuiApplication>
+#include <QFile>
+#include <QWidget>
+#include <QDebug>
+#include <algorithm>
+
+PaintProfiler *PaintProfiler::instance()
+{
+    static PaintProfiler *profiler = []() -> PaintProfiler *
+    {
+        QByteArray setting = qgetenv("D0_PAINT_PROFILE");
+        if (setting.isEmpty() || setting == "0")
+        {
+            return nullptr;
+        }
+        PaintProfiler *p = new PaintProfiler(setting == "1" ? QString() : QString::fromLocal8Bit(setting));
+        QObject::connect(qApp, &QCoreApplication::aboutToQuit, [p]()
+                         { p->report(); });
+        return p;
+    }();
+    return profiler;
+}
+
+PaintProfiler::PaintProfiler(const QString &csvPath)
+{
+    if (!csvPath.isEmpty())
+    {
+        csv = new QFile(csvPath);
+        if (csv->open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+        {
+            csv->write("frame_ms,dirty_pixels\n");
+        }
+        else
+        {
+            qWarning() << "PaintProfiler: cannot open" << csvPath;
+            delete csv;
+            csv = nullptr;
+        }
+    }
+}
+
+PaintProfiler::~PaintProfiler()
+{
+    delete csv;
+}
+
+void PaintProfiler::beginFrame()
+{
+    inFrame = true;
+    frameDirty = QRegion();
+    frameTimer.start();
+}
+
+void PaintProfiler::addDirtyRegion(QWidget *widget, const QRegion &region)
+{
+    // Accumulate in window coordinates so a child repainting inside its
+    // translucent parent is not counted twice
+    QRegion inWindow = region.translated(widget->mapTo(widget->window(), QPoint(0, 0)));
+    if (!inFrame)
+    {
+        // Synchronous repaint() outside an UpdateRequest: count it as its own frame
+        beginFrame();
+        frameDirty = inWindow;
+        endFrame();
+        return;
+    }
+    frameDirty += inWindow;
+}
+
+void PaintProfiler::endFrame()
+{
+    if (!inFrame)
+    {
+        return;
+    }
+    inFrame = false;
+
+    qint64 pixels = 0;
+    for (const QRect &rect : frameDirty)
+    {
+        pixels += qint64(rect.width()) * rect.height();
+    }
+    if (pixels == 0)
+    {
+        return; // update request that painted nothing
+    }
+
+    Frame frame{frameTimer.nsecsElapsed() / 1e6, pixels};
+    frameLog.append(frame);
+    if (csv)
+    {
+        csv->write(QByteArray::number(frame.ms, 'f', 3) + ',' + QByteArray::number(frame.dirtyPixels) + '\n');
+    }
+}
+
+void PaintProfiler::report() const
+{
+    if (frameLog.isEmpty())
+    {
+        qDebug() << "PaintProfiler: no frames painted";
+        return;
+    }
+
+    QVector<double> times;
+    times.reserve(frameLog.size());
+    double totalMs = 0;
+    qint64 totalPixels = 0;
+    for (const Frame &frame : frameLog)
+    {
+        times.append(frame.ms);
+        totalMs += frame.ms;
+        totalPixels += frame.dirtyPixels;
+    }
+    std::sort(times.begin(), times.end());
+    auto percentile = [&times](double p)
+    { return times.at(qMin(times.size() - 1, int(p * times.size()))); };
+
+    qDebug().nospace() << "PaintProfiler [" << QGuiApplication::platformName() << "]: "
+                       << frameLog.size() << " frames, mean " << totalMs / frameLog.size() << " ms"
+                       << ", p50 " << percentile(0.50) << " ms, p95 " << percentile(0.95) << " ms"
+                       << ", max " << times.last() << " ms, mean dirty " << totalPixels / frameLog.size() << " px";
+}
@@ -0,0 +1,46 @@
+#ifndef PAINTPROFILER_H
+#define PAINTPROFILER_H
+
+#include <QElapsedTimer>
+#include <QRegion>
+#include <QVector>
+
+class QFile;
+class QWidget;
+
+// Measures paint cost per frame (one UpdateRequest) and the dirty area painted.
+// Enabled by setting D0_PAINT_PROFILE: "1" prints a summary on exit, any other
+// value is taken as a CSV path that receives one line per frame. Run the same
+// scenario with QT_QPA_PLATFORM=offscreen (or under Xvfb) to compare numbers
+// across machines.
+class PaintProfiler
+{
+public:
+    struct Frame
+    {
+        double ms;
+        qint64 dirtyPixels;
+    };
+
+    // Returns nullptr when profiling is disabled
+    static PaintProfiler *instance();
+
+    void beginFrame();
+    void addDirtyRegion(QWidget *widget, const QRegion &region);
+    void endFrame();
+    void report() const;
+
+    const QVector<Frame> &frames() const { return frameLog; }
+
+private:
+    explicit PaintProfiler(const QString &csvPath);
+    ~PaintProfiler();
+
+    QElapsedTimer frameTimer;
+    QRegion frameDirty;
+    bool inFrame = false;
+    QVector<Frame> frameLog;
+    QFile *csv = nullptr;
+};
+
+#endif // PAINTPROFILER_H
@@ -0,0 +1,223 @@
+#include "replyview.h"
+#include "stats.h"
+#include <QMouseEvent>
+#include <QPaintEvent>
+#include <QPainter>
+
+static const int PageLines = 128;
+static const int KeptPages = 32;
+static const int MaxLineChars = 1000; // longer lines are cut; nothing wraps
+
+ReplyView::ReplyView(QWidget *parent) : QWidget(parent), pages(KeptPages)
+{
+    setSizePolicy(QSizePolicy::Preferred, QSizePolicy::Fixed);
+}
+
+bool ReplyView::isHuge(const QString &text)
+{
+    return text.size() > HugeChars || text.count('\n') >= HugeLines;
+}
+
+QString ReplyView::collapsedPreview(const QString &text)
+{
+    QVector<qsizetype> starts{0};
+    for (qsizetype i = text.indexOf('\n'); i >= 0; i = text.indexOf('\n', i + 1))
+    {
+        starts.append(i + 1);
+    }
+    int lines = starts.size();
+    if (lines <= 2 * EdgeLines + 1)
+    {
+        return text.size() > HugeChars ? text.left(HugeChars) + "\n[truncated]" : text;
+    }
+    QString head = text.left(starts.at(EdgeLines));
+    QString tail = text.mid(starts.at(lines - EdgeLines));
+    return head + QString("[%1 lines hidden]\n").arg(lines - 2 * EdgeLines) + tail;
+}
+
+void ReplyView::setText(const QString &value)
+{
+    text = value;
+    lineStarts.clear();
+    pages.clear();
+    indexLines(0);
+}
+
+void ReplyView::appendText(const QString &more)
+{
+    if (more.isEmpty())
+    {
+        return;
+    }
+    // The last line may grow; re-index from its start and drop its page
+    int from = lineStarts.isEmpty() ? 0 : lineStarts.last();
+    if (!lineStarts.isEmpty())
+    {
+        pages.remove((lineStarts.size() - 1) / PageLines);
+        lineStarts.removeLast();
+    }
+    text += more;
+    indexLines(from);
+}
+
+void ReplyView::indexLines(int from)
+{
+    int oldRows = rowCount();
+    lineStarts.append(from);
+    for (qsizetype i = text.indexOf('\n', from); i >= 0; i = text.indexOf('\n', i + 1))
+    {
+        lineStarts.append(int(i + 1));
+    }
+    if (lineStarts.size() > 1 && lineStarts.last() == text.size())
+    {
+        lineStarts.removeLast(); // a trailing newline does not start a row
+    }
+    if (rowCount() != oldRows)
+    {
+        updateGeometry();
+    }
+    update();
+}
+
+void ReplyView::setExpanded(bool expand)
+{
+    if (expanded == expand)
+    {
+        return;
+    }
+    expanded = expand;
+    Stats::instance()->add(expand ? "reply_view.expanded" : "reply_view.collapsed");
+    updateGeometry();
+    update();
+}
+
+int ReplyView::rowCount() const
+{
+    if (!isCollapsible())
+    {
+        return lineStarts.size();
+    }
+    return expanded ? lineStarts.size() + 1 : 2 * EdgeLines + 1;
+}
+
+int ReplyView::toggleRow() const
+{
+    if (!isCollapsible())
+    {
+        return -1;
+    }
+    return expanded ? 0 : EdgeLines;
+}
+
+int ReplyView::lineForRow(int row) const
+{
+    if (!isCollapsible())
+    {
+        return row;
+    }
+    if (expanded)
+    {
+        return row - 1;
+    }
+    if (row < EdgeLines)
+    {
+        return row;
+    }
+    if (row == EdgeLines)
+    {
+        return -1;
+    }
+    return lineStarts.size() - (2 * EdgeLines + 1 - row);
+}
+
+QString ReplyView::lineText(int line) const
+{
+    int start = lineStarts.at(line);
+    int end = line + 1 < lineStarts.size() ? lineStarts.at(line + 1) - 1 : text.size();
+    QString value = text.mid(start, qMin(end - start, MaxLineChars));
+    if (end - start > MaxLineChars)
+    {
+        value += QChar(0x2026);
+    }
+    return value;
+}
+
+const QStaticText &ReplyView::staticLine(int line)
+{
+    int page = line / PageLines;
+    QVector<QStaticText> *laidOut = pages.object(page);
+    if (!laidOut)
+    {
+        // Shaped a page at a time, only once some line of it is on screen
+        laidOut = new QVector<QStaticText>;
+        int first = page * PageLines;
+        int last = qMin<int>(lineStarts.size(), first + PageLines);
+        laidOut->reserve(last - first);
+        for (int i = first; i < last; ++i)
+        {
+            QStaticText staticText(lineText(i));
+            staticText.setTextFormat(Qt::PlainText);
+            staticText.prepare(QTransform(), font());
+            laidOut->append(staticText);
+        }
+        pages.insert(page, laidOut);
+        Stats::instance()->add("reply_view.pages_laid_out");
+    }
+    return laidOut->at(line % PageLines);
+}
+
+QSize ReplyView::sizeHint() const
+{
+    return QSize(200, rowCount() * fontMetrics().lineSpacing());
+}
+
+QSize ReplyView::minimumSizeHint() const
+{
+    return QSize(0, rowCount() * fontMetrics().lineSpacing());
+}
+
+void ReplyView::paintEvent(QPaintEvent *event)
+{
+    QPainter painter(this);
+    painter.setFont(font());
+    int lineHeight = fontMetrics().lineSpacing();
+    QRect dirty = event->rect();
+    int first = qMax(0, dirty.top() / lineHeight);
+    int last = qMin(rowCount() - 1, dirty.bottom() / lineHeight);
+    for (int row = first; row <= last; ++row)
+    {
+        int line = lineForRow(row);
+        QRect rowRect(0, row * lineHeight, width(), lineHeight);
+        if (line < 0)
+        {
+            QString label = expanded ? QString("▾ Hide %1 lines").arg(lineStarts.size() - 2 * EdgeLines)
+                                     : QString("▸ %1 more lines").arg(lineStarts.size() - 2 * EdgeLines);
+            painter.setPen(palette().color(QPalette::Link));
+            painter.drawText(rowRect, Qt::AlignLeft | Qt::AlignVCenter, label);
+            continue;
+        }
+        painter.setPen(palette().color(QPalette::WindowText));
+        painter.drawStaticText(rowRect.topLeft(), staticLine(line));
+    }
+}
+
+void ReplyView::mousePressEvent(QMouseEvent *event)
+{
+    int row = int(event->position().y()) / fontMetrics().lineSpacing();
+    if (event->button() == Qt::LeftButton && row == toggleRow())
+    {
+        setExpanded(!expanded);
+        return;
+    }
+    QWidget::mousePressEvent(event);
+}
+
+void ReplyView::changeEvent(QEvent *event)
+{
+    if (event->type() == QEvent::FontChange)
+    {
+        pages.clear();
+        updateGeometry();
+    }
+    QWidget::changeEvent(event);
+}
@@ -0,0 +1,61 @@
+#ifndef REPLYVIEW_H
+#define REPLYVIEW_H
+
+#include <QCache>
+#include <QStaticText>
+#include <QVector>
+#include <QWidget>
+
+// A reply too large for a QLabel: a log or code dump of thousands of lines.
+// Lines are not wrapped, so every row is one line high and the widget's
+// height is known without shaping anything. Collapsed, it shows the first
+// and last lines around a toggle row; expanded, it shows everything. Lines
+// are laid out in pages of QStaticText the first time a page is painted,
+// and only the pages on screen are kept warm.
+class ReplyView : public QWidget
+{
+    Q_OBJECT
+
+public:
+    static constexpr int HugeLines = 200;
+    static constexpr int HugeChars = 32 * 1024;
+    static constexpr int EdgeLines = 20; // shown above and below the collapsed middle
+
+    explicit ReplyView(QWidget *parent = nullptr);
+
+    // Text that should use a ReplyView instead of a QLabel
+    static bool isHuge(const QString &text);
+    // The collapsed form as plain text, for places that show a static preview
+    static QString collapsedPreview(const QString &text);
+
+    void setText(const QString &text);
+    void appendText(const QString &text); // streamed continuation
+    int lineCount() const { return lineStarts.size(); }
+
+    bool isExpanded() const { return expanded; }
+    void setExpanded(bool expand);
+
+    QSize sizeHint() const override;
+    QSize minimumSizeHint() const override;
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void mousePressEvent(QMouseEvent *event) override;
+    void changeEvent(QEvent *event) override;
+
+private:
+    bool isCollapsible() const { return lineStarts.size() > 2 * EdgeLines + 1; }
+    int rowCount() const;
+    int lineForRow(int row) const; // -1 for the toggle row
+    int toggleRow() const;
+    QString lineText(int line) const;
+    const QStaticText &staticLine(int line);
+    void indexLines(int from);
+
+    QString text;
+    QVector<int> lineStarts;
+    bool expanded = false;
+    QCache<int, QVector<QStaticText>> pages; // by page number
+};
+
+#endif // REPLYVIEW_H
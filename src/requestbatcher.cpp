@@ -0,0 +1,188 @@
+#include "requestbatcher.h"
+#include "alloctracker.h"
+#include "chatclient.h"
+#include "stats.h"
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QNetworkReply>
+#include <memory>
+
+RequestBatcher::RequestBatcher(Post post, QObject *parent)
+    : QObject(parent), post(std::move(post))
+{
+    window.setSingleShot(true);
+    connect(&window, &QTimer::timeout, this, &RequestBatcher::flush);
+}
+
+QUrl RequestBatcher::batchUrl(const QUrl &endpoint)
+{
+    QUrl url = endpoint;
+    QString path = url.path();
+    if (path.endsWith('/'))
+    {
+        path.chop(1);
+    }
+    url.setPath(path + "/batch");
+    return url;
+}
+
+void RequestBatcher::add(const QUrl &url, const QByteArray &body, InFlightReply *reply)
+{
+    Pending &waiting = pending[url];
+    if (!waiting.entries.isEmpty() && waiting.bytes + body.size() > MaxBytes)
+    {
+        submit(url, std::exchange(waiting.entries, {}));
+        waiting.bytes = 0;
+    }
+    waiting.entries.append(Entry{reply, body});
+    waiting.bytes += body.size();
+    if (waiting.entries.size() >= MaxRequests)
+    {
+        submit(url, pending.take(url).entries);
+        return;
+    }
+    // The window counts from the oldest waiting request, so adding more never delays it
+    if (!window.isActive())
+    {
+        window.start(WindowMs);
+    }
+}
+
+void RequestBatcher::flush()
+{
+    window.stop();
+    QHash<QUrl, Pending> batches = std::exchange(pending, {});
+    for (auto it = batches.begin(); it != batches.end(); ++it)
+    {
+        submit(it.key(), it->entries);
+    }
+}
+
+void RequestBatcher::submit(const QUrl &url, QList<Entry> entries)
+{
+    // Callers that went away while the request waited are left out
+    entries.removeIf([](const Entry &entry)
+                     { return !entry.reply || entry.reply->done; });
+    if (entries.isEmpty())
+    {
+        return;
+    }
+
+    QJsonArray requests;
+    for (int i = 0; i < entries.size(); ++i)
+    {
+        QJsonObject body = QJsonDocument::fromJson(entries.at(i).body).object();
+        body["stream"] = false;
+        requests.append(QJsonObject{{"custom_id", QString::number(i)}, {"body", body}});
+    }
+    QByteArray document = QJsonDocument(QJsonObject{{"requests", requests}}).toJson(QJsonDocument::Compact);
+    QNetworkReply *reply = post(batchUrl(url), document);
+    reply->setParent(this);
+    connect(reply, &QNetworkReply::finished, this, [this, reply, url, entries]()
+            { onBatchFinished(reply, url, entries); });
+
+    Stats::instance()->add("chat.batch.sent");
+    Stats::instance()->add("chat.batch.requests", entries.size());
+}
+
+void RequestBatcher::onBatchFinished(QNetworkReply *reply, const QUrl &url, const QList<Entry> &entries)
+{
+    reply->deleteLater();
+    int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (status == 404 || status == 405 || status == 501)
+    {
+        unsupported.insert(url);
+        sendSeparately(url, entries);
+        if (pending.contains(url))
+        {
+            sendSeparately(url, pending.take(url).entries);
+        }
+        return;
+    }
+    if (reply->error() != QNetworkReply::NoError)
+    {
+        for (const Entry &entry : entries)
+        {
+            if (entry.reply && !entry.reply->done)
+            {
+                entry.reply->fail(reply->errorString(), reply->error());
+            }
+        }
+        return;
+    }
+
+    AllocScope scope(AllocTracker::Parsing);
+    QHash<QString, QJsonObject> results;
+    for (const QJsonValue &value : QJsonDocument::fromJson(reply->readAll()).object()["responses"].toArray())
+    {
+        QJsonObject result = value.toObject();
+        results.insert(result["custom_id"].toString(), result);
+    }
+    for (int i = 0; i < entries.size(); ++i)
+    {
+        InFlightReply *waiting = entries.at(i).reply;
+        if (!waiting || waiting->done)
+        {
+            continue;
+        }
+        auto found = results.constFind(QString::number(i));
+        if (found == results.constEnd())
+        {
+            waiting->fail(QStringLiteral("Missing from the batch response"), QNetworkReply::UnknownContentError);
+            continue;
+        }
+        QJsonObject response = found->value("response").toObject();
+        QJsonObject error = found->value("error").toObject();
+        if (error.isEmpty())
+        {
+            error = response["body"].toObject()["error"].toObject();
+        }
+        int code = response["status_code"].toInt(error.isEmpty() ? 200 : 500);
+        if (!error.isEmpty() || code >= 400)
+        {
+            QString message = error["message"].toString();
+            waiting->fail(message.isEmpty() ? QString("Batch entry failed with status %1").arg(code) : message,
+                          QNetworkReply::UnknownServerError);
+            continue;
+        }
+        waiting->complete(QJsonDocument(response["body"].toObject()).toJson(QJsonDocument::Compact));
+    }
+}
+
+void RequestBatcher::sendSeparately(const QUrl &url, const QList<Entry> &entries)
+{
+    for (const Entry &entry : entries)
+    {
+        separate.append({url, entry});
+    }
+    sendNextSeparate();
+}
+
+void RequestBatcher::sendNextSeparate()
+{
+    while (separateInFlight < MaxSeparate && !separate.isEmpty())
+    {
+        auto [url, entry] = separate.takeFirst();
+        if (!entry.reply || entry.reply->done)
+        {
+            continue;
+        }
+        QNetworkReply *reply = post(url, entry.body);
+        ++separateInFlight;
+        // The slot is free once the reply finishes or is thrown away unfinished
+        auto released = std::make_shared<bool>(false);
+        auto release = [this, released]()
+        {
+            if (!std::exchange(*released, true))
+            {
+                --separateInFlight;
+                sendNextSeparate();
+            }
+        };
+        connect(reply, &QNetworkReply::finished, this, release);
+        connect(reply, &QObject::destroyed, this, release);
+        entry.reply->attach(reply);
+        Stats::instance()->add("chat.batch.unbatched");
+    }
+}
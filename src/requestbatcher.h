@@ -0,0 +1,82 @@
+#ifndef REQUESTBATCHER_H
+#define REQUESTBATCHER_H
+
+#include <QObject>
+#include <QHash>
+#include <QList>
+#include <QPointer>
+#include <QSet>
+#include <QTimer>
+#include <QUrl>
+#include <functional>
+#include <utility>
+
+class InFlightReply;
+class QNetworkReply;
+
+// Sends background completion requests several at a time. Requests to the
+// same endpoint are held for up to WindowMs, or until MaxRequests or
+// MaxBytes are waiting, and then POSTed to the endpoint's batch URL (its
+// path plus "/batch") as one document:
+//
+//   {"requests": [{"custom_id": "0", "body": {...}}, ...]}
+//
+// Each body is the usual completion request with "stream" off. The server
+// answers every entry in one document:
+//
+//   {"responses": [{"custom_id": "0", "response": {"status_code": 200, "body": {...}}},
+//                  {"custom_id": "1", "error": {"message": "..."}}, ...]}
+//
+// and each body goes to the InFlightReply waiting for it. An endpoint that
+// answers a batch with 404, 405 or 501 has no batch support: the requests
+// of that batch are sent one by one, at most MaxSeparate at a time, and so
+// are later ones.
+class RequestBatcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    using Post = std::function<QNetworkReply *(const QUrl &url, const QByteArray &body)>;
+
+    static const int WindowMs = 200;
+    static const int MaxRequests = 64;
+    static const qsizetype MaxBytes = 4 * 1024 * 1024;
+    static const int MaxSeparate = 4; // requests of a failed batch in flight at once
+
+    RequestBatcher(Post post, QObject *parent = nullptr);
+
+    // False once url turned out not to take batches
+    bool supports(const QUrl &url) const { return !unsupported.contains(url); }
+    // body is the request as it would be sent on its own
+    void add(const QUrl &url, const QByteArray &body, InFlightReply *reply);
+    // Sends everything waiting now
+    void flush();
+
+    static QUrl batchUrl(const QUrl &endpoint);
+
+private:
+    struct Entry
+    {
+        QPointer<InFlightReply> reply;
+        QByteArray body;
+    };
+    struct Pending
+    {
+        QList<Entry> entries;
+        qsizetype bytes = 0;
+    };
+
+    void submit(const QUrl &url, QList<Entry> entries);
+    void onBatchFinished(QNetworkReply *reply, const QUrl &url, const QList<Entry> &entries);
+    void sendSeparately(const QUrl &url, const QList<Entry> &entries);
+    void sendNextSeparate();
+
+    Post post;
+    QHash<QUrl, Pending> pending; // by endpoint
+    QSet<QUrl> unsupported;
+    QList<std::pair<QUrl, Entry>> separate; // waiting for a slot below MaxSeparate
+    int separateInFlight = 0;
+    QTimer window;
+};
+
+#endif // REQUESTBATCHER_H
@@ -0,0 +1,429 @@
+#include "responsecache.h"
+#include "stats.h"
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QLockFile>
+#include <QStandardPaths>
+#include <QThread>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#ifdef Q_OS_UNIX
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+static const quint32 Magic = 0x44305243;
+static const quint32 Version = 1;
+static const int MaxReaders = 64;
+static const int MaxProbe = 32;
+static const qint64 MaxAgeMs = 24 * 3600 * 1000;
+static const int ReaderWaitMs = 200;
+static constexpr qint64 HeaderBytes = 4096;
+
+// Everything in the mapping is accessed through std::atomic_ref, which works
+// across processes as long as the operations are lock-free
+using Atomic = std::atomic_ref<quint64>;
+static_assert(Atomic::is_always_lock_free, "the shared cache needs lock-free 64-bit atomics");
+
+struct CacheHeader
+{
+    quint32 magic;
+    quint32 version;
+    quint32 slotCount; // power of two
+    quint32 reserved;
+    quint64 valueBytes; // size of the value ring
+    quint64 head;       // oldest live byte of the log (logical offset)
+    quint64 tail;       // end of the log (logical offset)
+    quint64 epoch;
+    struct Reader
+    {
+        quint64 pid;   // 0: free
+        quint64 epoch; // 0: not reading
+    } readers[MaxReaders];
+};
+static_assert(sizeof(CacheHeader) <= HeaderBytes, "header must fit its page");
+
+struct CacheSlot
+{
+    quint64 tag;    // 0: never used; chains stop here
+    quint64 offset; // logical offset + 1 of the record, 0: unlinked
+};
+
+// Records are 8-byte aligned in the ring
+struct CacheRecord
+{
+    quint64 tag;      // 0 marks padding up to the end of the ring
+    quint32 length;   // UTF-8 bytes that follow
+    quint32 checksum; // over key and text, catches torn reads
+    qint64 storedAt;  // ms since epoch
+    char key[32];
+};
+
+static quint64 tagOf(const QByteArray &key)
+{
+    quint64 tag;
+    memcpy(&tag, key.constData(), sizeof(tag));
+    return tag < 2 ? tag + 2 : tag; // 0 is reserved
+}
+
+static quint32 checksum(const char *key, const char *data, quint32 length)
+{
+    quint32 hash = 2166136261u;
+    for (int i = 0; i < 32; ++i)
+    {
+        hash = (hash ^ uchar(key[i])) * 16777619u;
+    }
+    for (quint32 i = 0; i < length; ++i)
+    {
+        hash = (hash ^ uchar(data[i])) * 16777619u;
+    }
+    return hash;
+}
+
+static quint64 recordBytes(quint32 length)
+{
+    return (sizeof(CacheRecord) + length + 7) & ~quint64(7);
+}
+
+static bool processAlive(quint64 pid)
+{
+#ifdef Q_OS_UNIX
+    return kill(pid_t(pid), 0) == 0 || errno == EPERM;
+#else
+    Q_UNUSED(pid);
+    return true;
+#endif
+}
+
+ResponseCache *ResponseCache::instance()
+{
+    static ResponseCache *cache = []()
+    {
+        ResponseCache *created = new ResponseCache(qApp);
+        if (qEnvironmentVariable("D0_RESPONSE_CACHE") != "0")
+        {
+            QString dir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+            QDir().mkpath(dir);
+            created->open(dir + "/responses.cache");
+        }
+        return created;
+    }();
+    return cache;
+}
+
+ResponseCache::ResponseCache(QObject *parent) : QObject(parent)
+{
+    writer.setMaxThreadCount(1);
+}
+
+ResponseCache::~ResponseCache()
+{
+    close();
+}
+
+bool ResponseCache::open(const QString &path, int slotCount, qint64 valueBytes)
+{
+    close();
+    Q_ASSERT((slotCount & (slotCount - 1)) == 0);
+    valueBytes &= ~qint64(7);
+    qint64 size = HeaderBytes + qint64(slotCount) * sizeof(CacheSlot) + valueBytes;
+
+    // Creation and layout checks happen under the writers' lock
+    QLockFile lock(path + ".lock");
+    if (!lock.lock())
+    {
+        return false;
+    }
+    file.setFileName(path);
+    if (!file.open(QIODevice::ReadWrite))
+    {
+        return false;
+    }
+    bool fresh = file.size() != size;
+    if (!fresh)
+    {
+        CacheHeader existing;
+        fresh = file.read(reinterpret_cast<char *>(&existing), sizeof(existing)) != sizeof(existing) ||
+                existing.magic != Magic || existing.version != Version ||
+                existing.slotCount != quint32(slotCount) || existing.valueBytes != quint64(valueBytes);
+    }
+    if (fresh && !(file.resize(0) && file.resize(size)))
+    {
+        file.close();
+        return false;
+    }
+    base = file.map(0, size);
+    if (!base)
+    {
+        file.close();
+        return false;
+    }
+    header = reinterpret_cast<CacheHeader *>(base);
+    slots = reinterpret_cast<CacheSlot *>(base + HeaderBytes);
+    values = base + HeaderBytes + qint64(slotCount) * sizeof(CacheSlot);
+    if (fresh)
+    {
+        // resize() zero-fills, so only the layout needs writing
+        header->slotCount = slotCount;
+        header->valueBytes = valueBytes;
+        header->version = Version;
+        header->epoch = 1;
+        Atomic(header->tail).store(0);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        header->magic = Magic;
+    }
+    claimReaderSlot();
+    if (readerSlot < 0)
+    {
+        close(); // a lookup without a slot would announce its epoch in someone else's
+        return false;
+    }
+    return true;
+}
+
+void ResponseCache::close()
+{
+    writer.waitForDone(); // stores write into the mapping
+    if (base)
+    {
+        if (readerSlot >= 0)
+        {
+            Atomic(header->readers[readerSlot].epoch).store(0);
+            Atomic(header->readers[readerSlot].pid).store(0);
+        }
+        file.unmap(base);
+        file.close();
+    }
+    base = nullptr;
+    header = nullptr;
+    readerSlot = -1;
+}
+
+void ResponseCache::claimReaderSlot()
+{
+    quint64 pid = QCoreApplication::applicationPid();
+    for (int i = 0; i < MaxReaders && readerSlot < 0; ++i)
+    {
+        CacheHeader::Reader &reader = header->readers[i];
+        quint64 owner = Atomic(reader.pid).load();
+        // Slots of crashed processes are taken over
+        if (owner != 0 && processAlive(owner))
+        {
+            continue;
+        }
+        if (Atomic(reader.pid).compare_exchange_strong(owner, pid))
+        {
+            Atomic(reader.epoch).store(0);
+            readerSlot = i;
+        }
+    }
+}
+
+bool ResponseCache::lookup(const QByteArray &key, QString *text)
+{
+    Q_ASSERT(QThread::currentThread() == thread());
+    if (!base || key.size() != 32)
+    {
+        return false;
+    }
+    Atomic announced(header->readers[readerSlot].epoch);
+    announced.store(Atomic(header->epoch).load());
+    // A store is not ordered before later acquire loads (StoreLoad); the fence
+    // pairs with the writer's seq_cst unlink and reader-epoch loads, so either
+    // it sees our announcement or we see its unlinked slots
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    bool found = false;
+    quint64 tag = tagOf(key);
+    quint32 mask = header->slotCount - 1;
+    for (int probe = 0; probe < MaxProbe && !found; ++probe)
+    {
+        CacheSlot &slot = slots[(tag + probe) & mask];
+        quint64 slotTag = Atomic(slot.tag).load(std::memory_order_acquire);
+        if (slotTag == 0)
+        {
+            break;
+        }
+        quint64 offset = Atomic(slot.offset).load(std::memory_order_acquire);
+        if (slotTag != tag || offset == 0 || offset - 1 < Atomic(header->head).load())
+        {
+            continue;
+        }
+        const CacheRecord *record = reinterpret_cast<const CacheRecord *>(values + (offset - 1) % header->valueBytes);
+        CacheRecord copy;
+        memcpy(&copy, record, sizeof(copy));
+        if (copy.tag != tag || memcmp(copy.key, key.constData(), 32) != 0 ||
+            recordBytes(copy.length) > header->valueBytes ||
+            QDateTime::currentMSecsSinceEpoch() - copy.storedAt > MaxAgeMs)
+        {
+            continue;
+        }
+        const char *data = reinterpret_cast<const char *>(record + 1);
+        if (checksum(copy.key, data, copy.length) == copy.checksum)
+        {
+            *text = QString::fromUtf8(data, copy.length);
+            found = true;
+        }
+    }
+
+    announced.store(0, std::memory_order_release);
+    Stats::instance()->add(found ? "cache.shared.hits" : "cache.shared.misses");
+    return found;
+}
+
+void ResponseCache::store(const QByteArray &key, const QString &text)
+{
+    Q_ASSERT(QThread::currentThread() == thread());
+    QByteArray data = text.toUtf8();
+    if (!base || key.size() != 32 || recordBytes(data.size()) > header->valueBytes / 4)
+    {
+        return;
+    }
+    // close() waits for the writer, so the mapping outlives the job
+    writer.start([this, key, data]()
+                 { write(key, data); });
+}
+
+// Runs on the writer thread
+void ResponseCache::write(const QByteArray &key, const QByteArray &data)
+{
+    QLockFile lock(file.fileName() + ".lock");
+    if (!lock.tryLock(50))
+    {
+        return; // another instance is storing; dropping one entry is fine
+    }
+
+    // Records never straddle the end of the ring
+    quint64 size = recordBytes(data.size());
+    quint64 tail = Atomic(header->tail).load();
+    quint64 position = tail;
+    if (position % header->valueBytes + size > header->valueBytes)
+    {
+        position += header->valueBytes - position % header->valueBytes;
+    }
+    if (!reclaim(position + size))
+    {
+        return;
+    }
+    if (position != tail && header->valueBytes - tail % header->valueBytes >= sizeof(CacheRecord))
+    {
+        memset(values + tail % header->valueBytes, 0, sizeof(CacheRecord)); // padding marker
+    }
+
+    CacheRecord *record = reinterpret_cast<CacheRecord *>(values + position % header->valueBytes);
+    record->tag = tagOf(key);
+    record->length = data.size();
+    record->storedAt = QDateTime::currentMSecsSinceEpoch();
+    memcpy(record->key, key.constData(), 32);
+    memcpy(record + 1, data.constData(), data.size());
+    record->checksum = checksum(record->key, data.constData(), data.size());
+    Atomic(header->tail).store(position + size);
+
+    // Link it: the same key's slot, else the first unlinked or unused one
+    quint64 tag = record->tag;
+    quint32 mask = header->slotCount - 1;
+    CacheSlot *target = nullptr;
+    for (int probe = 0; probe < MaxProbe; ++probe)
+    {
+        CacheSlot &slot = slots[(tag + probe) & mask];
+        quint64 slotTag = Atomic(slot.tag).load();
+        if (slotTag == tag)
+        {
+            target = &slot;
+            break;
+        }
+        if (!target && (slotTag == 0 || Atomic(slot.offset).load() == 0))
+        {
+            target = &slot;
+        }
+        if (slotTag == 0)
+        {
+            break;
+        }
+    }
+    if (target)
+    {
+        // Readers check the record's key, so a reused slot briefly pairing
+        // the new tag with an old offset is harmless
+        Atomic(target->tag).store(tag, std::memory_order_release);
+        Atomic(target->offset).store(position + 1, std::memory_order_release);
+        Stats::instance()->add("cache.shared.stores");
+    }
+}
+
+// Frees the oldest records until the log can extend to end
+bool ResponseCache::reclaim(quint64 end)
+{
+    quint64 head = Atomic(header->head).load();
+    if (end - head <= header->valueBytes)
+    {
+        return true;
+    }
+    quint64 newHead = head;
+    while (end - newHead > header->valueBytes)
+    {
+        quint64 physical = newHead % header->valueBytes;
+        const CacheRecord *record = reinterpret_cast<const CacheRecord *>(values + physical);
+        if (header->valueBytes - physical < sizeof(CacheRecord) || record->tag == 0)
+        {
+            newHead += header->valueBytes - physical; // padding to the end of the ring
+        }
+        else
+        {
+            newHead += recordBytes(record->length);
+        }
+    }
+
+    // Unlink, then wait out every reader that may have seen the old links
+    for (quint32 i = 0; i < header->slotCount; ++i)
+    {
+        quint64 offset = Atomic(slots[i].offset).load();
+        if (offset != 0 && offset - 1 < newHead)
+        {
+            Atomic(slots[i].offset).store(0);
+        }
+    }
+    quint64 epoch = Atomic(header->epoch).fetch_add(1) + 1;
+    if (!waitForReaders(epoch))
+    {
+        return false; // the unlinked entries are simply lost
+    }
+    Atomic(header->head).store(newHead);
+    Stats::instance()->add("cache.shared.reclaimed_bytes", newHead - head);
+    return true;
+}
+
+bool ResponseCache::waitForReaders(quint64 epoch)
+{
+    QElapsedTimer waited;
+    waited.start();
+    for (int i = 0; i < MaxReaders; ++i)
+    {
+        CacheHeader::Reader &reader = header->readers[i];
+        for (;;)
+        {
+            // Our own slot counts too: the GUI thread may be in a lookup
+            quint64 seen = Atomic(reader.epoch).load();
+            if (seen == 0 || seen >= epoch)
+            {
+                break;
+            }
+            quint64 pid = Atomic(reader.pid).load();
+            if (pid == 0 || !processAlive(pid))
+            {
+                Atomic(reader.epoch).compare_exchange_strong(seen, 0);
+                break;
+            }
+            if (waited.elapsed() > ReaderWaitMs)
+            {
+                return false;
+            }
+            QThread::yieldCurrentThread();
+        }
+    }
+    return true;
+}
@@ -0,0 +1,62 @@
+#ifndef RESPONSECACHE_H
+#define RESPONSECACHE_H
+
+#include <QObject>
+#include <QFile>
+#include <QThreadPool>
+
+struct CacheHeader;
+struct CacheSlot;
+
+// Completed responses shared by every instance of the app on this machine,
+// keyed by the SHA-256 of the request. Lives in one memory-mapped file:
+//
+//   header | index: open-addressing slots of (tag, offset) | value log
+//
+// Lookups take no lock: they announce the current epoch in a per-process
+// reader slot, probe the index with atomic loads and copy the value out.
+// Stores are serialized by a lock file. The value log is a ring; before a
+// store overwrites old records it unlinks them from the index, advances the
+// epoch and waits until no reader is left in an older epoch. That wait can
+// take a while, so stores are written by a thread of their own.
+//
+// Lookups and stores must come from the thread that created the cache.
+class ResponseCache : public QObject
+{
+    Q_OBJECT
+
+public:
+    static ResponseCache *instance();
+
+    explicit ResponseCache(QObject *parent = nullptr);
+    ~ResponseCache() override;
+
+    // Opens (creating if needed) a cache file; instance() uses the one in
+    // CacheLocation. False if the file cannot be mapped or every reader slot
+    // is taken by other processes; the cache then stays closed.
+    bool open(const QString &path, int slotCount = 65536, qint64 valueBytes = 64LL * 1024 * 1024);
+    bool isOpen() const { return base != nullptr; }
+
+    bool lookup(const QByteArray &key, QString *text);
+    // Queued for the writer thread; lookups see the entry once it is written
+    void store(const QByteArray &key, const QString &text);
+    // Blocks until every queued store is written
+    void flush() { writer.waitForDone(); }
+
+private:
+    void close();
+    void write(const QByteArray &key, const QByteArray &data);
+    void claimReaderSlot();
+    bool reclaim(quint64 end);
+    bool waitForReaders(quint64 epoch);
+
+    QFile file;
+    uchar *base = nullptr;
+    CacheHeader *header = nullptr;
+    CacheSlot *slots = nullptr;
+    uchar *values = nullptr;
+    int readerSlot = -1;
+    QThreadPool writer; // one thread, so stores stay in order
+};
+
+#endif // RESPONSECACHE_H
@@ -0,0 +1,193 @@
+#include "screencapture.h"
+#include "stats.h"
+#include <QBuffer>
+#include <QGuiApplication>
+#include <QImageWriter>
+#include <QKeyEvent>
+#include <QMouseEvent>
+#include <QPainter>
+#include <QPointer>
+#include <QScreen>
+#include <QThreadPool>
+#include <QDebug>
+
+RegionSelector::RegionSelector(QScreen *screen, const QPixmap &frozen, QWidget *parent)
+    : QWidget(parent), frozen(frozen)
+{
+    setWindowFlags(Qt::WindowStaysOnTopHint | Qt::FramelessWindowHint | Qt::Tool);
+    setAttribute(Qt::WA_DeleteOnClose);
+    setAttribute(Qt::WA_OpaquePaintEvent);
+    setCursor(Qt::CrossCursor);
+    setGeometry(screen->geometry());
+}
+
+void RegionSelector::paintEvent(QPaintEvent *)
+{
+    QPainter painter(this);
+    painter.drawPixmap(rect(), frozen);
+    painter.fillRect(rect(), QColor(0, 0, 0, 100));
+    if (!selection.isEmpty())
+    {
+        // Show the selected part undimmed
+        qreal ratio = frozen.devicePixelRatio();
+        painter.drawPixmap(selection, frozen, QRectF(selection.topLeft() * ratio, selection.size() * ratio));
+        painter.setPen(QPen(Qt::white, 1, Qt::DashLine));
+        painter.drawRect(selection.adjusted(0, 0, -1, -1));
+    }
+}
+
+void RegionSelector::mousePressEvent(QMouseEvent *event)
+{
+    origin = event->position().toPoint();
+    selection = QRect();
+    update();
+}
+
+void RegionSelector::mouseMoveEvent(QMouseEvent *event)
+{
+    if (event->buttons() & Qt::LeftButton)
+    {
+        QRect dirty = selection;
+        selection = QRect(origin, event->position().toPoint()).normalized();
+        update(dirty.united(selection).adjusted(-1, -1, 1, 1));
+    }
+}
+
+void RegionSelector::mouseReleaseEvent(QMouseEvent *)
+{
+    if (selection.width() > 4 && selection.height() > 4)
+    {
+        emit regionSelected(selection);
+    }
+    else
+    {
+        // A click without a drag takes the whole screen
+        emit regionSelected(rect());
+    }
+    close();
+}
+
+void RegionSelector::keyPressEvent(QKeyEvent *event)
+{
+    if (event->key() == Qt::Key_Escape)
+    {
+        emit cancelled();
+        close();
+    }
+    else
+    {
+        QWidget::keyPressEvent(event);
+    }
+}
+
+ScreenCapture::ScreenCapture(QObject *parent) : QObject(parent)
+{
+}
+
+void ScreenCapture::start(QScreen *screen)
+{
+    if (selector)
+    {
+        return;
+    }
+    // Freeze the screen first so the selector itself never ends up in the capture
+    QElapsedTimer grabTimer;
+    grabTimer.start();
+    frozen = screen->grabWindow(0);
+    grabMs = grabTimer.elapsed();
+
+    selector = new RegionSelector(screen, frozen);
+    connect(selector, &RegionSelector::regionSelected, this, &ScreenCapture::onRegionSelected);
+    connect(selector, &RegionSelector::cancelled, this, &ScreenCapture::cancelled);
+    connect(selector, &QObject::destroyed, this, [this]()
+            {
+                selector = nullptr;
+                frozen = QPixmap();
+            });
+    selector->showFullScreen();
+}
+
+void ScreenCapture::onRegionSelected(const QRect &rect)
+{
+    QElapsedTimer latency;
+    latency.start();
+
+    qreal ratio = frozen.devicePixelRatio();
+    QRect source(rect.topLeft() * ratio, rect.size() * ratio);
+    // QPixmap must stay on the GUI thread; the worker only sees the QImage
+    QImage image = frozen.copy(source).toImage();
+    qint64 alreadySpent = grabMs;
+
+    QPointer<ScreenCapture> guard(this);
+    QThreadPool::globalInstance()->start([guard, image, latency, alreadySpent]()
+                                         {
+                                             ImageAttachment attachment = encode(downscale(image, MaxEdge));
+                                             qint64 totalMs = alreadySpent + latency.elapsed();
+                                             QMetaObject::invokeMethod(qApp, [guard, attachment, totalMs]()
+                                                                       {
+                                                                           if (guard)
+                                                                           {
+                                                                               emit guard->captured(attachment, totalMs);
+                                                                           }
+                                                                       }, Qt::QueuedConnection);
+                                         });
+}
+
+// Averages each 2x2 block. Two channels are summed at once in 16-bit lanes
+// of a 32-bit word; the loop has no branches so the compiler vectorizes it.
+static QImage halve(const QImage &source)
+{
+    QImage half(source.width() / 2, source.height() / 2, source.format());
+    const int width = half.width();
+    for (int y = 0; y < half.height(); ++y)
+    {
+        const quint32 *top = reinterpret_cast<const quint32 *>(source.constScanLine(2 * y));
+        const quint32 *bottom = reinterpret_cast<const quint32 *>(source.constScanLine(2 * y + 1));
+        quint32 *out = reinterpret_cast<quint32 *>(half.scanLine(y));
+        for (int x = 0; x < width; ++x)
+        {
+            quint32 a = top[2 * x], b = top[2 * x + 1], c = bottom[2 * x], d = bottom[2 * x + 1];
+            quint32 redBlue = (a & 0x00ff00ff) + (b & 0x00ff00ff) + (c & 0x00ff00ff) + (d & 0x00ff00ff) + 0x00020002;
+            quint32 alphaGreen = ((a >> 8) & 0x00ff00ff) + ((b >> 8) & 0x00ff00ff) + ((c >> 8) & 0x00ff00ff) + ((d >> 8) & 0x00ff00ff) + 0x00020002;
+            out[x] = ((redBlue >> 2) & 0x00ff00ff) | (((alphaGreen >> 2) & 0x00ff00ff) << 8);
+        }
+    }
+    return half;
+}
+
+QImage ScreenCapture::downscale(const QImage &image, int maxEdge)
+{
+    QImage scaled = image.convertToFormat(image.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32);
+    while (qMax(scaled.width(), scaled.height()) >= 2 * maxEdge)
+    {
+        scaled = halve(scaled);
+    }
+    if (qMax(scaled.width(), scaled.height()) > maxEdge)
+    {
+        scaled = scaled.scaled(maxEdge, maxEdge, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    }
+    return scaled;
+}
+
+ImageAttachment ScreenCapture::encode(const QImage &image)
+{
+    // JPEG keeps encode time low on large captures; PNG only for images with alpha
+    bool png = image.hasAlphaChannel();
+    ImageAttachment attachment;
+    attachment.mimeType = png ? "image/png" : "image/jpeg";
+    attachment.size = image.size();
+
+    QBuffer buffer(&attachment.data);
+    buffer.open(QIODevice::WriteOnly);
+    QImageWriter writer(&buffer, png ? "png" : "jpeg");
+    if (!png)
+    {
+        writer.setQuality(85);
+    }
+    if (!writer.write(image))
+    {
+        qWarning() << "ScreenCapture: encoding failed:" << writer.errorString();
+        attachment.data.clear();
+    }
+    return attachment;
+}
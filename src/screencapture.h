@@ -0,0 +1,70 @@
+#ifndef SCREENCAPTURE_H
+#define SCREENCAPTURE_H
+
+#include <QObject>
+#include <QWidget>
+#include <QImage>
+#include <QPixmap>
+#include <QElapsedTimer>
+#include "chatclient.h"
+
+class QScreen;
+
+// Full-screen view of a frozen screenshot where the user drags out a region
+class RegionSelector : public QWidget
+{
+    Q_OBJECT
+
+public:
+    RegionSelector(QScreen *screen, const QPixmap &frozen, QWidget *parent = nullptr);
+
+signals:
+    void regionSelected(const QRect &rect); // logical coordinates
+    void cancelled();
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void mousePressEvent(QMouseEvent *event) override;
+    void mouseMoveEvent(QMouseEvent *event) override;
+    void mouseReleaseEvent(QMouseEvent *event) override;
+    void keyPressEvent(QKeyEvent *event) override;
+
+private:
+    QPixmap frozen;
+    QPoint origin;
+    QRect selection;
+};
+
+// Grabs a screen region and turns it into an image attachment. Downscaling
+// and encoding run on the global thread pool so the GUI stays responsive;
+// captured() reports the time from grab to attachment.
+class ScreenCapture : public QObject
+{
+    Q_OBJECT
+
+public:
+    // Longest edge sent to the model; larger captures are downscaled
+    static constexpr int MaxEdge = 1568;
+
+    explicit ScreenCapture(QObject *parent = nullptr);
+
+    void start(QScreen *screen);
+
+    // Halves with a 2x2 box filter while the image is at least twice too large,
+    // then finishes with a smooth scale
+    static QImage downscale(const QImage &image, int maxEdge);
+    static ImageAttachment encode(const QImage &image);
+
+signals:
+    void captured(const ImageAttachment &attachment, qint64 latencyMs);
+    void cancelled();
+
+private:
+    void onRegionSelected(const QRect &rect);
+
+    QPixmap frozen;
+    qint64 grabMs = 0;
+    RegionSelector *selector = nullptr;
+};
+
+#endif // SCREENCAPTURE_H
@@ -0,0 +1,86 @@
+#include "searchpanel.h"
+#include "fileview.h"
+#include <QCheckBox>
+#include <QFontDatabase>
+#include <QHBoxLayout>
+#include <QLabel>
+#include <QLineEdit>
+#include <QListWidget>
+#include <QVBoxLayout>
+
+static const int MaxListedHits = 10000; // the rest are only counted
+
+SearchPanel::SearchPanel(FileView *fileView, QWidget *parent)
+    : QDockWidget(tr("Search"), parent), fileView(fileView), search(new FileSearch(this))
+{
+    setObjectName("searchPanel");
+
+    QWidget *content = new QWidget(this);
+    QVBoxLayout *layout = new QVBoxLayout(content);
+    queryField = new QLineEdit(content);
+    queryField->setPlaceholderText(tr("Search the open file"));
+    regexBox = new QCheckBox(tr("Regex"), content);
+    caseBox = new QCheckBox(tr("Match case"), content);
+    QHBoxLayout *options = new QHBoxLayout();
+    options->addWidget(regexBox);
+    options->addWidget(caseBox);
+    options->addStretch();
+    results = new QListWidget(content);
+    results->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+    results->setUniformItemSizes(true);
+    statusLabel = new QLabel(content);
+
+    layout->addWidget(queryField);
+    layout->addLayout(options);
+    layout->addWidget(results, 1);
+    layout->addWidget(statusLabel);
+    setWidget(content);
+
+    connect(queryField, &QLineEdit::returnPressed, this, &SearchPanel::startSearch);
+    connect(search, &FileSearch::hitsFound, this, &SearchPanel::onHitsFound);
+    connect(search, &FileSearch::finished, this, &SearchPanel::onFinished);
+    connect(results, &QListWidget::itemActivated, this, [this](QListWidgetItem *item)
+            { this->fileView->scrollToOffset(item->data(Qt::UserRole).toLongLong()); });
+}
+
+void SearchPanel::focusQuery()
+{
+    show();
+    raise();
+    queryField->setFocus();
+    queryField->selectAll();
+}
+
+void SearchPanel::startSearch()
+{
+    results->clear();
+    if (fileView->path().isEmpty())
+    {
+        statusLabel->setText(tr("Open a file first"));
+        return;
+    }
+    statusLabel->setText(tr("Searching..."));
+    search->start(fileView->path(), queryField->text(), regexBox->isChecked(),
+                  caseBox->isChecked() ? Qt::CaseSensitive : Qt::CaseInsensitive);
+}
+
+void SearchPanel::onHitsFound(const QVector<SearchHit> &hits)
+{
+    for (const SearchHit &hit : hits)
+    {
+        if (results->count() >= MaxListedHits)
+        {
+            break;
+        }
+        QListWidgetItem *item = new QListWidgetItem(hit.text, results);
+        item->setData(Qt::UserRole, hit.offset);
+    }
+}
+
+void SearchPanel::onFinished(qint64 hits, qint64 bytes, qint64 elapsedMs)
+{
+    statusLabel->setText(tr("%1 matching lines in %2 MB, %3 ms")
+                             .arg(hits)
+                             .arg(bytes / (1024 * 1024))
+                             .arg(elapsedMs));
+}
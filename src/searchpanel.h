@@ -0,0 +1,39 @@
+#ifndef SEARCHPANEL_H
+#define SEARCHPANEL_H
+
+#include <QDockWidget>
+#include "filesearch.h"
+
+class QCheckBox;
+class QLabel;
+class QLineEdit;
+class QListWidget;
+class FileView;
+
+// Dock for searching the file shown in a FileView; results appear as the
+// search finds them and jump to the line when activated
+class SearchPanel : public QDockWidget
+{
+    Q_OBJECT
+
+public:
+    explicit SearchPanel(FileView *fileView, QWidget *parent = nullptr);
+
+    void focusQuery();
+
+private slots:
+    void startSearch();
+    void onHitsFound(const QVector<SearchHit> &hits);
+    void onFinished(qint64 hits, qint64 bytes, qint64 elapsedMs);
+
+private:
+    FileView *fileView;
+    FileSearch *search;
+    QLineEdit *queryField;
+    QCheckBox *regexBox;
+    QCheckBox *caseBox;
+    QListWidget *results;
+    QLabel *statusLabel;
+};
+
+#endif // SEARCHPANEL_H
@@ -0,0 +1,189 @@
+#include "sessionstore.h"
+#include "chatoverlay.h"
+#include "stats.h"
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QTimer>
+
+static const quint32 SnapshotMagic = 0x44305353; // "D0SS"
+static const quint32 SnapshotVersion = 1;
+static const int WriteDelayMs = 2000;
+
+QDataStream &operator<<(QDataStream &out, const OverlayState &state)
+{
+    out << state.conversation << state.geometry << state.visible << qint32(state.scrollValue)
+        << qint32(state.totalMessages) << quint32(state.recent.size());
+    for (const ChatMessage &message : state.recent)
+    {
+        out << message.id << message.role << message.timestamp << message.text;
+    }
+    return out;
+}
+
+QDataStream &operator>>(QDataStream &in, OverlayState &state)
+{
+    qint32 scrollValue;
+    qint32 totalMessages;
+    quint32 recent;
+    in >> state.conversation >> state.geometry >> state.visible >> scrollValue >> totalMessages >> recent;
+    state.scrollValue = scrollValue;
+    state.totalMessages = totalMessages;
+    for (quint32 i = 0; i < recent && in.status() == QDataStream::Ok; ++i)
+    {
+        ChatMessage message;
+        message.conversation = state.conversation;
+        in >> message.id >> message.role >> message.timestamp >> message.text;
+        state.recent.append(message);
+    }
+    return in;
+}
+
+SessionStore *SessionStore::instance()
+{
+    static SessionStore *store = new SessionStore(qApp);
+    return store;
+}
+
+SessionStore::SessionStore(QObject *parent) : QObject(parent), writeTimer(new QTimer(this))
+{
+    QString dir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+    QDir().mkpath(dir);
+    path = dir + "/session.bin";
+
+    // One writer thread keeps snapshots in order
+    writer.setMaxThreadCount(1);
+    writeTimer->setSingleShot(true);
+    writeTimer->setTimerType(Qt::VeryCoarseTimer);
+    writeTimer->setInterval(WriteDelayMs);
+    connect(writeTimer, &QTimer::timeout, this, &SessionStore::writeSnapshot);
+    connect(qApp, &QCoreApplication::aboutToQuit, this, [this]()
+            {
+                writeSnapshot();
+                writer.waitForDone();
+            });
+}
+
+SessionStore::~SessionStore()
+{
+    writer.waitForDone();
+}
+
+void SessionStore::track(ChatOverlay *overlay)
+{
+    overlays.append(overlay);
+    connect(overlay, &QObject::destroyed, this, [this, overlay]()
+            {
+                overlays.removeOne(overlay);
+                serialized.remove(overlay);
+                dirty.remove(overlay);
+                writeTimer->start();
+            });
+    markDirty(overlay);
+}
+
+void SessionStore::markDirty(ChatOverlay *overlay)
+{
+    if (restoring)
+    {
+        return;
+    }
+    dirty.insert(overlay);
+    if (!writeTimer->isActive())
+    {
+        writeTimer->start();
+    }
+}
+
+void SessionStore::writeSnapshot()
+{
+    writeTimer->stop();
+    for (ChatOverlay *overlay : std::as_const(dirty))
+    {
+        QByteArray blob;
+        QDataStream out(&blob, QIODevice::WriteOnly);
+        out.setVersion(QDataStream::Qt_6_0);
+        out << overlay->sessionState();
+        serialized.insert(overlay, blob);
+    }
+    dirty.clear();
+
+    // An overlay hidden with Escape has no way back on screen, so it is not
+    // brought back either; otherwise they would pile up across restarts
+    QList<ChatOverlay *> shown;
+    for (ChatOverlay *overlay : std::as_const(overlays))
+    {
+        if (overlay->isVisible())
+        {
+            shown.append(overlay);
+        }
+    }
+    QByteArray snapshot;
+    QDataStream out(&snapshot, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_6_0);
+    out << SnapshotMagic << SnapshotVersion << quint32(shown.size());
+    for (ChatOverlay *overlay : std::as_const(shown))
+    {
+        out << serialized.value(overlay);
+    }
+
+    QString target = path;
+    writer.start([target, snapshot]()
+                 {
+                     QSaveFile file(target);
+                     if (file.open(QIODevice::WriteOnly))
+                     {
+                         file.write(snapshot);
+                         file.commit();
+                     }
+                 });
+}
+
+int SessionStore::restore()
+{
+    QElapsedTimer timer;
+    timer.start();
+    TranscriptStore::instance(); // start indexing earlier sessions in the background
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        return 0;
+    }
+    QDataStream in(file.readAll());
+    in.setVersion(QDataStream::Qt_6_0);
+    quint32 magic, version, count;
+    in >> magic >> version >> count;
+    if (magic != SnapshotMagic || version != SnapshotVersion)
+    {
+        return 0;
+    }
+
+    restoring = true;
+    int restored = 0;
+    for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i)
+    {
+        QByteArray blob;
+        in >> blob;
+        QDataStream overlayIn(blob);
+        overlayIn.setVersion(QDataStream::Qt_6_0);
+        OverlayState state;
+        overlayIn >> state;
+        if (overlayIn.status() != QDataStream::Ok || !state.visible)
+        {
+            continue; // hidden ones are from snapshots written before they were left out
+        }
+        ChatOverlay *overlay = new ChatOverlay();
+        overlay->restoreSession(state);
+        serialized.insert(overlay, blob);
+        ++restored;
+    }
+    restoring = false;
+
+    Stats::instance()->set("session.restore_us", timer.nsecsElapsed() / 1000);
+    Stats::instance()->set("session.restored_overlays", restored);
+    return restored;
+}
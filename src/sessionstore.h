@@ -0,0 +1,62 @@
+#ifndef SESSIONSTORE_H
+#define SESSIONSTORE_H
+
+#include <QObject>
+#include <QHash>
+#include <QList>
+#include <QRect>
+#include <QSet>
+#include <QThreadPool>
+#include "transcriptstore.h"
+
+class ChatOverlay;
+class QTimer;
+
+// What a restart needs to bring an overlay back without replaying its history:
+// where it was, what was visible, and the most recent messages already decoded.
+struct OverlayState
+{
+    QUuid conversation;
+    QRect geometry;
+    bool visible = false;
+    int scrollValue = 0;
+    int totalMessages = 0;
+    QList<ChatMessage> recent; // the tail of the conversation; older ones load lazily
+};
+
+QDataStream &operator<<(QDataStream &out, const OverlayState &state);
+QDataStream &operator>>(QDataStream &in, OverlayState &state);
+
+// Keeps a compact binary snapshot of the overlays on screen. Overlays report
+// changes with markDirty(); only those are re-serialized, and the file is
+// rewritten on a background thread at most every couple of seconds.
+class SessionStore : public QObject
+{
+    Q_OBJECT
+
+public:
+    static SessionStore *instance();
+    ~SessionStore() override;
+
+    void track(ChatOverlay *overlay);
+    void markDirty(ChatOverlay *overlay);
+
+    // Recreates the overlays of the last snapshot; returns how many
+    int restore();
+
+private slots:
+    void writeSnapshot();
+
+private:
+    explicit SessionStore(QObject *parent = nullptr);
+
+    QString path;
+    QList<ChatOverlay *> overlays;
+    QHash<ChatOverlay *, QByteArray> serialized;
+    QSet<ChatOverlay *> dirty;
+    QTimer *writeTimer;
+    QThreadPool writer;
+    bool restoring = false;
+};
+
+#endif // SESSIONSTORE_H
@@ -0,0 +1,62 @@
+#include "stats.h"
+#include "alloctracker.h"
+#include <QCoreApplication>
+#include <QFile>
+
+Stats *Stats::instance()
+{
+    static Stats *stats = new Stats(qApp);
+    return stats;
+}
+
+Stats::Stats(QObject *parent) : QObject(parent)
+{
+    QString path = qEnvironmentVariable("D0_STATS_FILE");
+    if (!path.isEmpty())
+    {
+        connect(qApp, &QCoreApplication::aboutToQuit, this, [this, path]()
+                {
+                    AllocTracker::publish();
+                    QFile file(path);
+                    if (file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+                    {
+                        file.write(toText());
+                    }
+                });
+    }
+}
+
+void Stats::add(const QString &name, qint64 delta)
+{
+    QMutexLocker locker(&mutex);
+    values[name] += delta;
+}
+
+void Stats::set(const QString &name, qint64 value)
+{
+    QMutexLocker locker(&mutex);
+    values[name] = value;
+}
+
+qint64 Stats::value(const QString &name) const
+{
+    QMutexLocker locker(&mutex);
+    return values.value(name);
+}
+
+QMap<QString, qint64> Stats::snapshot() const
+{
+    QMutexLocker locker(&mutex);
+    return values;
+}
+
+QByteArray Stats::toText() const
+{
+    QByteArray text;
+    const QMap<QString, qint64> current = snapshot();
+    for (auto it = current.begin(); it != current.end(); ++it)
+    {
+        text += it.key().toUtf8() + ' ' + QByteArray::number(it.value()) + '\n';
+    }
+    return text;
+}
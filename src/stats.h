@@ -0,0 +1,32 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <QObject>
+#include <QMap>
+#include <QMutex>
+
+// Process-wide named counters and gauges, shown in the stats panel and
+// written to $D0_STATS_FILE on exit. Safe to update from any thread.
+class Stats : public QObject
+{
+    Q_OBJECT
+
+public:
+    static Stats *instance();
+
+    void add(const QString &name, qint64 delta = 1);
+    void set(const QString &name, qint64 value);
+    qint64 value(const QString &name) const;
+    QMap<QString, qint64> snapshot() const;
+
+    // One "name value" line per entry
+    QByteArray toText() const;
+
+private:
+    explicit Stats(QObject *parent = nullptr);
+
+    mutable QMutex mutex;
+    QMap<QString, qint64> values;
+};
+
+#endif // STATS_H
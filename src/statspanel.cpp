@@ -0,0 +1,41 @@
+#include "statspanel.h"
+#include "alloctracker.h"
+#include "stats.h"
+#include <QPlainTextEdit>
+#include <QTimer>
+#include <QFontDatabase>
+
+StatsPanel::StatsPanel(QWidget *parent)
+    : QDockWidget(tr("Stats"), parent), view(new QPlainTextEdit(this)), refreshTimer(new QTimer(this))
+{
+    setObjectName("statsPanel");
+    view->setReadOnly(true);
+    view->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+    setWidget(view);
+
+    refreshTimer->setTimerType(Qt::VeryCoarseTimer);
+    refreshTimer->setInterval(1000);
+    connect(refreshTimer, &QTimer::timeout, this, &StatsPanel::refresh);
+    connect(this, &QDockWidget::visibilityChanged, this, [this](bool visible)
+            {
+                if (visible)
+                {
+                    refresh();
+                    refreshTimer->start();
+                }
+                else
+                {
+                    refreshTimer->stop();
+                }
+            });
+}
+
+void StatsPanel::refresh()
+{
+    AllocTracker::publish();
+    QString text = QString::fromUtf8(Stats::instance()->toText());
+    if (text != view->toPlainText())
+    {
+        view->setPlainText(text);
+    }
+}
@@ -0,0 +1,25 @@
+#ifndef STATSPANEL_H
+#define STATSPANEL_H
+
+#include <QDockWidget>
+
+class QPlainTextEdit;
+class QTimer;
+
+// Dock showing the Stats counters; refreshes only while visible
+class StatsPanel : public QDockWidget
+{
+    Q_OBJECT
+
+public:
+    explicit StatsPanel(QWidget *parent = nullptr);
+
+private slots:
+    void refresh();
+
+private:
+    QPlainTextEdit *view;
+    QTimer *refreshTimer;
+};
+
+#endif // STATSPANEL_H
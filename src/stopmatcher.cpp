@@ -0,0 +1,124 @@
+#include "stopmatcher.h"
+#include <QQueue>
+#include <algorithm>
+#include <utility>
+
+StopMatcher::StopMatcher(const QStringList &patterns)
+{
+    nodes.append(Node());
+    for (const QString &pattern : patterns)
+    {
+        int node = 0;
+        for (QChar c : pattern)
+        {
+            int child = nodes[node].next.value(c.unicode(), -1);
+            if (child < 0)
+            {
+                child = nodes.size();
+                nodes.append(Node());
+                nodes[child].depth = nodes[node].depth + 1;
+                nodes[node].next.insert(c.unicode(), child);
+            }
+            node = child;
+        }
+        if (node != 0)
+        {
+            nodes[node].matchLength = pattern.size();
+        }
+    }
+
+    // Breadth first, so every fail target is finished before it is used
+    QQueue<int> queue;
+    for (int child : std::as_const(nodes[0].next))
+    {
+        queue.enqueue(child);
+    }
+    while (!queue.isEmpty())
+    {
+        int node = queue.dequeue();
+        for (auto it = nodes[node].next.cbegin(); it != nodes[node].next.cend(); ++it)
+        {
+            int child = it.value();
+            int fail = nodes[node].fail;
+            while (fail != 0 && !nodes[fail].next.contains(it.key()))
+            {
+                fail = nodes[fail].fail;
+            }
+            int target = nodes[fail].next.value(it.key(), 0);
+            nodes[child].fail = target == child ? 0 : target;
+            nodes[child].matchLength = std::max(nodes[child].matchLength, nodes[nodes[child].fail].matchLength);
+            queue.enqueue(child);
+        }
+    }
+}
+
+qsizetype StopMatcher::feed(QStringView text)
+{
+    for (qsizetype i = 0; i < text.size(); ++i)
+    {
+        char16_t c = text[i].unicode();
+        while (state != 0 && !nodes[state].next.contains(c))
+        {
+            state = nodes[state].fail;
+        }
+        state = nodes[state].next.value(c, 0);
+        if (nodes[state].matchLength > 0)
+        {
+            qsizetype end = consumed + i + 1;
+            consumed += text.size();
+            return end - nodes[state].matchLength;
+        }
+    }
+    consumed += text.size();
+    return -1;
+}
+
+RepetitionDetector::RepetitionDetector()
+{
+    std::fill(std::begin(recent), std::end(recent), 0);
+    std::fill(std::begin(words), std::end(words), 0);
+    std::fill(std::begin(runs), std::end(runs), 0);
+    for (int period = 0; period <= MaxPeriod; ++period)
+    {
+        // run + period characters are run / period + 1 copies of the last period characters
+        needed[period] = std::max(Repeats * period, MinChars) - period;
+    }
+}
+
+qsizetype RepetitionDetector::feed(QStringView text)
+{
+    for (QChar qc : text)
+    {
+        char16_t c = qc.unicode();
+        qsizetype index = consumed++;
+        int slot = int(index & RingMask);
+        qsizetype wordsSoFar = words[slot] + (qc.isLetterOrNumber() ? 1 : 0);
+        words[consumed & RingMask] = wordsSoFar;
+
+        // recent runs backwards, so back[period] is the character period
+        // positions earlier and the loop below vectorizes
+        int reversed = RingMask - slot;
+        const char16_t *back = recent + reversed;
+        int seen = int(std::min<qsizetype>(index, MaxPeriod));
+        int reached = 0;
+        for (int period = MinPeriod; period <= MaxPeriod; ++period)
+        {
+            int same = (back[period] == c) & (period <= seen);
+            runs[period] = (runs[period] + 1) * same;
+            reached |= runs[period] >= needed[period];
+        }
+        recent[reversed] = recent[reversed + RingSize] = c;
+        if (!reached)
+        {
+            continue;
+        }
+        for (int period = MinPeriod; period <= MaxPeriod; ++period)
+        {
+            if (runs[period] >= needed[period] && wordsSoFar - words[(consumed - period) & RingMask] > 0)
+            {
+                return consumed - runs[period];
+            }
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,71 @@
+#ifndef STOPMATCHER_H
+#define STOPMATCHER_H
+
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+// Finds the first occurrence of any of several literal stop strings in text
+// that arrives in pieces (Aho-Corasick). The automaton state carries over
+// between pieces, so a stop string split across two chunks is found, and
+// each character is looked at once however many strings there are.
+class StopMatcher
+{
+public:
+    explicit StopMatcher(const QStringList &patterns);
+
+    bool isEmpty() const { return nodes.size() == 1; }
+
+    // Feeds the next piece. Returns where the first match starts, counted
+    // from the start of everything fed, or -1.
+    qsizetype feed(QStringView text);
+    // Trailing characters that may be the start of a stop string; a caller
+    // holds them back until the next piece decides
+    int pending() const { return nodes.at(state).depth; }
+
+private:
+    struct Node
+    {
+        QHash<char16_t, int> next;
+        int fail = 0;
+        int depth = 0;
+        int matchLength = 0; // longest pattern ending here, own or via fail links
+    };
+
+    QVector<Node> nodes;
+    int state = 0;
+    qsizetype consumed = 0;
+};
+
+// Notices a reply stuck in a loop: the same passage (8 to 200 characters,
+// with at least one letter or digit) at least Repeats times in a row,
+// covering at least MinChars. Each character is compared with the one a
+// period earlier for every period, so the cost per character is fixed.
+class RepetitionDetector
+{
+public:
+    static const int MinPeriod = 8;
+    static const int MaxPeriod = 200;
+    static const int Repeats = 4;
+    static const int MinChars = 160;
+
+    RepetitionDetector();
+
+    // Feeds the next piece. Returns where the first repeat of the looping
+    // passage starts (so everything before it is one copy), or -1. Nothing
+    // more should be fed after a hit.
+    qsizetype feed(QStringView text);
+
+private:
+    static const int RingSize = 256; // more than MaxPeriod
+    static const int RingMask = RingSize - 1;
+
+    char16_t recent[2 * RingSize]; // every character twice, so the last RingSize are contiguous
+    qsizetype words[RingSize];     // letters and digits seen, by position
+    int runs[MaxPeriod + 1];       // per period: characters equal to the one a period earlier
+    int needed[MaxPeriod + 1];     // run length at which a period counts as looping
+    qsizetype consumed = 0;
+};
+
+#endif // STOPMATCHER_H
@@ -0,0 +1,558 @@
+#ifndef TASK_H
+#define TASK_H
+
+#include <QCoreApplication>
+#include <QNetworkReply>
+#include <QObject>
+#include <QPointer>
+#include <QThreadPool>
+#include <coroutine>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+// Coroutine tasks for the request pipeline. A Task is lazy: it runs when it
+// is awaited by another task or started with start(). Tasks and their
+// awaitables live on the GUI thread; work sent to runInPool() resumes there.
+//
+//     Task<QString> summarize(QNetworkAccessManager *manager, QNetworkRequest request)
+//     {
+//         QNetworkReply *reply = co_await awaitReply(manager->get(request));
+//         QByteArray body = reply->readAll();
+//         reply->deleteLater();
+//         co_return co_await runInPool([body]() { return parse(body); });
+//     }
+//
+// Cancelling the token a task was started with aborts the reply or wakes
+// the signal it is waiting on, and the next co_await throws TaskCancelled.
+// Tasks awaited by a task share its token.
+
+class TaskCancelled : public std::exception
+{
+public:
+    const char *what() const noexcept override { return "task cancelled"; }
+};
+
+class CancellationToken
+{
+public:
+    // Intrusive, so waiting for cancellation never allocates
+    struct Registration
+    {
+        void (*callback)(void *context) = nullptr;
+        void *context = nullptr;
+        Registration *next = nullptr;
+        Registration *previous = nullptr;
+    };
+
+    bool isCancelled() const { return state && state->cancelled; }
+    bool canBeCancelled() const { return bool(state); }
+
+    void subscribe(Registration *registration) const
+    {
+        if (!state)
+        {
+            return;
+        }
+        registration->previous = nullptr;
+        registration->next = state->head;
+        if (state->head)
+        {
+            state->head->previous = registration;
+        }
+        state->head = registration;
+    }
+
+    void unsubscribe(Registration *registration) const
+    {
+        if (!state || (!registration->previous && state->head != registration))
+        {
+            return; // not subscribed
+        }
+        if (registration->previous)
+        {
+            registration->previous->next = registration->next;
+        }
+        else
+        {
+            state->head = registration->next;
+        }
+        if (registration->next)
+        {
+            registration->next->previous = registration->previous;
+        }
+        registration->next = registration->previous = nullptr;
+    }
+
+private:
+    friend class CancellationSource;
+    struct State
+    {
+        bool cancelled = false;
+        Registration *head = nullptr;
+    };
+    std::shared_ptr<State> state;
+};
+
+class CancellationSource
+{
+public:
+    CancellationSource() { token_.state = std::make_shared<CancellationToken::State>(); }
+
+    CancellationToken token() const { return token_; }
+    bool isCancelled() const { return token_.isCancelled(); }
+
+    void cancel()
+    {
+        auto &state = *token_.state;
+        if (state.cancelled)
+        {
+            return;
+        }
+        state.cancelled = true;
+        // Callbacks may resume coroutines that unsubscribe others, so pop before calling
+        while (CancellationToken::Registration *registration = state.head)
+        {
+            token_.unsubscribe(registration);
+            registration->callback(registration->context);
+        }
+    }
+
+private:
+    CancellationToken token_;
+};
+
+template <typename T = void>
+class Task;
+
+namespace TaskDetail
+{
+    // Coroutine frames are recycled per thread by size class, so a pipeline
+    // that runs thousands of times does not go back to the heap for each step
+    struct FramePool
+    {
+        static constexpr std::size_t Granularity = 64;
+        static constexpr std::size_t Classes = 16; // frames up to 1 KB
+        static constexpr int MaxCached = 64;
+
+        void *freeLists[Classes] = {};
+        int cached[Classes] = {};
+
+        ~FramePool()
+        {
+            for (void *head : freeLists)
+            {
+                while (head)
+                {
+                    void *next = *static_cast<void **>(head);
+                    ::operator delete(head);
+                    head = next;
+                }
+            }
+        }
+    };
+
+    inline thread_local FramePool framePool;
+
+    inline void *allocateFrame(std::size_t size)
+    {
+        std::size_t sizeClass = (size + FramePool::Granularity - 1) / FramePool::Granularity - 1;
+        if (sizeClass >= FramePool::Classes)
+        {
+            return ::operator new(size);
+        }
+        if (void *frame = framePool.freeLists[sizeClass])
+        {
+            framePool.freeLists[sizeClass] = *static_cast<void **>(frame);
+            --framePool.cached[sizeClass];
+            return frame;
+        }
+        return ::operator new((sizeClass + 1) * FramePool::Granularity);
+    }
+
+    inline void freeFrame(void *frame, std::size_t size)
+    {
+        std::size_t sizeClass = (size + FramePool::Granularity - 1) / FramePool::Granularity - 1;
+        if (sizeClass >= FramePool::Classes || framePool.cached[sizeClass] >= FramePool::MaxCached)
+        {
+            ::operator delete(frame);
+            return;
+        }
+        *static_cast<void **>(frame) = framePool.freeLists[sizeClass];
+        framePool.freeLists[sizeClass] = frame;
+        ++framePool.cached[sizeClass];
+    }
+
+    struct PromiseBase
+    {
+        std::coroutine_handle<> continuation;
+        std::exception_ptr exception;
+        CancellationToken token;
+        bool detached = false;
+
+        static void *operator new(std::size_t size) { return allocateFrame(size); }
+        static void operator delete(void *frame, std::size_t size) { freeFrame(frame, size); }
+
+        std::suspend_always initial_suspend() noexcept { return {}; }
+
+        struct FinalAwaiter
+        {
+            bool await_ready() noexcept { return false; }
+
+            template <typename Promise>
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+            {
+                PromiseBase &promise = handle.promise();
+                if (promise.continuation)
+                {
+                    return promise.continuation; // symmetric transfer, no stack growth
+                }
+                if (promise.detached)
+                {
+                    handle.destroy();
+                }
+                return std::noop_coroutine();
+            }
+
+            void await_resume() noexcept {}
+        };
+
+        FinalAwaiter final_suspend() noexcept { return {}; }
+        void unhandled_exception() { exception = std::current_exception(); }
+
+        // Every co_await in a task first checks for cancellation, and awaitables
+        // that can be interrupted get the task's token
+        template <typename Awaitable>
+        Awaitable &&await_transform(Awaitable &&awaitable)
+        {
+            if (token.isCancelled())
+            {
+                throw TaskCancelled();
+            }
+            if constexpr (requires { awaitable.bindToken(token); })
+            {
+                awaitable.bindToken(token);
+            }
+            return std::forward<Awaitable>(awaitable);
+        }
+    };
+
+    template <typename T>
+    struct Promise : PromiseBase
+    {
+        std::optional<T> value;
+
+        Task<T> get_return_object();
+
+        template <typename U>
+        void return_value(U &&result)
+        {
+            value.emplace(std::forward<U>(result));
+        }
+    };
+
+    template <>
+    struct Promise<void> : PromiseBase
+    {
+        Task<void> get_return_object();
+        void return_void() {}
+    };
+}
+
+template <typename T>
+class [[nodiscard]] Task
+{
+public:
+    using promise_type = TaskDetail::Promise<T>;
+    using Handle = std::coroutine_handle<promise_type>;
+
+    explicit Task(Handle handle) : handle(handle) {}
+    Task(Task &&other) noexcept : handle(std::exchange(other.handle, {})) {}
+    Task &operator=(Task &&other) noexcept
+    {
+        if (this != &other)
+        {
+            if (handle)
+            {
+                handle.destroy();
+            }
+            handle = std::exchange(other.handle, {});
+        }
+        return *this;
+    }
+    Task(const Task &) = delete;
+    Task &operator=(const Task &) = delete;
+    ~Task()
+    {
+        if (handle)
+        {
+            handle.destroy();
+        }
+    }
+
+    // Called by the awaiting task, so a child is cancelled with its parent
+    void bindToken(const CancellationToken &token)
+    {
+        if (handle)
+        {
+            handle.promise().token = token;
+        }
+    }
+
+    auto operator co_await() && noexcept
+    {
+        struct Awaiter
+        {
+            Handle handle;
+
+            bool await_ready() const noexcept { return !handle || handle.done(); }
+
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> parent) noexcept
+            {
+                handle.promise().continuation = parent;
+                return handle;
+            }
+
+            T await_resume()
+            {
+                promise_type &promise = handle.promise();
+                if (promise.exception)
+                {
+                    std::rethrow_exception(promise.exception);
+                }
+                if constexpr (!std::is_void_v<T>)
+                {
+                    return std::move(*promise.value);
+                }
+            }
+        };
+        return Awaiter{handle};
+    }
+
+    // Runs a top-level task; its frame frees itself when it completes.
+    // An exception escaping a started task is dropped.
+    void start(const CancellationToken &token = CancellationToken()) &&
+    {
+        Handle started = std::exchange(handle, {});
+        started.promise().token = token;
+        started.promise().detached = true;
+        started.resume();
+    }
+
+private:
+    Handle handle;
+};
+
+namespace TaskDetail
+{
+    template <typename T>
+    Task<T> Promise<T>::get_return_object()
+    {
+        return Task<T>(std::coroutine_handle<Promise<T>>::from_promise(*this));
+    }
+
+    inline Task<void> Promise<void>::get_return_object()
+    {
+        return Task<void>(std::coroutine_handle<Promise<void>>::from_promise(*this));
+    }
+}
+
+// Resumes when the reply finishes. Cancellation aborts the reply.
+class ReplyAwaiter
+{
+public:
+    explicit ReplyAwaiter(QNetworkReply *reply) : reply(reply) {}
+
+    void bindToken(const CancellationToken &cancellation) { token = cancellation; }
+    bool await_ready() const { return reply->isFinished(); }
+
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        registration.callback = [](void *context)
+        { static_cast<QNetworkReply *>(context)->abort(); };
+        registration.context = reply;
+        token.subscribe(&registration);
+        QObject::connect(reply, &QNetworkReply::finished, reply, [this, handle]()
+                         {
+                             token.unsubscribe(&registration);
+                             handle.resume();
+                         }, Qt::SingleShotConnection);
+    }
+
+    QNetworkReply *await_resume()
+    {
+        if (token.isCancelled())
+        {
+            throw TaskCancelled();
+        }
+        return reply;
+    }
+
+private:
+    QNetworkReply *reply;
+    CancellationToken token;
+    CancellationToken::Registration registration;
+};
+
+inline ReplyAwaiter awaitReply(QNetworkReply *reply)
+{
+    return ReplyAwaiter(reply);
+}
+
+// Resumes the next time sender emits signal; the arguments are dropped.
+// Cancellation stops waiting.
+template <typename Sender, typename Signal>
+class SignalAwaiter
+{
+public:
+    SignalAwaiter(Sender *sender, Signal signal) : sender(sender), signal(signal) {}
+
+    void bindToken(const CancellationToken &cancellation) { token = cancellation; }
+    bool await_ready() const { return !sender; }
+
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        this->handle = handle;
+        registration.callback = [](void *context)
+        {
+            SignalAwaiter *awaiter = static_cast<SignalAwaiter *>(context);
+            QObject::disconnect(awaiter->connection);
+            awaiter->handle.resume();
+        };
+        registration.context = this;
+        token.subscribe(&registration);
+        connection = QObject::connect(sender.data(), signal, sender.data(), [this]()
+                                      {
+                                          token.unsubscribe(&registration);
+                                          this->handle.resume();
+                                      }, Qt::SingleShotConnection);
+    }
+
+    void await_resume()
+    {
+        if (token.isCancelled())
+        {
+            throw TaskCancelled();
+        }
+    }
+
+private:
+    QPointer<Sender> sender;
+    Signal signal;
+    std::coroutine_handle<> handle;
+    QMetaObject::Connection connection;
+    CancellationToken token;
+    CancellationToken::Registration registration;
+};
+
+template <typename Sender, typename Signal>
+SignalAwaiter<Sender, Signal> awaitSignal(Sender *sender, Signal signal)
+{
+    return SignalAwaiter<Sender, Signal>(sender, signal);
+}
+
+// Runs function on a pool thread and resumes on the GUI thread with its result.
+// Cancellation resumes at once without waiting for function; whatever it
+// returns later is dropped.
+template <typename Function>
+class PoolAwaiter
+{
+public:
+    using Result = std::invoke_result_t<Function>;
+
+    PoolAwaiter(Function function, QThreadPool *pool)
+        : shared(std::make_shared<Shared>(std::move(function))), pool(pool)
+    {
+    }
+
+    void bindToken(const CancellationToken &cancellation) { token = cancellation; }
+    bool await_ready() const noexcept { return false; }
+
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        // The pool job only touches shared: after a cancel this awaiter and
+        // its coroutine may be gone by the time the job finishes
+        shared->handle = handle;
+        shared->registration.callback = [](void *context)
+        {
+            Shared *state = static_cast<Shared *>(context);
+            state->resumed = true;
+            state->handle.resume();
+        };
+        shared->registration.context = shared.get();
+        token.subscribe(&shared->registration);
+        CancellationToken cancellation = token;
+        pool->start([state = shared, cancellation]()
+                    {
+                        try
+                        {
+                            if constexpr (std::is_void_v<Result>)
+                            {
+                                state->function();
+                            }
+                            else
+                            {
+                                state->result.emplace(state->function());
+                            }
+                        }
+                        catch (...)
+                        {
+                            state->exception = std::current_exception();
+                        }
+                        QMetaObject::invokeMethod(qApp, [state, cancellation]()
+                                                  {
+                                                      if (!state->resumed)
+                                                      {
+                                                          state->resumed = true;
+                                                          cancellation.unsubscribe(&state->registration);
+                                                          state->handle.resume();
+                                                      }
+                                                  }, Qt::QueuedConnection);
+                    });
+    }
+
+    Result await_resume()
+    {
+        if (token.isCancelled())
+        {
+            throw TaskCancelled();
+        }
+        if (shared->exception)
+        {
+            std::rethrow_exception(shared->exception);
+        }
+        if constexpr (!std::is_void_v<Result>)
+        {
+            return std::move(*shared->result);
+        }
+    }
+
+private:
+    using Storage = std::conditional_t<std::is_void_v<Result>, bool, std::optional<Result>>;
+
+    struct Shared
+    {
+        explicit Shared(Function function) : function(std::move(function)) {}
+
+        Function function;
+        Storage result{};
+        std::exception_ptr exception;
+        std::coroutine_handle<> handle;
+        CancellationToken::Registration registration;
+        bool resumed = false; // GUI thread only
+    };
+
+    std::shared_ptr<Shared> shared;
+    QThreadPool *pool;
+    CancellationToken token;
+};
+
+template <typename Function>
+PoolAwaiter<std::decay_t<Function>> runInPool(Function &&function, QThreadPool *pool = QThreadPool::globalInstance())
+{
+    return PoolAwaiter<std::decay_t<Function>>(std::forward<Function>(function), pool);
+}
+
+#endif // TASK_H
@@ -0,0 +1,101 @@
+#include <QtTest/QtTest>
+#include <QTemporaryDir>
+#include <cstdio>
+#include "asynclog.h"
+
+// Cost of one log call on the calling thread: AsyncLog against qDebug with a
+// handler that only formats and writes to /dev/null. Calls come in bursts
+// that fit a ring, with a pause for the writer in between, so the numbers are
+// for the hot path and not for drops.
+class BenchAsyncLog : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void asyncLog();
+    void qDebugToNull();
+    void cleanupTestCase();
+};
+
+static const int Bursts = 200;
+static const int BurstSize = 1000;
+static QTemporaryDir *dir = nullptr;
+static FILE *null = nullptr;
+
+static void nullHandler(QtMsgType, const QMessageLogContext &, const QString &message)
+{
+    QByteArray line = message.toLocal8Bit() + '\n';
+    fwrite(line.constData(), 1, size_t(line.size()), null);
+}
+
+void BenchAsyncLog::initTestCase()
+{
+    dir = new QTemporaryDir;
+    qputenv("D0_LOG_FILE", dir->filePath("bench.log").toLocal8Bit());
+    qputenv("D0_LOG_STDERR", "0");
+    null = fopen("/dev/null", "w");
+    QVERIFY(null);
+}
+
+void BenchAsyncLog::asyncLog()
+{
+    AsyncLog::debug("warm up"); // creates the ring and the writer
+    qint64 nanos = 0;
+    for (int burst = 0; burst < Bursts; ++burst)
+    {
+        QElapsedTimer timer;
+        timer.start();
+        for (int i = 0; i < BurstSize; ++i)
+        {
+            AsyncLog::debug("key {} modifiers {} at {} ms", i, 0x0a000000, 12.5);
+        }
+        nanos += timer.nsecsElapsed();
+        QThread::msleep(20);
+    }
+    double perCall = double(nanos) / (Bursts * BurstSize);
+    qDebug() << "AsyncLog:" << perCall << "ns per call";
+    QCOMPARE(AsyncLog::dropped(), qint64(0));
+    QVERIFY(perCall < 200);
+}
+
+void BenchAsyncLog::qDebugToNull()
+{
+    QtMessageHandler previous = qInstallMessageHandler(nullHandler);
+    qint64 nanos = 0;
+    for (int burst = 0; burst < Bursts; ++burst)
+    {
+        QElapsedTimer timer;
+        timer.start();
+        for (int i = 0; i < BurstSize; ++i)
+        {
+            qDebug() << "key" << i << "modifiers" << 0x0a000000 << "at" << 12.5 << "ms";
+        }
+        nanos += timer.nsecsElapsed();
+    }
+    qInstallMessageHandler(previous);
+    qDebug() << "qDebug to /dev/null:" << double(nanos) / (Bursts * BurstSize) << "ns per call";
+}
+
+void BenchAsyncLog::cleanupTestCase()
+{
+    AsyncLog::shutdown();
+    // About 16 MB of lines, so the log has rotated on the way
+    qsizetype lines = 0;
+    for (const QString &name : {"bench.log", "bench.log.1", "bench.log.2", "bench.log.3"})
+    {
+        QFile log(dir->filePath(name));
+        if (log.open(QIODevice::ReadOnly))
+        {
+            lines += log.readAll().count('\n');
+        }
+    }
+    QCOMPARE(lines, qsizetype(1 + Bursts * BurstSize));
+    QFile log(dir->filePath("bench.log"));
+    QVERIFY(log.open(QIODevice::ReadOnly));
+    QVERIFY(log.readAll().contains("key 999 modifiers 167772160 at 12.5 ms"));
+    fclose(null);
+}
+
+QTEST_MAIN(BenchAsyncLog)
+#include "benchasynclog.moc"
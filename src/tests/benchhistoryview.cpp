@@ -0,0 +1,82 @@
+#include <QtTest/QtTest>
+#include <QRandomGenerator>
+#include <QScrollArea>
+#include <QScrollBar>
+#include "historyview.h"
+
+// Frame times while flinging through 100k history rows, first with a cold
+// row cache and then once the rows have been rasterized
+class BenchHistoryView : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void fastScrollFrames();
+    void cleanupTestCase();
+
+private:
+    QScrollArea *area = nullptr;
+    HistoryView *view = nullptr;
+};
+
+static const int Messages = 100000;
+
+void BenchHistoryView::initTestCase()
+{
+    area = new QScrollArea;
+    area->resize(420, 640);
+    view = new HistoryView;
+    area->setWidget(view);
+    area->setWidgetResizable(true);
+    area->show();
+    QVERIFY(QTest::qWaitForWindowExposed(area));
+
+    QRandomGenerator random(7);
+    QList<ChatMessage> messages;
+    for (int i = 0; i < Messages; ++i)
+    {
+        ChatMessage message;
+        message.id = quint64(i + 1);
+        message.role = i % 2 ? "assistant" : "user";
+        message.text = QString("message %1 ").arg(i).repeated(1 + random.bounded(12));
+        messages.append(message);
+    }
+    QElapsedTimer timer;
+    timer.start();
+    view->prependMessages(messages);
+    qDebug() << "laid out" << Messages << "rows in" << timer.elapsed() << "ms";
+    QTRY_VERIFY(area->verticalScrollBar()->maximum() > 0);
+}
+
+void BenchHistoryView::fastScrollFrames()
+{
+    QScrollBar *bar = area->verticalScrollBar();
+    // Roughly a flick per frame: two viewports per step, the whole history
+    int step = area->viewport()->height() * 2;
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        QVector<double> frames;
+        for (int value = 0; value < bar->maximum() && frames.size() < 4000; value += step)
+        {
+            bar->setValue(value);
+            QElapsedTimer timer;
+            timer.start();
+            area->viewport()->repaint();
+            frames.append(timer.nsecsElapsed() / 1e6);
+        }
+        std::sort(frames.begin(), frames.end());
+        double p95 = frames.at(int(frames.size() * 0.95));
+        qDebug() << (pass ? "warm" : "cold") << frames.size() << "frames, p50" << frames.at(frames.size() / 2)
+                 << "ms, p95" << p95 << "ms, max" << frames.last() << "ms, cache" << HistoryView::cacheBytes() / 1024 << "KB";
+        QVERIFY(p95 < 8);
+    }
+}
+
+void BenchHistoryView::cleanupTestCase()
+{
+    delete area;
+}
+
+QTEST_MAIN(BenchHistoryView)
+#include "benchhistoryview.moc"
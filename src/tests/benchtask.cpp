@@ -0,0 +1,140 @@
+#include <QtTest/QtTest>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include "alloctracker.h"
+#include "task.h"
+
+// Per-request overhead of the coroutine pipeline against the plain
+// signal/slot path. data: URLs complete asynchronously through the normal
+// QNetworkReply machinery without touching the network, so the difference
+// is the cost of the plumbing itself.
+class BenchTask : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void signalSlotRequests();
+    void coroutineRequests();
+    void signalSlotStages();
+    void coroutineStages();
+    void cleanupTestCase();
+};
+
+static const int Requests = 1000;
+static const QUrl DataUrl("data:text/plain,hello");
+
+void BenchTask::signalSlotRequests()
+{
+    QNetworkAccessManager manager;
+    QBENCHMARK
+    {
+        int remaining = Requests;
+        QEventLoop loop;
+        for (int i = 0; i < Requests; ++i)
+        {
+            QNetworkReply *reply = manager.get(QNetworkRequest(DataUrl));
+            connect(reply, &QNetworkReply::finished, &loop, [reply, &remaining, &loop]()
+                    {
+                        reply->readAll();
+                        reply->deleteLater();
+                        if (--remaining == 0)
+                        {
+                            loop.quit();
+                        }
+                    });
+        }
+        loop.exec();
+    }
+}
+
+static Task<> fetch(QNetworkAccessManager *manager, int *remaining, QEventLoop *loop)
+{
+    QNetworkReply *reply = co_await awaitReply(manager->get(QNetworkRequest(DataUrl)));
+    reply->readAll();
+    reply->deleteLater();
+    if (--*remaining == 0)
+    {
+        loop->quit();
+    }
+}
+
+void BenchTask::coroutineRequests()
+{
+    QNetworkAccessManager manager;
+    QBENCHMARK
+    {
+        int remaining = Requests;
+        QEventLoop loop;
+        for (int i = 0; i < Requests; ++i)
+        {
+            fetch(&manager, &remaining, &loop).start();
+        }
+        loop.exec();
+    }
+}
+
+// Four chained stages (retrieve, send, stream, render), each a queued hop
+class StageChain : public QObject
+{
+    Q_OBJECT
+
+public:
+    int value = 0;
+
+signals:
+    void retrieved();
+    void sent();
+    void streamed();
+    void rendered();
+};
+
+void BenchTask::signalSlotStages()
+{
+    StageChain chain;
+    QEventLoop loop;
+    connect(&chain, &StageChain::retrieved, &chain, [&chain]()
+            { ++chain.value; emit chain.sent(); }, Qt::QueuedConnection);
+    connect(&chain, &StageChain::sent, &chain, [&chain]()
+            { ++chain.value; emit chain.streamed(); }, Qt::QueuedConnection);
+    connect(&chain, &StageChain::streamed, &chain, [&chain]()
+            { ++chain.value; emit chain.rendered(); }, Qt::QueuedConnection);
+    connect(&chain, &StageChain::rendered, &loop, &QEventLoop::quit, Qt::QueuedConnection);
+    QBENCHMARK
+    {
+        emit chain.retrieved();
+        loop.exec();
+    }
+}
+
+static Task<int> stage(int value)
+{
+    co_return value + 1;
+}
+
+static Task<> pipeline(int *value, QEventLoop *loop)
+{
+    *value = co_await stage(co_await stage(co_await stage(*value)));
+    QMetaObject::invokeMethod(loop, &QEventLoop::quit, Qt::QueuedConnection);
+}
+
+void BenchTask::coroutineStages()
+{
+    int value = 0;
+    QEventLoop loop;
+    QBENCHMARK
+    {
+        pipeline(&value, &loop).start();
+        loop.exec();
+    }
+}
+
+void BenchTask::cleanupTestCase()
+{
+    if (AllocTracker::Enabled)
+    {
+        qDebug().noquote() << "Heap by subsystem:\n" + AllocTracker::summary();
+    }
+}
+
+QTEST_MAIN(BenchTask)
+#include "benchtask.moc"
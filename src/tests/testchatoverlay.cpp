@@ -1,21 +1,126 @@
-// Path: /path/to/project/tests/TestChatOverlay.cpp
-
 #include <QtTest/QtTest>
-#include "ChatOverlay.h"
+#include <QAbstractEventDispatcher>
+#include <QLabel>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTemporaryDir>
+#include "asynclog.h"
+#include "chatoverlay.h"
+#include "outboundqueue.h"
+#include "stats.h"
+#include "toolexecutor.h"
+
+// A completion endpoint on localhost. It answers every request with one
+// streamed reply, or, with holdOpen set, sends the headers and then keeps
+// the stream open without writing anything more.
+class MockChatServer : public QTcpServer
+{
+    Q_OBJECT
+
+public:
+    bool holdOpen = false;
+    qsizetype replyChars = 0; // 0: the short greeting
+    int requests = 0;
+
+    MockChatServer()
+    {
+        connect(this, &QTcpServer::newConnection, this, &MockChatServer::accept);
+    }
+
+private:
+    void accept()
+    {
+        while (QTcpSocket *socket = nextPendingConnection())
+        {
+            connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+            connect(socket, &QTcpSocket::readyRead, this, [this, socket]()
+                    {
+                        if (!socket->readAll().contains("\r\n\r\n") || socket->property("answered").toBool())
+                        {
+                            return; // the small requests here arrive in one piece
+                        }
+                        socket->setProperty("answered", true);
+                        ++requests;
+                        socket->write("HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nConnection: close\r\n\r\n");
+                        if (!holdOpen && replyChars > 0)
+                        {
+                            QByteArray event = "data: {\"choices\":[{\"text\":\"" + QByteArray(64 * 1024, 'x') + "\"}]}\n\n";
+                            for (qsizetype sent = 0; sent < replyChars; sent += 64 * 1024)
+                            {
+                                socket->write(event);
+                            }
+                            socket->write("data: [DONE]\n\n");
+                            socket->disconnectFromHost();
+                        }
+                        else if (!holdOpen)
+                        {
+                            socket->write("data: {\"choices\":[{\"text\":\"Hello from the mock\"}]}\n\n");
+                            socket->write("data: [DONE]\n\n");
+                            socket->disconnectFromHost();
+                        }
+                    });
+        }
+    }
+};
+
+// Times any thread of this process blocked, and so later woke up again
+static qint64 voluntarySwitches()
+{
+    qint64 total = 0;
+    const QStringList tasks = QDir("/proc/self/task").entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+    for (const QString &task : tasks)
+    {
+        QFile status("/proc/self/task/" + task + "/status");
+        if (!status.open(QIODevice::ReadOnly))
+        {
+            continue;
+        }
+        for (const QByteArray &line : status.readAll().split('\n'))
+        {
+            if (line.startsWith("voluntary_ctxt_switches:"))
+            {
+                total += line.mid(24).trimmed().toLongLong();
+            }
+        }
+    }
+    return total;
+}
 
 class TestChatOverlay : public QObject
 {
     Q_OBJECT
 
 private slots:
+    void initTestCase();
     void testUISetup();
     void testMessageSubmission();
     void testApiIntegration();
+    void testIdleWakeups();
+    void testDestroyedWhileSummarizing();
+    void testQueueDrainsWhileHidden();
 
 private:
     ChatOverlay *chatOverlay;
+    MockChatServer server;
+
+    void submit(const QString &message);
 };
 
+void TestChatOverlay::initTestCase()
+{
+    QStandardPaths::setTestModeEnabled(true);
+    qputenv("D0_RESPONSE_CACHE", "0");
+    QVERIFY(server.listen(QHostAddress::LocalHost));
+    ChatClient::instance()->setEndpoint(QUrl(QString("http://127.0.0.1:%1/v1/completions").arg(server.serverPort())));
+}
+
+void TestChatOverlay::submit(const QString &message)
+{
+    QLineEdit *inputField = chatOverlay->findChild<QLineEdit *>("inputField");
+    inputField->setText(message);
+    QTest::keyClick(inputField, Qt::Key_Return);
+}
+
 void TestChatOverlay::testUISetup()
 {
     chatOverlay = new ChatOverlay();
@@ -27,30 +132,125 @@ void TestChatOverlay::testUISetup()
 void TestChatOverlay::testMessageSubmission()
 {
     chatOverlay = new ChatOverlay();
-    QLineEdit *inputField = chatOverlay->findChild<QLineEdit *>("inputField");
     QVBoxLayout *chatLayout = chatOverlay->findChild<QVBoxLayout *>("chatLayout");
+    int rows = chatLayout->count();
 
-    QSignalSpy spy(chatOverlay, SIGNAL(onMessageSubmitted()));
-    inputField->setText("Hello, ChatGPT!");
-    QTest::keyPress(inputField, Qt::Key_Return);
+    submit("Hello, ChatGPT!");
 
-    QCOMPARE(spy.count(), 1);
-    QCOMPARE(chatLayout->count(), 2); // One for the input field, one for the user message
+    QCOMPARE(chatLayout->count(), rows + 1); // the user message; the reply comes later
+    QVERIFY(chatOverlay->findChild<QLineEdit *>("inputField")->text().isEmpty());
     delete chatOverlay;
 }
 
 void TestChatOverlay::testApiIntegration()
 {
+    server.holdOpen = false;
+    int requestsBefore = server.requests;
+    chatOverlay = new ChatOverlay();
+    chatOverlay->show();
+    QVERIFY(QTest::qWaitForWindowExposed(chatOverlay));
+
+    submit("Test message");
+
+    QTRY_COMPARE(server.requests, requestsBefore + 1);
+    auto replyShown = [this]()
+    {
+        const QList<QLabel *> labels = chatOverlay->findChildren<QLabel *>();
+        return std::any_of(labels.cbegin(), labels.cend(), [](QLabel *label)
+                           { return label->text() == "ChatGPT: Hello from the mock"; });
+    };
+    QTRY_VERIFY(replyShown());
+    delete chatOverlay;
+}
+
+void TestChatOverlay::testIdleWakeups()
+{
+    server.holdOpen = true; // a stream stays in flight, but nothing arrives on it
+    int requestsBefore = server.requests;
     chatOverlay = new ChatOverlay();
-    QNetworkAccessManager *networkManager = chatOverlay->findChild<QNetworkAccessManager *>("networkManager");
+    chatOverlay->show();
+    QVERIFY(QTest::qWaitForWindowExposed(chatOverlay));
+    submit("Test message");
+    QTRY_COMPARE(server.requests, requestsBefore + 1);
+    QTest::keyClick(chatOverlay, Qt::Key_Escape);
+    QVERIFY(chatOverlay->isHidden());
+    QVERIFY(chatOverlay->isIdle());
+    QTest::qWait(200); // let the hide settle
 
-    QSignalSpy spy(networkManager, SIGNAL(finished(QNetworkReply *)));
-    chatOverlay->sendMessageToChatGPT("Test message");
+    // Count how often the event dispatcher wakes up over one idle second,
+    // and how often any thread of the process does (the log writer, the
+    // network and journal threads). The single-shot timer that ends the
+    // loop accounts for one wakeup.
+    AsyncLog::info("idle wakeup test starts"); // the log writer is running
+    QTest::qWait(100);
+    qint64 switchesBefore = voluntarySwitches();
+    int wakeups = 0;
+    QAbstractEventDispatcher *dispatcher = QAbstractEventDispatcher::instance();
+    QMetaObject::Connection counter = connect(dispatcher, &QAbstractEventDispatcher::awake, [&wakeups]()
+                                              { ++wakeups; });
+    QEventLoop loop;
+    QTimer::singleShot(1000, &loop, &QEventLoop::quit);
+    loop.exec();
+    disconnect(counter);
+    qint64 processWakeups = voluntarySwitches() - switchesBefore;
 
-    QVERIFY(spy.wait(5000)); // Wait for the network reply
-    QCOMPARE(spy.count(), 1);
+    QVERIFY2(wakeups <= 5, qPrintable(QString("%1 GUI thread wakeups in an idle second").arg(wakeups)));
+    QVERIFY2(processWakeups <= 10, qPrintable(QString("%1 wakeups across all threads in an idle second").arg(processWakeups)));
     delete chatOverlay;
 }
 
+void TestChatOverlay::testDestroyedWhileSummarizing()
+{
+    QTemporaryDir dir;
+    QFile file(dir.filePath("server.log"));
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    for (int i = 0; i < 2000; ++i)
+    {
+        file.write("worker " + QByteArray::number(i) + " processed a request\n");
+    }
+    file.close();
+    ToolExecutor::setOpenFilePath(file.fileName());
+
+    server.holdOpen = true; // the summary stays waiting for its requests
+    int requestsBefore = server.requests;
+    chatOverlay = new ChatOverlay();
+    chatOverlay->show();
+    QVERIFY(QTest::qWaitForWindowExposed(chatOverlay));
+    submit("/summarize");
+    QTRY_VERIFY(server.requests > requestsBefore);
+
+    // The summarizer is cancelled while the overlay is being torn down; it
+    // must not report into the overlay's slots from there
+    delete chatOverlay;
+    QTest::qWait(100);
+    ToolExecutor::setOpenFilePath(QString());
+}
+
+void TestChatOverlay::testQueueDrainsWhileHidden()
+{
+    // Four hidden overlays take every slot of the outbound queue, and each
+    // reply is longer than a reader that never reads lets through
+    server.holdOpen = false;
+    server.replyChars = 2 * InFlightReply::MaxPendingChars;
+    qint64 deliveredBefore = Stats::instance()->value("outbound.delivered");
+    QList<ChatOverlay *> overlays;
+    for (int i = 0; i < 4; ++i)
+    {
+        overlays.append(new ChatOverlay());
+        QVERIFY(overlays.last()->isIdle()); // never shown
+        for (int j = 0; j < 2; ++j)
+        {
+            ChatRequest request;
+            request.conversation = overlays.last()->sessionState().conversation;
+            request.prompt = QString("queued %1.%2").arg(i).arg(j);
+            OutboundQueue::instance()->enqueue(request);
+        }
+    }
+
+    QTRY_COMPARE_WITH_TIMEOUT(Stats::instance()->value("outbound.delivered"), deliveredBefore + 8, 30000);
+    qDeleteAll(overlays);
+    server.replyChars = 0;
+}
+
 QTEST_MAIN(TestChatOverlay)
-#include "TestChatOverlay.moc"
+#include "testchatoverlay.moc"
@@ -0,0 +1,52 @@
+#include <QtTest/QtTest>
+#include <QLineEdit>
+#include <QTemporaryDir>
+#include "customapplication.h"
+#include "eventrecorder.h"
+
+// Needs CustomApplication::notify, so it has its own main instead of QTEST_MAIN
+static QTemporaryDir *dir = nullptr;
+
+class TestEventRecorder : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testRecordedTypingReplays();
+};
+
+void TestEventRecorder::testRecordedTypingReplays()
+{
+    QVERIFY(EventRecorder::instance());
+    QVERIFY(EventReplayer::instance());
+
+    QLineEdit edit;
+    edit.show();
+    QVERIFY(QTest::qWaitForWindowExposed(&edit));
+    // Window-level key clicks arrive as spontaneous events, like real input
+    QTest::keyClicks(edit.windowHandle(), "hello");
+    QCOMPARE(edit.text(), QString("hello"));
+
+    QFileInfo recording(dir->filePath("session.d0ev"));
+    QVERIFY(recording.size() > 5);
+    QVERIFY(recording.size() < 200); // ten key events plus one window definition
+
+    edit.clear();
+    EventReplayer::instance()->start();
+    QTRY_COMPARE(edit.text(), QString("hello"));
+}
+
+int main(int argc, char *argv[])
+{
+    QTemporaryDir temporary;
+    dir = &temporary;
+    qputenv("QT_QPA_PLATFORM", "offscreen");
+    qputenv("D0_RECORD_EVENTS", temporary.filePath("session.d0ev").toLocal8Bit());
+    qputenv("D0_REPLAY_EVENTS", temporary.filePath("session.d0ev").toLocal8Bit());
+    qputenv("D0_REPLAY_SPEED", "0");
+    CustomApplication app(argc, argv);
+    TestEventRecorder test;
+    return QTest::qExec(&test, argc, argv);
+}
+
+#include "testeventrecorder.moc"
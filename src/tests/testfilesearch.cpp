@@ -0,0 +1,56 @@
+#include <QtTest/QtTest>
+#include <QTemporaryFile>
+#include "filesearch.h"
+
+class TestFileSearch : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testRequiredLiteral();
+    void testFindsEveryMatchingLine();
+};
+
+void TestFileSearch::testRequiredLiteral()
+{
+    QCOMPARE(FileSearch::requiredLiteral("error: \\d+ items", false), QByteArray("error: "));
+    QCOMPARE(FileSearch::requiredLiteral("timeout(s)? after", false), QByteArray("timeout"));
+    QCOMPARE(FileSearch::requiredLiteral("colou?r", false), QByteArray("colo"));
+    QCOMPARE(FileSearch::requiredLiteral("foo\\.bar", false), QByteArray("foo.bar"));
+    QCOMPARE(FileSearch::requiredLiteral("Warn[A-Z]+", true), QByteArray("warn"));
+    QVERIFY(FileSearch::requiredLiteral("cat|dog", false).isEmpty());
+    QVERIFY(FileSearch::requiredLiteral("(?i)abc", false).isEmpty());
+
+    QCOMPARE(FileSearch::rarestByte("hello quiz"), 9); // 'z'
+}
+
+void TestFileSearch::testFindsEveryMatchingLine()
+{
+    QTemporaryFile file;
+    QVERIFY(file.open());
+    int expected = 0;
+    for (int i = 0; i < 200000; ++i)
+    {
+        bool match = i % 97 == 0;
+        expected += match;
+        file.write(QByteArray("line ") + QByteArray::number(i) + (match ? " Connection RESET by peer\n" : " ok\n"));
+    }
+    file.flush();
+
+    for (bool regex : {false, true})
+    {
+        FileSearch search;
+        QVector<SearchHit> hits;
+        connect(&search, &FileSearch::hitsFound, this, [&hits](const QVector<SearchHit> &found)
+                { hits += found; });
+        QSignalSpy finished(&search, &FileSearch::finished);
+        search.start(file.fileName(), regex ? "connection reset by \\w+" : "connection reset", regex, Qt::CaseInsensitive);
+        QVERIFY(finished.wait(10000));
+        QCOMPARE(hits.size(), expected);
+        QCOMPARE(finished.first().at(0).toLongLong(), qint64(expected));
+        QVERIFY(hits.first().text.endsWith("peer"));
+    }
+}
+
+QTEST_MAIN(TestFileSearch)
+#include "testfilesearch.moc"
@@ -0,0 +1,64 @@
+#include <QtTest/QtTest>
+#include "filesummarizer.h"
+
+class TestFileSummarizer : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testChunksCoverFileAtLineEnds();
+    void testEditChangesFewChunks();
+};
+
+static QByteArray sampleLog(int lines)
+{
+    QByteArray data;
+    for (int i = 0; i < lines; ++i)
+    {
+        data += "2024-05-01 12:00:" + QByteArray::number(i % 60) + " worker " + QByteArray::number(i * 7919 % 1000) +
+                " processed request " + QByteArray::number(i) + "\n";
+    }
+    return data;
+}
+
+static QList<QByteArray> chunkTexts(const QByteArray &data)
+{
+    QList<QByteArray> texts;
+    for (const FileSummarizer::Chunk &chunk : FileSummarizer::chunkBoundaries(data.constData(), data.size()))
+    {
+        texts.append(data.mid(chunk.offset, chunk.length));
+    }
+    return texts;
+}
+
+void TestFileSummarizer::testChunksCoverFileAtLineEnds()
+{
+    QByteArray data = sampleLog(20000);
+    QList<QByteArray> texts = chunkTexts(data);
+    QCOMPARE(texts.join(), data);
+    for (int i = 0; i + 1 < texts.size(); ++i)
+    {
+        QVERIFY(texts[i].endsWith('\n'));
+        QVERIFY(texts[i].size() <= FileSummarizer::ChunkBytes * 4 / 3);
+    }
+}
+
+void TestFileSummarizer::testEditChangesFewChunks()
+{
+    QByteArray before = sampleLog(20000);
+    QByteArray after = before;
+    after.insert(after.size() / 3, "an inserted line that shifts every later offset\n");
+
+    QList<QByteArray> old = chunkTexts(before);
+    QSet<QByteArray> known(old.begin(), old.end());
+    int changed = 0;
+    for (const QByteArray &text : chunkTexts(after))
+    {
+        changed += !known.contains(text);
+    }
+    qDebug() << old.size() << "chunks," << changed << "changed by the edit";
+    QVERIFY(changed <= 3);
+}
+
+QTEST_MAIN(TestFileSummarizer)
+#include "testfilesummarizer.moc"
@@ -0,0 +1,69 @@
+#include <QtTest/QtTest>
+#include <QTemporaryDir>
+#include "fileview.h"
+
+class TestFileView : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testIndexKeepsUpWithAppends();
+    void testFollowAppendTruncateRotate();
+};
+
+void TestFileView::testIndexKeepsUpWithAppends()
+{
+    // 256 MB of 100-byte lines must index well above the 100 MB/s ingest target
+    QByteArray line(99, 'x');
+    line += '\n';
+    QByteArray data = line.repeated(256 * 1024 * 1024 / line.size());
+    QVector<qint64> starts;
+    starts.reserve(data.size() / line.size());
+
+    QElapsedTimer timer;
+    timer.start();
+    FileView::indexLines(data.constData(), 0, data.size(), starts);
+    double seconds = timer.nsecsElapsed() / 1e9;
+
+    QCOMPARE(starts.size(), data.size() / line.size());
+    QCOMPARE(starts.first(), qint64(line.size()));
+    qDebug() << "line index:" << int(data.size() / 1e6 / seconds) << "MB/s";
+    QVERIFY(data.size() / 1e6 / seconds > 100);
+}
+
+void TestFileView::testFollowAppendTruncateRotate()
+{
+    QTemporaryDir dir;
+    QString path = dir.filePath("app.log");
+    QFile log(path);
+    QVERIFY(log.open(QIODevice::WriteOnly));
+    log.write("one\ntwo\n");
+    log.flush();
+
+    FileView view;
+    view.open(path);
+    view.setFollowing(true);
+    QTRY_COMPARE(view.lineCount(), qint64(2));
+
+    log.write("three\nfour");
+    log.flush();
+    QTRY_COMPARE(view.lineCount(), qint64(4));
+
+    log.resize(0);
+    log.seek(0);
+    log.write("fresh\n");
+    log.flush();
+    QTRY_COMPARE(view.lineCount(), qint64(1));
+
+    // Rotate: rename away, then start a new file under the old name
+    log.close();
+    QVERIFY(QFile::rename(path, path + ".1"));
+    QFile next(path);
+    QVERIFY(next.open(QIODevice::WriteOnly));
+    next.write("a\nb\nc\n");
+    next.flush();
+    QTRY_COMPARE(view.lineCount(), qint64(3));
+}
+
+QTEST_MAIN(TestFileView)
+#include "testfileview.moc"
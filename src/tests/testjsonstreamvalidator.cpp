@@ -0,0 +1,235 @@
+#include <QtTest/QtTest>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTemporaryDir>
+#include "chatclient.h"
+#include "jsonstreamvalidator.h"
+#include "responsecache.h"
+#include "stats.h"
+
+static QJsonObject issueSchema()
+{
+    QJsonObject tag{{"type", "string"}, {"enum", QJsonArray{"bug", "feature", "question"}}};
+    QJsonObject properties{
+        {"title", QJsonObject{{"type", "string"}, {"maxLength", 40}}},
+        {"priority", QJsonObject{{"type", "integer"}, {"minimum", 1}, {"maximum", 5}}},
+        {"tags", QJsonObject{{"type", "array"}, {"items", tag}, {"maxItems", 3}}},
+        {"done", QJsonObject{{"type", "boolean"}}},
+    };
+    return QJsonObject{{"type", "object"},
+                       {"properties", properties},
+                       {"required", QJsonArray{"title", "priority"}},
+                       {"additionalProperties", false}};
+}
+
+// Streams one reply per connection, a few characters per event. Each
+// connection takes the next reply from the list.
+class MockJsonServer : public QTcpServer
+{
+    Q_OBJECT
+
+public:
+    QStringList replies;
+    int connections = 0;
+    QList<int> charsSent; // per connection
+
+    MockJsonServer()
+    {
+        connect(this, &QTcpServer::newConnection, this, &MockJsonServer::accept);
+    }
+
+private:
+    void accept()
+    {
+        QTcpSocket *socket = nextPendingConnection();
+        int index = connections++;
+        charsSent.append(0);
+        connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+        connect(socket, &QTcpSocket::readyRead, this, [this, socket, index]()
+                {
+                    if (!socket->readAll().contains("\r\n\r\n") || socket->property("started").toBool())
+                    {
+                        return;
+                    }
+                    socket->setProperty("started", true);
+                    socket->write("HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nConnection: close\r\n\r\n");
+                    QTimer *timer = new QTimer(socket);
+                    connect(timer, &QTimer::timeout, socket, [this, socket, index, timer]()
+                            {
+                                QString reply = replies.value(index);
+                                int &sent = charsSent[index];
+                                if (sent >= reply.size())
+                                {
+                                    timer->stop();
+                                    socket->write("data: [DONE]\n\n");
+                                    socket->disconnectFromHost();
+                                    return;
+                                }
+                                QJsonObject choice{{"text", reply.mid(sent, 3)}};
+                                sent += 3;
+                                QJsonObject event{{"choices", QJsonArray{choice}}};
+                                socket->write("data: " + QJsonDocument(event).toJson(QJsonDocument::Compact) + "\n\n");
+                            });
+                    timer->start(2);
+                });
+    }
+};
+
+class TestJsonStreamValidator : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void testValidDocumentInPieces();
+    void testFailsAtFirstImpossibleCharacter_data();
+    void testFailsAtFirstImpossibleCharacter();
+    void testInvalidReplyIsRetried();
+    void testGivesUpAfterRetries();
+    void testRepeatedRequestStillValidates();
+};
+
+void TestJsonStreamValidator::initTestCase()
+{
+    qputenv("D0_RESPONSE_CACHE", "0");
+}
+
+void TestJsonStreamValidator::testValidDocumentInPieces()
+{
+    QString document = "{\"title\": \"Crash on \\u00e9 save\", \"priority\": 3, \"tags\": [\"bug\", \"feature\"], \"done\": false}";
+    JsonStreamValidator validator(issueSchema());
+    for (int i = 0; i < document.size(); i += 2)
+    {
+        QVERIFY2(validator.feed(QStringView(document).mid(i, 2)), qPrintable(validator.error()));
+    }
+    QVERIFY(validator.finish());
+
+    const QList<JsonField> &fields = validator.fields();
+    QCOMPARE(fields.size(), 5);
+    QCOMPARE(fields.at(0).path, QString("title"));
+    QCOMPARE(fields.at(0).value.toString(), QString("Crash on é save"));
+    QCOMPARE(fields.at(1).value.toInt(), 3);
+    QCOMPARE(fields.at(3).path, QString("tags[1]"));
+    QVERIFY(fields.at(4).value == QJsonValue(false));
+}
+
+void TestJsonStreamValidator::testFailsAtFirstImpossibleCharacter_data()
+{
+    QTest::addColumn<QString>("text");
+    QTest::addColumn<int>("failsAt"); // characters fed when the validator gives up
+
+    QTest::newRow("prose instead of json") << "Sure! Here is the issue: {" << 1;
+    QTest::newRow("wrong type") << "{\"title\": \"x\", \"priority\": \"high\"}" << 28;
+    QTest::newRow("unknown property") << "{\"title\": \"x\", \"prio\": 1}" << 21; // a prefix of "priority" until the quote
+    QTest::newRow("not an enum value") << "{\"title\": \"x\", \"priority\": 1, \"tags\": [\"bux\"]}" << 43;
+    QTest::newRow("too long") << "{\"title\": \"" + QString(41, 'a') + "\"}" << 52;
+    QTest::newRow("too many items") << "{\"title\": \"x\", \"priority\": 1, \"tags\": [\"bug\", \"bug\", \"bug\", \"bug\"]}" << 59;
+    QTest::newRow("missing required") << "{\"title\": \"x\"}" << 14;
+    QTest::newRow("out of range") << "{\"title\": \"x\", \"priority\": 9}" << 29;
+}
+
+void TestJsonStreamValidator::testFailsAtFirstImpossibleCharacter()
+{
+    QFETCH(QString, text);
+    QFETCH(int, failsAt);
+    JsonStreamValidator validator(issueSchema());
+    int fed = 0;
+    while (fed < text.size() && validator.feed(QStringView(text).mid(fed, 1)))
+    {
+        ++fed;
+    }
+    QVERIFY(validator.isFailed());
+    QCOMPARE(fed + 1, failsAt);
+}
+
+void TestJsonStreamValidator::testInvalidReplyIsRetried()
+{
+    MockJsonServer server;
+    QString invalid = "{\"title\": \"Login fails\", \"priority\": \"high\", \"tags\": [\"bug\"]}" + QString(3000, ' ');
+    QString valid = "{\"title\": \"Login fails\", \"priority\": 2, \"tags\": [\"bug\"]}";
+    server.replies = QStringList{invalid, valid};
+    QVERIFY(server.listen(QHostAddress::LocalHost));
+    ChatClient::instance()->setEndpoint(QUrl(QString("http://127.0.0.1:%1/v1/completions").arg(server.serverPort())));
+
+    ChatRequest request;
+    request.prompt = "File an issue for the login bug";
+    request.responseSchema = issueSchema();
+    ChatStream *stream = ChatClient::instance()->send(request, this);
+    QSignalSpy restarted(stream, &ChatStream::restarted);
+    QList<JsonField> fields;
+    connect(stream, &ChatStream::restarted, this, [&fields]() { fields.clear(); });
+    connect(stream, &ChatStream::readyRead, this, [&fields, stream]() { fields += stream->readFields(); });
+    QSignalSpy finished(stream, &ChatStream::finished);
+    QVERIFY(finished.wait(10000));
+
+    QVERIFY2(!stream->hasError(), qPrintable(stream->errorString()));
+    QCOMPARE(restarted.count(), 1);
+    QCOMPARE(server.connections, 2);
+    QVERIFY(server.charsSent.at(0) < 100); // cut off at "high", not after 3000 more characters
+    stream->readText();
+    QCOMPARE(stream->text(), valid);
+    fields += stream->readFields();
+    QCOMPARE(fields.size(), 3);
+    QCOMPARE(fields.at(1).path, QString("priority"));
+    QCOMPARE(fields.at(1).value.toInt(), 2);
+    delete stream;
+}
+
+void TestJsonStreamValidator::testGivesUpAfterRetries()
+{
+    MockJsonServer server;
+    QString prose = "I cannot produce JSON for that.";
+    server.replies = QStringList{prose, prose, prose, prose};
+    QVERIFY(server.listen(QHostAddress::LocalHost));
+    ChatClient::instance()->setEndpoint(QUrl(QString("http://127.0.0.1:%1/v1/completions").arg(server.serverPort())));
+
+    qint64 failedBefore = Stats::instance()->value("chat.schema.failed");
+    ChatRequest request;
+    request.prompt = "File an issue, but the model refuses";
+    request.responseSchema = issueSchema();
+    request.schemaRetries = 2;
+    ChatStream *stream = ChatClient::instance()->send(request, this);
+    QSignalSpy finished(stream, &ChatStream::finished);
+    QVERIFY(finished.wait(10000));
+
+    QVERIFY(stream->hasError());
+    QVERIFY(stream->errorString().startsWith("Reply does not match the schema"));
+    QCOMPARE(server.connections, 3);
+    QCOMPARE(Stats::instance()->value("chat.schema.failed"), failedBefore + 1);
+    delete stream;
+}
+
+void TestJsonStreamValidator::testRepeatedRequestStillValidates()
+{
+    // With a shared cache, a repeated request must still stream its fields
+    QTemporaryDir dir;
+    QVERIFY(ResponseCache::instance()->open(dir.filePath("responses.cache")));
+    MockJsonServer server;
+    QString valid = "{\"title\": \"Save hangs\", \"priority\": 1, \"done\": true}";
+    server.replies = QStringList{valid, valid};
+    QVERIFY(server.listen(QHostAddress::LocalHost));
+    ChatClient::instance()->setEndpoint(QUrl(QString("http://127.0.0.1:%1/v1/completions").arg(server.serverPort())));
+
+    ChatRequest request;
+    request.prompt = "File an issue for the hang";
+    request.responseSchema = issueSchema();
+    for (int round = 0; round < 2; ++round)
+    {
+        ChatStream *stream = ChatClient::instance()->send(request, this);
+        QSignalSpy finished(stream, &ChatStream::finished);
+        QVERIFY(finished.wait(10000));
+        QVERIFY2(!stream->hasError(), qPrintable(stream->errorString()));
+        stream->readText();
+        QList<JsonField> fields = stream->readFields();
+        QCOMPARE(fields.size(), 3);
+        QCOMPARE(fields.at(2).path, QString("done"));
+        delete stream;
+        ResponseCache::instance()->flush();
+    }
+    QCOMPARE(server.connections, 2);
+}
+
+QTEST_MAIN(TestJsonStreamValidator)
+#include "testjsonstreamvalidator.moc"
@@ -0,0 +1,73 @@
+#include <QtTest/QtTest>
+#include "replyview.h"
+#include "stats.h"
+
+class TestReplyView : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testHugeReplyShapesOnlyWhatIsShown();
+    void testStreamedAppendMatchesWholeText();
+};
+
+static QString logDump(int lines)
+{
+    QString text;
+    for (int i = 0; i < lines; ++i)
+    {
+        text += QString("2024-05-01 12:00:%1 worker[%2] processed batch %3\n").arg(i % 60, 2, 10, QChar('0')).arg(i % 8).arg(i);
+    }
+    return text;
+}
+
+void TestReplyView::testHugeReplyShapesOnlyWhatIsShown()
+{
+    QString text = logDump(50000);
+    QVERIFY(ReplyView::isHuge(text));
+
+    ReplyView view;
+    view.resize(600, 10);
+    QElapsedTimer timer;
+    timer.start();
+    view.setText(text);
+    view.resize(view.sizeHint());
+    QPixmap collapsed = view.grab();
+    qDebug() << "collapsed 50k lines in" << timer.elapsed() << "ms";
+    QVERIFY(timer.elapsed() < 200);
+    QCOMPARE(view.lineCount(), 50000);
+    QCOMPARE(view.height(), (2 * ReplyView::EdgeLines + 1) * view.fontMetrics().lineSpacing());
+
+    // Expanded, a viewport-sized paint in the middle lays out one or two pages
+    view.setExpanded(true);
+    view.resize(view.sizeHint());
+    QCOMPARE(view.height(), 50001 * view.fontMetrics().lineSpacing());
+    qint64 pagesBefore = Stats::instance()->value("reply_view.pages_laid_out");
+    QPixmap viewport(600, 800);
+    timer.restart();
+    view.render(&viewport, QPoint(), QRegion(0, view.height() / 2, 600, 800));
+    qDebug() << "expanded viewport paint in" << timer.elapsed() << "ms";
+    QVERIFY(Stats::instance()->value("reply_view.pages_laid_out") - pagesBefore <= 2);
+}
+
+void TestReplyView::testStreamedAppendMatchesWholeText()
+{
+    QString text = logDump(3000);
+    ReplyView whole;
+    whole.setText(text);
+
+    ReplyView streamed;
+    for (int i = 0; i < text.size(); i += 997) // chunks split lines anywhere
+    {
+        streamed.appendText(text.mid(i, 997));
+    }
+    QCOMPARE(streamed.lineCount(), whole.lineCount());
+    QCOMPARE(streamed.sizeHint(), whole.sizeHint());
+
+    QString preview = ReplyView::collapsedPreview(text);
+    QVERIFY(preview.contains(QString("[%1 lines hidden]").arg(3000 - 2 * ReplyView::EdgeLines)));
+    QVERIFY(preview.endsWith("processed batch 2999\n"));
+}
+
+QTEST_MAIN(TestReplyView)
+#include "testreplyview.moc"
@@ -0,0 +1,213 @@
+#include <QtTest/QtTest>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include "chatclient.h"
+#include "requestbatcher.h"
+
+// A completion endpoint answering whole (non-streamed) completions, with or
+// without the batch URL. Every completion echoes its prompt; the prompt
+// "fail" gets an error instead.
+class MockBatchServer : public QTcpServer
+{
+    Q_OBJECT
+
+public:
+    bool batchSupported = true;
+    QStringList paths;     // one per HTTP request
+    QList<int> batchSizes; // one per batch answered
+
+    MockBatchServer()
+    {
+        connect(this, &QTcpServer::newConnection, this, &MockBatchServer::accept);
+    }
+
+private:
+    void accept()
+    {
+        while (QTcpSocket *socket = nextPendingConnection())
+        {
+            connect(socket, &QTcpSocket::readyRead, this, [this, socket]() { readRequest(socket); });
+            connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+            connect(socket, &QObject::destroyed, this, [this, socket]() { requests.remove(socket); });
+        }
+    }
+
+    static QJsonObject completion(const QJsonObject &body)
+    {
+        QString prompt = body["prompt"].toString();
+        if (prompt == "fail")
+        {
+            return QJsonObject{{"error", QJsonObject{{"message", "refused"}}}};
+        }
+        QJsonObject choice{{"text", "echo: " + prompt}};
+        return QJsonObject{{"choices", QJsonArray{choice}}};
+    }
+
+    void readRequest(QTcpSocket *socket)
+    {
+        QByteArray &request = requests[socket];
+        request += socket->readAll();
+        int headerEnd = request.indexOf("\r\n\r\n");
+        if (headerEnd < 0)
+        {
+            return;
+        }
+        QRegularExpression length("content-length:\\s*(\\d+)", QRegularExpression::CaseInsensitiveOption);
+        QRegularExpressionMatch match = length.match(QString::fromLatin1(request.left(headerEnd)));
+        int bodyLength = match.hasMatch() ? match.captured(1).toInt() : 0;
+        if (request.size() - headerEnd - 4 < bodyLength)
+        {
+            return;
+        }
+        QString path = QString::fromLatin1(request.left(request.indexOf("\r\n")).split(' ').value(1));
+        QJsonObject body = QJsonDocument::fromJson(request.mid(headerEnd + 4, bodyLength)).object();
+        request = request.mid(headerEnd + 4 + bodyLength);
+        paths.append(path);
+
+        QByteArray status = "200 OK";
+        QJsonObject answer;
+        if (path.endsWith("/batch"))
+        {
+            if (!batchSupported)
+            {
+                status = "404 Not Found";
+            }
+            else
+            {
+                QJsonArray responses;
+                const QJsonArray entries = body["requests"].toArray();
+                for (const QJsonValue &entry : entries)
+                {
+                    QJsonObject result = completion(entry["body"].toObject());
+                    QJsonObject response{{"status_code", result.contains("error") ? 400 : 200}, {"body", result}};
+                    responses.append(QJsonObject{{"custom_id", entry["custom_id"]}, {"response", response}});
+                }
+                batchSizes.append(entries.size());
+                answer["responses"] = responses;
+            }
+        }
+        else
+        {
+            answer = completion(body);
+        }
+        QByteArray payload = QJsonDocument(answer).toJson(QJsonDocument::Compact);
+        socket->write("HTTP/1.1 " + status + "\r\nContent-Type: application/json\r\nContent-Length: " +
+                      QByteArray::number(payload.size()) + "\r\n\r\n" + payload);
+    }
+
+    QHash<QTcpSocket *, QByteArray> requests;
+};
+
+class TestRequestBatcher : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void testBackgroundRequestsShareOneBatch();
+    void testInteractiveRequestsAreNotHeld();
+    void testFallsBackWithoutBatchSupport();
+
+private:
+    QList<ChatStream *> sendAll(const QStringList &prompts, bool background);
+};
+
+void TestRequestBatcher::initTestCase()
+{
+    qputenv("D0_RESPONSE_CACHE", "0");
+}
+
+QList<ChatStream *> TestRequestBatcher::sendAll(const QStringList &prompts, bool background)
+{
+    QList<ChatStream *> streams;
+    for (const QString &prompt : prompts)
+    {
+        ChatRequest request;
+        request.prompt = prompt;
+        request.background = background;
+        streams.append(ChatClient::instance()->send(request, this));
+    }
+    for (ChatStream *stream : streams)
+    {
+        if (!stream->isFinished())
+        {
+            QSignalSpy finished(stream, &ChatStream::finished);
+            finished.wait(5000);
+        }
+        stream->readText();
+    }
+    return streams;
+}
+
+void TestRequestBatcher::testBackgroundRequestsShareOneBatch()
+{
+    MockBatchServer server;
+    QVERIFY(server.listen(QHostAddress::LocalHost));
+    ChatClient::instance()->setEndpoint(QUrl(QString("http://127.0.0.1:%1/v1/completions").arg(server.serverPort())));
+    QVERIFY(ChatClient::instance()->isBatching());
+
+    QStringList prompts;
+    for (int i = 0; i < 20; ++i)
+    {
+        prompts.append(QString("part %1").arg(i));
+    }
+    prompts.append("fail");
+    QList<ChatStream *> streams = sendAll(prompts, true);
+
+    QCOMPARE(server.paths, QStringList{"/v1/completions/batch"});
+    QCOMPARE(server.batchSizes, QList<int>{21});
+    for (int i = 0; i < 20; ++i)
+    {
+        QVERIFY(!streams.at(i)->hasError());
+        QCOMPARE(streams.at(i)->text(), QString("echo: part %1").arg(i));
+    }
+    QVERIFY(streams.last()->hasError());
+    QCOMPARE(streams.last()->errorString(), QString("refused"));
+    qDeleteAll(streams);
+}
+
+void TestRequestBatcher::testInteractiveRequestsAreNotHeld()
+{
+    MockBatchServer server;
+    QVERIFY(server.listen(QHostAddress::LocalHost));
+    ChatClient::instance()->setEndpoint(QUrl(QString("http://127.0.0.1:%1/v1/completions").arg(server.serverPort())));
+
+    QElapsedTimer timer;
+    timer.start();
+    QList<ChatStream *> streams = sendAll({"typed by hand"}, false);
+    QVERIFY(timer.elapsed() < RequestBatcher::WindowMs);
+    QCOMPARE(server.paths, QStringList{"/v1/completions"});
+    QCOMPARE(streams.first()->text(), QString("echo: typed by hand"));
+    qDeleteAll(streams);
+}
+
+void TestRequestBatcher::testFallsBackWithoutBatchSupport()
+{
+    MockBatchServer server;
+    server.batchSupported = false;
+    QVERIFY(server.listen(QHostAddress::LocalHost));
+    ChatClient::instance()->setEndpoint(QUrl(QString("http://127.0.0.1:%1/v1/completions").arg(server.serverPort())));
+
+    QList<ChatStream *> streams = sendAll({"a", "b", "c"}, true);
+    QCOMPARE(server.paths.count("/v1/completions/batch"), 1);
+    QCOMPARE(server.paths.count("/v1/completions"), 3);
+    for (ChatStream *stream : streams)
+    {
+        QVERIFY(!stream->hasError());
+        QCOMPARE(stream->text(), "echo: " + stream->request().prompt);
+    }
+    QVERIFY(!ChatClient::instance()->isBatching());
+    qDeleteAll(streams);
+
+    // Later background requests go straight to the endpoint
+    streams = sendAll({"d"}, true);
+    QCOMPARE(server.paths.count("/v1/completions/batch"), 1);
+    QCOMPARE(streams.first()->text(), QString("echo: d"));
+    qDeleteAll(streams);
+}
+
+QTEST_MAIN(TestRequestBatcher)
+#include "testrequestbatcher.moc"
@@ -0,0 +1,84 @@
+#include <QtTest/QtTest>
+#include <QCryptographicHash>
+#include <QTemporaryDir>
+#include <memory>
+#include <vector>
+#include "responsecache.h"
+
+class TestResponseCache : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testSharedBetweenMappings();
+    void testRingReclaimsOldest();
+    void testClosedWithoutReaderSlot();
+};
+
+static QByteArray keyFor(int i)
+{
+    return QCryptographicHash::hash(QByteArray::number(i), QCryptographicHash::Sha256);
+}
+
+void TestResponseCache::testSharedBetweenMappings()
+{
+    // Two caches on one file behave like two processes
+    QTemporaryDir dir;
+    ResponseCache writer;
+    ResponseCache reader;
+    QVERIFY(writer.open(dir.filePath("responses.cache")));
+    QVERIFY(reader.open(dir.filePath("responses.cache")));
+
+    QString text;
+    QVERIFY(!reader.lookup(keyFor(1), &text));
+    writer.store(keyFor(1), QString::fromUtf8("héllo"));
+    writer.flush();
+    QVERIFY(reader.lookup(keyFor(1), &text));
+    QCOMPARE(text, QString::fromUtf8("héllo"));
+}
+
+void TestResponseCache::testRingReclaimsOldest()
+{
+    QTemporaryDir dir;
+    ResponseCache cache;
+    QVERIFY(cache.open(dir.filePath("responses.cache"), 1024, 64 * 1024));
+
+    // ~1 KB each: the ring holds the newest ~60
+    for (int i = 0; i < 1000; ++i)
+    {
+        cache.store(keyFor(i), QString("answer %1 ").arg(i).repeated(100));
+    }
+    cache.flush();
+    QString text;
+    QVERIFY(!cache.lookup(keyFor(0), &text));
+    for (int i = 990; i < 1000; ++i)
+    {
+        QVERIFY(cache.lookup(keyFor(i), &text));
+        QCOMPARE(text, QString("answer %1 ").arg(i).repeated(100));
+    }
+}
+
+void TestResponseCache::testClosedWithoutReaderSlot()
+{
+    // Every mapping in this process holds a slot of its own; the header has 64
+    QTemporaryDir dir;
+    std::vector<std::unique_ptr<ResponseCache>> holders;
+    for (int i = 0; i < 64; ++i)
+    {
+        holders.push_back(std::make_unique<ResponseCache>());
+        QVERIFY(holders.back()->open(dir.filePath("responses.cache"), 1024, 64 * 1024));
+    }
+    holders.front()->store(keyFor(1), "kept");
+    holders.front()->flush();
+
+    ResponseCache late;
+    QVERIFY(!late.open(dir.filePath("responses.cache"), 1024, 64 * 1024));
+    QVERIFY(!late.isOpen());
+    QString text;
+    QVERIFY(!late.lookup(keyFor(1), &text));
+    QVERIFY(holders.back()->lookup(keyFor(1), &text));
+    QCOMPARE(text, QString("kept"));
+}
+
+QTEST_MAIN(TestResponseCache)
+#include "testresponsecache.moc"
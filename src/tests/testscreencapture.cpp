@@ -0,0 +1,64 @@
+#include <QtTest/QtTest>
+#include <QPainter>
+#include "screencapture.h"
+
+class TestScreenCapture : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testDownscaleKeepsAspect();
+    void testHalvingAverages();
+    void testFourKLatency();
+};
+
+void TestScreenCapture::testDownscaleKeepsAspect()
+{
+    QImage image(3840, 2160, QImage::Format_RGB32);
+    image.fill(Qt::darkCyan);
+    QImage scaled = ScreenCapture::downscale(image, ScreenCapture::MaxEdge);
+    QCOMPARE(scaled.width(), ScreenCapture::MaxEdge);
+    QCOMPARE(scaled.height(), ScreenCapture::MaxEdge * 2160 / 3840);
+}
+
+void TestScreenCapture::testHalvingAverages()
+{
+    // A 2x2 checkerboard of black and white averages to mid grey
+    QImage image(4 * ScreenCapture::MaxEdge, 4, QImage::Format_RGB32);
+    for (int y = 0; y < image.height(); ++y)
+    {
+        for (int x = 0; x < image.width(); ++x)
+        {
+            image.setPixel(x, y, (x + y) % 2 ? 0xffffffff : 0xff000000);
+        }
+    }
+    QImage scaled = ScreenCapture::downscale(image, ScreenCapture::MaxEdge);
+    QCOMPARE(scaled.width(), ScreenCapture::MaxEdge);
+    QCOMPARE(qGray(scaled.pixel(0, 0)), 128);
+}
+
+void TestScreenCapture::testFourKLatency()
+{
+    // Text-like content so the encoder does real work
+    QImage image(3840, 2160, QImage::Format_RGB32);
+    image.fill(Qt::white);
+    QPainter painter(&image);
+    for (int y = 0; y < image.height(); y += 18)
+    {
+        painter.drawText(0, y, QString("The quick brown fox jumps over the lazy dog %1 ").repeated(20).arg(y));
+    }
+    painter.end();
+
+    QElapsedTimer timer;
+    timer.start();
+    ImageAttachment attachment = ScreenCapture::encode(ScreenCapture::downscale(image, ScreenCapture::MaxEdge));
+    qint64 elapsed = timer.elapsed();
+
+    qDebug() << "4K downscale + encode:" << elapsed << "ms," << attachment.data.size() / 1024 << "KB";
+    QVERIFY(!attachment.data.isEmpty());
+    QCOMPARE(attachment.mimeType, QByteArray("image/jpeg"));
+    QVERIFY(elapsed < 100);
+}
+
+QTEST_MAIN(TestScreenCapture)
+#include "testscreencapture.moc"
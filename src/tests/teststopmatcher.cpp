@@ -0,0 +1,192 @@
+#include <QtTest/QtTest>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include "chatclient.h"
+#include "stopmatcher.h"
+
+// Streams a fixed list of tokens as server-sent events, one every few
+// milliseconds, and notes when the client hangs up.
+class MockTokenServer : public QTcpServer
+{
+    Q_OBJECT
+
+public:
+    QStringList tokens;
+    int sent = 0;
+    bool clientClosed = false;
+
+    MockTokenServer()
+    {
+        connect(this, &QTcpServer::newConnection, this, &MockTokenServer::accept);
+    }
+
+private:
+    void accept()
+    {
+        QTcpSocket *socket = nextPendingConnection();
+        connect(socket, &QTcpSocket::disconnected, this, [this, socket]()
+                {
+                    clientClosed = sent < tokens.size();
+                    socket->deleteLater();
+                });
+        connect(socket, &QTcpSocket::readyRead, this, [this, socket]()
+                {
+                    if (!socket->readAll().contains("\r\n\r\n") || timer.isActive())
+                    {
+                        return; // the small requests here arrive in one piece
+                    }
+                    socket->write("HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nConnection: close\r\n\r\n");
+                    timer.callOnTimeout(socket, [this, socket]() { writeNext(socket); });
+                    timer.start(2);
+                });
+    }
+
+    void writeNext(QTcpSocket *socket)
+    {
+        if (sent == tokens.size())
+        {
+            timer.stop();
+            socket->write("data: [DONE]\n\n");
+            socket->disconnectFromHost();
+            return;
+        }
+        QString token = tokens.at(sent++);
+        token.replace("\\", "\\\\").replace("\"", "\\\"").replace("\n", "\\n");
+        socket->write("data: {\"choices\":[{\"text\":\"" + token.toUtf8() + "\"}]}\n\n");
+    }
+
+    QTimer timer;
+};
+
+class TestStopMatcher : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void testMatchesAcrossPieces();
+    void testOverlappingPatterns();
+    void testRepetition();
+    void testStopStringAbortsReply();
+    void testRepetitionAbortsReply();
+
+private:
+    ChatStream *run(MockTokenServer &server, const ChatRequest &request);
+};
+
+void TestStopMatcher::initTestCase()
+{
+    qputenv("D0_RESPONSE_CACHE", "0");
+}
+
+void TestStopMatcher::testMatchesAcrossPieces()
+{
+    StopMatcher matcher({"\n\nEND", "###"});
+    QCOMPARE(matcher.feed(u"The answer is 42.\n"), qsizetype(-1));
+    QCOMPARE(matcher.pending(), 1); // "\n" may start "\n\nEND"
+    QCOMPARE(matcher.feed(u"\nE"), qsizetype(-1));
+    QCOMPARE(matcher.pending(), 3);
+    QCOMPARE(matcher.feed(u"ND and more"), qsizetype(17));
+}
+
+void TestStopMatcher::testOverlappingPatterns()
+{
+    // The classic Aho-Corasick case: "she" ends inside "hers"
+    StopMatcher matcher({"he", "she", "his", "hers"});
+    QCOMPARE(matcher.feed(u"us"), qsizetype(-1));
+    QCOMPARE(matcher.feed(u"hers"), qsizetype(1));
+
+    StopMatcher none({"", "zzz"});
+    QVERIFY(!none.isEmpty());
+    QCOMPARE(none.feed(u"zz z zz"), qsizetype(-1));
+    QVERIFY(StopMatcher({""}).isEmpty());
+}
+
+void TestStopMatcher::testRepetition()
+{
+    QString intro = "Here is the list you asked for:\n";
+    QString line = "- item number seven, again\n";
+    RepetitionDetector detector;
+    QCOMPARE(detector.feed(intro), qsizetype(-1));
+    qsizetype at = -1;
+    for (int i = 0; i < 20 && at < 0; ++i)
+    {
+        at = detector.feed(line);
+    }
+    // One copy is kept; it may start a character or two early when the
+    // text before the loop ends like the looping passage does ("\n" here)
+    QVERIFY(at > intro.size() + line.size() - 3 && at <= intro.size() + line.size());
+
+    // Separators and ordinary prose are not loops
+    RepetitionDetector rule;
+    QCOMPARE(rule.feed(QString(2000, '-')), qsizetype(-1));
+    RepetitionDetector prose;
+    for (int i = 0; i < 200; ++i)
+    {
+        QCOMPARE(prose.feed(QString("Sentence %1 says something a little different. ").arg(i)), qsizetype(-1));
+    }
+}
+
+ChatStream *TestStopMatcher::run(MockTokenServer &server, const ChatRequest &request)
+{
+    server.listen(QHostAddress::LocalHost);
+    ChatClient::instance()->setEndpoint(QUrl(QString("http://127.0.0.1:%1/v1/completions").arg(server.serverPort())));
+    ChatStream *stream = ChatClient::instance()->send(request, this);
+    QSignalSpy finished(stream, &ChatStream::finished);
+    while (!stream->isFinished() && finished.wait(5000))
+    {
+    }
+    stream->readText();
+    return stream;
+}
+
+void TestStopMatcher::testStopStringAbortsReply()
+{
+    MockTokenServer server;
+    server.tokens = QStringList{"The", " answer", " is", " 42", ".\n", "\nE", "ND", " then"};
+    for (int i = 0; i < 1000; ++i)
+    {
+        server.tokens.append(" filler");
+    }
+    ChatRequest request;
+    request.prompt = "stop string";
+    request.maxTokens = 1008;
+    request.stopSequences = QStringList{"\n\nEND"};
+    ChatStream *stream = run(server, request);
+
+    QVERIFY(!stream->hasError());
+    QCOMPARE(stream->text(), QString("The answer is 42."));
+    StreamMetrics metrics = stream->metrics();
+    QCOMPARE(metrics.stopReason, QString("stop"));
+    QVERIFY(metrics.tokensSaved >= 990);
+    QVERIFY(metrics.msSaved > 0);
+    QTRY_VERIFY(server.clientClosed);
+    QVERIFY(server.sent < 100);
+    delete stream;
+}
+
+void TestStopMatcher::testRepetitionAbortsReply()
+{
+    MockTokenServer server;
+    server.tokens = QStringList{"Sure.", "\n"};
+    for (int i = 0; i < 500; ++i)
+    {
+        server.tokens << "I" << " will" << " check" << " that" << " now" << "." << "\n";
+    }
+    ChatRequest request;
+    request.prompt = "loop";
+    request.maxTokens = 4000;
+    request.stopOnRepetition = true;
+    ChatStream *stream = run(server, request);
+
+    QVERIFY(!stream->hasError());
+    QVERIFY(stream->text().startsWith("Sure.\nI will check that now"));
+    QVERIFY(stream->text().size() <= 29);
+    QCOMPARE(stream->metrics().stopReason, QString("repetition"));
+    QTRY_VERIFY(server.clientClosed);
+    QVERIFY(server.sent < 200);
+    delete stream;
+}
+
+QTEST_MAIN(TestStopMatcher)
+#include "teststopmatcher.moc"
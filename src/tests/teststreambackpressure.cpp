@@ -0,0 +1,173 @@
+#include <QtTest/QtTest>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include "chatclient.h"
+#include "stats.h"
+
+// A completion endpoint that streams server-sent events as fast as the
+// socket takes them. It only queues more when its own send buffer is low,
+// so everything buffered beyond that is on the client side.
+class MockStreamServer : public QTcpServer
+{
+    Q_OBJECT
+
+public:
+    static const int Events = 12000;
+    static const int EventChars = 1000;
+
+    MockStreamServer()
+    {
+        QByteArray text(EventChars, 'x');
+        event = "data: {\"choices\":[{\"text\":\"" + text + "\"}]}\n\n";
+        connect(this, &QTcpServer::newConnection, this, &MockStreamServer::accept);
+    }
+
+private:
+    struct Client
+    {
+        QByteArray request;
+        int sent = -1; // events written; -1 until the request is complete
+    };
+
+    void accept()
+    {
+        while (QTcpSocket *socket = nextPendingConnection())
+        {
+            connect(socket, &QTcpSocket::readyRead, this, [this, socket]() { readRequest(socket); });
+            connect(socket, &QTcpSocket::bytesWritten, this, [this, socket]() { writeMore(socket); });
+            connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+            connect(socket, &QObject::destroyed, this, [this, socket]() { clients.remove(socket); });
+        }
+    }
+
+    void readRequest(QTcpSocket *socket)
+    {
+        Client &client = clients[socket];
+        client.request += socket->readAll();
+        int headerEnd = client.request.indexOf("\r\n\r\n");
+        if (client.sent >= 0 || headerEnd < 0)
+        {
+            return;
+        }
+        QRegularExpression length("content-length:\\s*(\\d+)", QRegularExpression::CaseInsensitiveOption);
+        QRegularExpressionMatch match = length.match(QString::fromLatin1(client.request.left(headerEnd)));
+        if (client.request.size() - headerEnd - 4 < (match.hasMatch() ? match.captured(1).toInt() : 0))
+        {
+            return;
+        }
+        client.sent = 0;
+        socket->write("HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nConnection: close\r\n\r\n");
+        writeMore(socket);
+    }
+
+    void writeMore(QTcpSocket *socket)
+    {
+        Client &client = clients[socket];
+        if (client.sent < 0)
+        {
+            return;
+        }
+        while (client.sent < Events && socket->bytesToWrite() < 256 * 1024)
+        {
+            socket->write(event);
+            ++client.sent;
+        }
+        if (client.sent == Events && socket->bytesToWrite() == 0)
+        {
+            socket->write("data: [DONE]\n\n");
+            socket->disconnectFromHost();
+            client.sent = Events + 1;
+        }
+    }
+
+    QByteArray event;
+    QHash<QTcpSocket *, Client> clients;
+};
+
+class TestStreamBackpressure : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void testMemoryCeilingWhileConsumerLags();
+};
+
+static qint64 residentBytes()
+{
+    QFile statm("/proc/self/statm");
+    if (!statm.open(QIODevice::ReadOnly))
+    {
+        return -1;
+    }
+    QList<QByteArray> fields = statm.readAll().split(' ');
+    return fields.value(1).toLongLong() * 4096;
+}
+
+void TestStreamBackpressure::initTestCase()
+{
+    qputenv("D0_RESPONSE_CACHE", "0");
+}
+
+void TestStreamBackpressure::testMemoryCeilingWhileConsumerLags()
+{
+    static const int Streams = 6; // one HTTP/1.1 connection each
+    MockStreamServer server;
+    QVERIFY(server.listen(QHostAddress::LocalHost));
+    ChatClient::instance()->setEndpoint(QUrl(QString("http://127.0.0.1:%1/v1/completions").arg(server.serverPort())));
+
+    qint64 before = residentBytes();
+    QList<ChatStream *> streams;
+    for (int i = 0; i < Streams; ++i)
+    {
+        ChatRequest request;
+        request.prompt = QString("stress %1").arg(i);
+        streams.append(ChatClient::instance()->send(request, this));
+    }
+
+    // Nobody reads: every reply has to stop at its ceiling instead of taking
+    // the 70 MB the server is trying to push
+    QTRY_VERIFY_WITH_TIMEOUT(Stats::instance()->value("chat.backpressure.pauses") >= Streams, 10000);
+    QTest::qWait(1000);
+    qint64 lagging = residentBytes() - before;
+    qDebug() << "resident growth while paused:" << lagging / (1024 * 1024) << "MB";
+    QVERIFY(lagging < 48 * 1024 * 1024);
+    for (ChatStream *stream : streams)
+    {
+        QVERIFY(!stream->isFinished());
+    }
+
+    // A slow consumer: every reply resumes and completes intact. Each reply
+    // keeps what it has delivered (UTF-16, with up to twice that reserved
+    // while it grows); anything beyond that must stay at the paused ceiling.
+    QTimer consumer;
+    qint64 total = 0;
+    qint64 overhead = 0;
+    connect(&consumer, &QTimer::timeout, this, [&]()
+            {
+                for (ChatStream *stream : streams)
+                {
+                    total += stream->readText().size();
+                }
+                overhead = qMax(overhead, residentBytes() - before - 4 * total);
+            });
+    consumer.start(20);
+    QTRY_VERIFY_WITH_TIMEOUT(std::all_of(streams.cbegin(), streams.cend(), [](ChatStream *stream)
+                                         { return stream->isFinished(); }),
+                             60000);
+    consumer.stop();
+    qDebug() << "resident growth beyond the kept text while consuming:" << overhead / (1024 * 1024) << "MB";
+    QVERIFY(overhead < 48 * 1024 * 1024);
+    for (ChatStream *stream : streams)
+    {
+        total += stream->readText().size();
+        QVERIFY(!stream->hasError());
+        QCOMPARE(stream->text().size(), qsizetype(MockStreamServer::Events) * MockStreamServer::EventChars);
+        delete stream;
+    }
+    QCOMPARE(total, qint64(Streams) * MockStreamServer::Events * MockStreamServer::EventChars);
+    QVERIFY(Stats::instance()->value("chat.backpressure.resumes") >= Streams);
+}
+
+QTEST_MAIN(TestStreamBackpressure)
+#include "teststreambackpressure.moc"
@@ -0,0 +1,73 @@
+#include <QtTest/QtTest>
+#include <QTemporaryFile>
+#include "transcriptimporter.h"
+
+class TestTranscriptImporter : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testEveryLineInExactlyOneRange();
+    void testEscapesAndArrays();
+};
+
+static QList<ChatMessage> decode(const TranscriptStore::Batch &batch)
+{
+    QTemporaryFile file;
+    file.open();
+    file.write(batch.data);
+    file.flush();
+    QList<ChatMessage> messages;
+    for (const auto &locations : batch.index)
+    {
+        for (const TranscriptStore::Location &location : locations)
+        {
+            messages.append(TranscriptStore::readMessage(file, location));
+        }
+    }
+    return messages;
+}
+
+void TestTranscriptImporter::testEveryLineInExactlyOneRange()
+{
+    QByteArray data;
+    for (int i = 0; i < 1000; ++i)
+    {
+        data += "{\"role\":\"user\",\"timestamp\":" + QByteArray::number(i) + ",\"text\":\"message " + QByteArray::number(i) + "\"}\n";
+    }
+    QUuid conversation = QUuid::createUuid();
+
+    // Boundaries at arbitrary offsets, mostly inside lines
+    for (qint64 step : {7, 64, 1000, 4096, qint64(data.size())})
+    {
+        int total = 0;
+        for (qint64 begin = 0; begin < data.size(); begin += step)
+        {
+            TranscriptStore::Batch batch;
+            QCOMPARE(TranscriptImporter::parseRange(data.constData(), data.size(), begin, qMin(data.size(), begin + step), conversation, batch), 0);
+            total += batch.messages;
+        }
+        QCOMPARE(total, 1000);
+    }
+}
+
+void TestTranscriptImporter::testEscapesAndArrays()
+{
+    QByteArray data = "[\n"
+                      "{\"role\":\"assistant\",\"text\":\"say \\\"hi\\\"\\n\"},\n"
+                      "{\"text\": \"plain\" , \"role\" : \"user\"}\n"
+                      "not json\n"
+                      "]\n";
+    QUuid conversation = QUuid::createUuid();
+    TranscriptStore::Batch batch;
+    QCOMPARE(TranscriptImporter::parseRange(data.constData(), data.size(), 0, data.size(), conversation, batch), 1);
+    QList<ChatMessage> messages = decode(batch);
+    QCOMPARE(messages.size(), 2);
+    QCOMPARE(messages[0].text, QString("say \"hi\"\n"));
+    QCOMPARE(messages[0].role, QString("assistant"));
+    QCOMPARE(messages[0].conversation, conversation);
+    QCOMPARE(messages[1].text, QString("plain"));
+}
+
+QTEST_MAIN(TestTranscriptImporter)
+#include "testtranscriptimporter.moc"
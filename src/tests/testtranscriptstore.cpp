@@ -0,0 +1,78 @@
+#include <QtTest/QtTest>
+#include <QRandomGenerator>
+#include "transcriptstore.h"
+#include "stats.h"
+
+class TestTranscriptStore : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void testChunkSizesStayInBounds();
+    void testRepeatedBlocksAreStoredOnce();
+};
+
+static QString randomCode(int lines, quint32 seed)
+{
+    QRandomGenerator random(seed);
+    QString text;
+    for (int i = 0; i < lines; ++i)
+    {
+        text += QString("    value_%1 = compute(%2, \"%3\");\n").arg(random.generate() % 10000).arg(random.generate() % 97).arg(random.generate(), 0, 16);
+    }
+    return text;
+}
+
+void TestTranscriptStore::initTestCase()
+{
+    QStandardPaths::setTestModeEnabled(true);
+    QDir(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation)).removeRecursively();
+}
+
+void TestTranscriptStore::testChunkSizesStayInBounds()
+{
+    QByteArray data = randomCode(20000, 1).toUtf8();
+    const uchar *bytes = reinterpret_cast<const uchar *>(data.constData());
+    int chunks = 0;
+    for (int position = 0; position < data.size(); ++chunks)
+    {
+        int length = TranscriptStore::chunkLength(bytes + position, data.size() - position);
+        QVERIFY(length > 0 && length <= 65536);
+        QVERIFY(length >= 2048 || position + length == data.size());
+        position += length;
+    }
+    qDebug() << chunks << "chunks, average" << data.size() / chunks << "bytes";
+}
+
+void TestTranscriptStore::testRepeatedBlocksAreStoredOnce()
+{
+    TranscriptStore *store = TranscriptStore::instance();
+    QSignalSpy indexed(store, &TranscriptStore::indexed);
+    QVERIFY(store->isIndexed() || indexed.wait());
+
+    // The same log pasted with a different question around it each time
+    QString block = randomCode(3000, 2);
+    QUuid conversation = QUuid::createUuid();
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < 20; ++i)
+    {
+        store->append(conversation, "user", QString("Question %1 about this:\n").arg(i) + block + "\nThanks");
+    }
+    qint64 writeMs = timer.elapsed();
+
+    qint64 logical = Stats::instance()->value("transcript.dedup.logical_bytes");
+    qint64 stored = Stats::instance()->value("transcript.dedup.stored_bytes");
+    qDebug() << "dedup ratio" << double(logical) / stored << "write" << logical / 1000 / qMax<qint64>(1, writeMs) << "MB/s";
+    QVERIFY(logical > 8 * stored);
+
+    timer.restart();
+    QList<ChatMessage> messages = store->messages(conversation, 0, 20);
+    qDebug() << "read" << messages.size() << "messages in" << timer.elapsed() << "ms";
+    QCOMPARE(messages.size(), 20);
+    QCOMPARE(messages[7].text, QString("Question 7 about this:\n") + block + "\nThanks");
+}
+
+QTEST_MAIN(TestTranscriptStore)
+#include "testtranscriptstore.moc"
@@ -0,0 +1,302 @@
+#include "toolexecutor.h"
+#include "stats.h"
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QPointer>
+#include <QRegularExpression>
+#include <QTextStream>
+#include <QThread>
+#include <QTimer>
+#include <algorithm>
+
+static const int MaxOutputBytes = 64 * 1024;
+static const int MaxGrepMatches = 200;
+static const int MaxDirectoryEntries = 500;
+
+static QMutex openFileMutex;
+static QString openFile;
+
+struct ToolDefinition
+{
+    const char *name;
+    const char *description;
+    const char *parameters; // JSON schema
+    int timeoutMs;
+};
+
+static const ToolDefinition toolDefinitions[] = {
+    {"grep_file", "Lines matching a regular expression in a file next to the open file (path relative to its directory)",
+     R"({"type":"object","properties":{"path":{"type":"string"},"pattern":{"type":"string"}},"required":["path","pattern"]})", 5000},
+    {"list_directory", "Entries of the open file's directory or one below it (path relative to that directory)",
+     R"({"type":"object","properties":{"path":{"type":"string"}},"required":["path"]})", 2000},
+    {"read_open_file", "Contents of the file open in the main window",
+     R"({"type":"object","properties":{"offset":{"type":"integer"},"length":{"type":"integer"}}})", 2000},
+};
+
+static const ToolDefinition *findTool(const QString &name)
+{
+    for (const ToolDefinition &definition : toolDefinitions)
+    {
+        if (name == QLatin1String(definition.name))
+        {
+            return &definition;
+        }
+    }
+    return nullptr;
+}
+
+ToolExecutor::ToolExecutor(QObject *parent) : QObject(parent)
+{
+    pool.setMaxThreadCount(qBound(2, QThread::idealThreadCount(), 4));
+}
+
+ToolExecutor::~ToolExecutor()
+{
+    // Tools poll their flag, so the pool destructor does not wait long
+    for (const auto &flag : cancelFlags)
+    {
+        flag->store(true);
+    }
+    pool.waitForDone();
+}
+
+QJsonArray ToolExecutor::definitions()
+{
+    QJsonArray tools;
+    for (const ToolDefinition &definition : toolDefinitions)
+    {
+        QJsonObject function;
+        function["name"] = definition.name;
+        function["description"] = definition.description;
+        function["parameters"] = QJsonDocument::fromJson(definition.parameters).object();
+        tools.append(QJsonObject{{"type", "function"}, {"function", function}});
+    }
+    return tools;
+}
+
+void ToolExecutor::setOpenFilePath(const QString &path)
+{
+    QMutexLocker locker(&openFileMutex);
+    openFile = path;
+}
+
+QString ToolExecutor::openFilePath()
+{
+    QMutexLocker locker(&openFileMutex);
+    return openFile;
+}
+
+int ToolExecutor::run(const QList<ToolCall> &calls)
+{
+    int batch = nextBatch++;
+    Batch &state = batches[batch];
+    state.results.resize(calls.size());
+    state.completed.fill(false, calls.size());
+    state.remaining = calls.size();
+
+    QPointer<ToolExecutor> guard(this);
+    for (int index = 0; index < calls.size(); ++index)
+    {
+        const ToolCall call = calls.at(index);
+        const ToolDefinition *definition = findTool(call.name);
+        auto cancelled = std::make_shared<std::atomic<bool>>(false);
+        cancelFlags.append(cancelled);
+
+        pool.start([guard, batch, index, call, cancelled]()
+                   {
+                       QElapsedTimer timer;
+                       timer.start();
+                       ToolResult result;
+                       result.callId = call.id;
+                       result.name = call.name;
+                       result.output = execute(call, *cancelled, &result.ok);
+                       result.latencyMs = timer.elapsed();
+                       QMetaObject::invokeMethod(qApp, [guard, batch, index, result]()
+                                                 {
+                                                     if (guard)
+                                                     {
+                                                         guard->complete(batch, index, result);
+                                                     }
+                                                 }, Qt::QueuedConnection);
+                   });
+
+        int timeoutMs = definition ? definition->timeoutMs : 1000;
+        QTimer::singleShot(timeoutMs, this, [this, batch, index, call, cancelled, timeoutMs]()
+                           {
+                               cancelled->store(true);
+                               ToolResult result;
+                               result.callId = call.id;
+                               result.name = call.name;
+                               result.output = QString("timed out after %1 ms").arg(timeoutMs);
+                               result.latencyMs = timeoutMs;
+                               complete(batch, index, result);
+                           });
+    }
+
+    if (calls.isEmpty())
+    {
+        batches.remove(batch);
+        QTimer::singleShot(0, this, [this, batch]()
+                           { emit batchFinished(batch, QList<ToolResult>()); });
+    }
+    return batch;
+}
+
+void ToolExecutor::complete(int batch, int index, const ToolResult &result)
+{
+    auto it = batches.find(batch);
+    if (it == batches.end() || it->completed.at(index))
+    {
+        return; // the timeout or the worker already won
+    }
+    it->completed[index] = true;
+    it->results[index] = result;
+
+    Stats::instance()->add("tools.calls");
+    Stats::instance()->set("tools." + result.name + ".last_ms", result.latencyMs);
+    if (!result.ok)
+    {
+        Stats::instance()->add("tools.failures");
+    }
+    emit toolFinished(batch, result);
+
+    if (--it->remaining == 0)
+    {
+        QList<ToolResult> results = it->results;
+        batches.erase(it);
+        cancelFlags.erase(std::remove_if(cancelFlags.begin(), cancelFlags.end(), [](const auto &flag)
+                                         { return flag.use_count() == 1; }),
+                          cancelFlags.end());
+        emit batchFinished(batch, results);
+    }
+}
+
+// The server picks the paths, so tools only reach the directory of the file
+// open in the main window and what is below it. Symlinks are resolved first
+// so a link cannot lead out, and hidden entries (".ssh", ".env") are refused.
+// Empty with *error set if the path is not allowed.
+static QString confinedPath(const QString &requested, QString *error)
+{
+    QString openPath = ToolExecutor::openFilePath();
+    QString root = openPath.isEmpty() ? QString() : QFileInfo(openPath).canonicalPath();
+    if (root.isEmpty())
+    {
+        *error = "no file is open; tools only read next to the open file";
+        return QString();
+    }
+    QString path = QFileInfo(QDir(root), requested).canonicalFilePath();
+    if (path.isEmpty())
+    {
+        *error = "no such file or directory";
+        return QString();
+    }
+    if (path != root && !path.startsWith(root.endsWith('/') ? root : root + '/'))
+    {
+        *error = "outside the directory of the open file";
+        return QString();
+    }
+    if (path != root && ('/' + QDir(root).relativeFilePath(path)).contains("/."))
+    {
+        *error = "hidden files are not available to tools";
+        return QString();
+    }
+    return path;
+}
+
+// Runs on a pool thread
+QString ToolExecutor::execute(const ToolCall &call, const std::atomic<bool> &cancelled, bool *ok)
+{
+    *ok = false;
+    QJsonObject arguments = QJsonDocument::fromJson(call.arguments.toUtf8()).object();
+
+    if (call.name == "list_directory")
+    {
+        QString error;
+        QDir dir(confinedPath(arguments["path"].toString(), &error));
+        if (!error.isEmpty() || !dir.exists())
+        {
+            return error.isEmpty() ? "no such directory" : error;
+        }
+        QString output;
+        qsizetype outputBytes = 0;
+        const QFileInfoList entries = dir.entryInfoList(QDir::AllEntries | QDir::NoDotAndDotDot, QDir::DirsFirst | QDir::Name);
+        for (int i = 0; i < entries.size() && i < MaxDirectoryEntries && outputBytes < MaxOutputBytes && !cancelled; ++i)
+        {
+            const QFileInfo &entry = entries.at(i);
+            QString line = entry.isDir() ? entry.fileName() + "/\n" : QString("%1 %2\n").arg(entry.fileName()).arg(entry.size());
+            outputBytes += line.toUtf8().size();
+            output += line;
+        }
+        *ok = true;
+        return output;
+    }
+
+    if (call.name == "grep_file")
+    {
+        QRegularExpression pattern(arguments["pattern"].toString());
+        if (!pattern.isValid())
+        {
+            return "invalid pattern: " + pattern.errorString();
+        }
+        QString error;
+        QString path = confinedPath(arguments["path"].toString(), &error);
+        if (!error.isEmpty())
+        {
+            return error;
+        }
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+        {
+            return file.errorString();
+        }
+        QTextStream in(&file);
+        QString output;
+        qsizetype outputBytes = 0; // as sent: UTF-8
+        int lineNumber = 0;
+        int matches = 0;
+        QString line;
+        while (in.readLineInto(&line) && matches < MaxGrepMatches && outputBytes < MaxOutputBytes)
+        {
+            ++lineNumber;
+            if ((lineNumber & 1023) == 0 && cancelled)
+            {
+                return output + "cancelled\n";
+            }
+            if (pattern.match(line).hasMatch())
+            {
+                QString hit = QString::number(lineNumber) + ": " + line + '\n';
+                outputBytes += hit.toUtf8().size();
+                output += hit;
+                ++matches;
+            }
+        }
+        *ok = true;
+        return output;
+    }
+
+    if (call.name == "read_open_file")
+    {
+        QString path = openFilePath();
+        if (path.isEmpty())
+        {
+            return "no file is open";
+        }
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly))
+        {
+            return file.errorString();
+        }
+        file.seek(arguments["offset"].toInteger());
+        qint64 length = qBound<qint64>(1, arguments["length"].toInteger(MaxOutputBytes), MaxOutputBytes);
+        *ok = true;
+        return QString::fromUtf8(file.read(length));
+    }
+
+    return "unknown tool: " + call.name;
+}
@@ -0,0 +1,54 @@
+#ifndef TOOLEXECUTOR_H
+#define TOOLEXECUTOR_H
+
+#include <QObject>
+#include <QHash>
+#include <QJsonArray>
+#include <QThreadPool>
+#include <atomic>
+#include <memory>
+#include "chatclient.h"
+
+// Runs the local tools a reply asks for. Calls in one batch are independent,
+// so they run concurrently on a small pool, each with its own timeout.
+// toolFinished() reports every result as soon as it is ready. Paths given by
+// the server are confined to the directory of the file open in MainWindow.
+class ToolExecutor : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ToolExecutor(QObject *parent = nullptr);
+    ~ToolExecutor() override;
+
+    // Tool descriptions, advertised with requests that set ChatRequest::tools
+    static QJsonArray definitions();
+    // The file MainWindow has open, for read_open_file
+    static void setOpenFilePath(const QString &path);
+    static QString openFilePath();
+
+    // Starts a batch and returns its id
+    int run(const QList<ToolCall> &calls);
+
+signals:
+    void toolFinished(int batch, const ToolResult &result);
+    void batchFinished(int batch, const QList<ToolResult> &results);
+
+private:
+    struct Batch
+    {
+        QList<ToolResult> results;
+        QList<bool> completed;
+        int remaining = 0;
+    };
+
+    static QString execute(const ToolCall &call, const std::atomic<bool> &cancelled, bool *ok);
+    void complete(int batch, int index, const ToolResult &result);
+
+    QThreadPool pool;
+    QHash<int, Batch> batches;
+    QList<std::shared_ptr<std::atomic<bool>>> cancelFlags;
+    int nextBatch = 0;
+};
+
+#endif // TOOLEXECUTOR_H
@@ -0,0 +1,176 @@
+#include "transcriptexporter.h"
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+
+static const int FlushBytes = 256 * 1024;
+static const int ProgressIntervalMs = 100;
+
+TranscriptExporter::TranscriptExporter(const QString &target, QObject *parent)
+    : QObject(parent), target(target)
+{
+}
+
+TranscriptExporter::~TranscriptExporter()
+{
+    if (worker)
+    {
+        cancelled = true;
+        worker->wait();
+    }
+}
+
+TranscriptExporter::Format TranscriptExporter::formatFor(const QString &fileName)
+{
+    QString suffix = QFileInfo(fileName).suffix().toLower();
+    if (suffix == "jsonl" || suffix == "json")
+    {
+        return JsonLines;
+    }
+    if (suffix == "html" || suffix == "htm")
+    {
+        return Html;
+    }
+    return Markdown;
+}
+
+void TranscriptExporter::start()
+{
+    TranscriptStore *store = TranscriptStore::instance();
+    if (!store->isIndexed())
+    {
+        // Earlier sessions are still being scanned; export once they are known
+        connect(store, &TranscriptStore::indexed, this, &TranscriptExporter::start, Qt::SingleShotConnection);
+        return;
+    }
+
+    // The index copy holds offsets only (12 bytes per message), never text
+    TranscriptStore::Index index = store->snapshotIndex();
+    QString source = store->fileName();
+    QString chunkSource = store->chunkFileName();
+    worker = QThread::create([this, index, source, chunkSource]()
+                             { run(index, source, chunkSource); });
+    connect(worker, &QThread::finished, worker, &QObject::deleteLater);
+    connect(worker, &QThread::finished, this, [this]()
+            { worker = nullptr; });
+    worker->start(QThread::LowPriority);
+}
+
+static QByteArray roleLabel(const ChatMessage &message)
+{
+    return message.role == "user" ? "You" : "ChatGPT";
+}
+
+// Runs on the worker thread; signals reach the GUI as queued connections
+void TranscriptExporter::run(const TranscriptStore::Index &index, const QString &source, const QString &chunkSource)
+{
+    Format format = formatFor(target);
+    qint64 total = 0;
+    for (const auto &locations : index)
+    {
+        total += locations.size();
+    }
+
+    QFile input(source);
+    QFile chunks(chunkSource);
+    chunks.open(QIODevice::ReadOnly);
+    QSaveFile output(target);
+    if (!input.open(QIODevice::ReadOnly) || !output.open(QIODevice::WriteOnly))
+    {
+        emit finished(false, input.isOpen() ? output.errorString() : input.errorString());
+        return;
+    }
+
+    QByteArray buffer;
+    buffer.reserve(FlushBytes + 64 * 1024);
+    if (format == Html)
+    {
+        buffer += "<!DOCTYPE html>\n<html><head><meta charset=\"utf-8\"><title>Conversations</title>\n"
+                  "<style>body{font-family:sans-serif;max-width:60em;margin:auto}"
+                  ".user{background:#eef}.assistant{background:#efe}"
+                  "pre{white-space:pre-wrap;padding:.5em}</style></head><body>\n";
+    }
+
+    qint64 done = 0;
+    QElapsedTimer sinceProgress;
+    sinceProgress.start();
+    for (auto it = index.constBegin(); it != index.constEnd(); ++it)
+    {
+        QByteArray conversation = it.key().toByteArray(QUuid::WithoutBraces);
+        if (format == Markdown)
+        {
+            buffer += "# Conversation " + conversation + "\n\n";
+        }
+        else if (format == Html)
+        {
+            buffer += "<section><h2>Conversation " + conversation + "</h2>\n";
+        }
+
+        for (const TranscriptStore::Location &location : it.value())
+        {
+            if (cancelled)
+            {
+                output.cancelWriting();
+                emit finished(false, QString());
+                return;
+            }
+
+            ChatMessage message = TranscriptStore::readMessage(input, location, &chunks);
+            QByteArray time = QDateTime::fromMSecsSinceEpoch(message.timestamp).toString(Qt::ISODate).toUtf8();
+            switch (format)
+            {
+            case Markdown:
+                buffer += "**" + roleLabel(message) + "** (" + time + "):\n\n" + message.text.toUtf8() + "\n\n";
+                break;
+            case JsonLines:
+            {
+                QJsonObject record;
+                record["conversation"] = QString::fromLatin1(conversation);
+                record["id"] = QString::number(message.id);
+                record["role"] = message.role;
+                record["timestamp"] = message.timestamp;
+                record["text"] = message.text;
+                buffer += QJsonDocument(record).toJson(QJsonDocument::Compact) + '\n';
+                break;
+            }
+            case Html:
+                buffer += "<div class=\"" + message.role.toHtmlEscaped().toUtf8() + "\"><b>" + roleLabel(message) + "</b> " + time +
+                          "<pre>" + message.text.toHtmlEscaped().toUtf8() + "</pre></div>\n";
+                break;
+            }
+
+            ++done;
+            if (buffer.size() >= FlushBytes)
+            {
+                output.write(buffer);
+                buffer.clear();
+            }
+            if (sinceProgress.elapsed() >= ProgressIntervalMs)
+            {
+                sinceProgress.restart();
+                emit progress(done, total);
+            }
+        }
+
+        if (format == Html)
+        {
+            buffer += "</section>\n";
+        }
+    }
+
+    if (format == Html)
+    {
+        buffer += "</body></html>\n";
+    }
+    output.write(buffer);
+    emit progress(done, total);
+    if (!output.commit())
+    {
+        emit finished(false, output.errorString());
+        return;
+    }
+    emit finished(true, QString());
+}
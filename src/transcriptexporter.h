@@ -0,0 +1,45 @@
+#ifndef TRANSCRIPTEXPORTER_H
+#define TRANSCRIPTEXPORTER_H
+
+#include <QObject>
+#include <QThread>
+#include <atomic>
+#include "transcriptstore.h"
+
+// Writes every conversation in the transcript store to Markdown, JSON Lines
+// or HTML (chosen by the file suffix). Runs on its own thread and streams one
+// message at a time from the store's file, so memory does not grow with the
+// size of the history. The output only replaces the target once complete.
+class TranscriptExporter : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Format
+    {
+        Markdown,
+        JsonLines,
+        Html
+    };
+
+    explicit TranscriptExporter(const QString &target, QObject *parent = nullptr);
+    ~TranscriptExporter() override;
+
+    static Format formatFor(const QString &fileName);
+
+    void start();
+    void cancel() { cancelled = true; }
+
+signals:
+    void progress(qint64 done, qint64 total);
+    void finished(bool ok, const QString &error); // error is empty when cancelled
+
+private:
+    void run(const TranscriptStore::Index &index, const QString &source, const QString &chunkSource);
+
+    QString target;
+    QThread *worker = nullptr;
+    std::atomic<bool> cancelled{false};
+};
+
+#endif // TRANSCRIPTEXPORTER_H
@@ -0,0 +1,398 @@
+#include "transcriptimporter.h"
+#include "alloctracker.h"
+#include "bytescan.h"
+#include "stats.h"
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QPointer>
+#include <QThread>
+
+static const qint64 RangeBytes = 32 * 1024 * 1024;
+
+static const char *findNewline(const char *p, const char *end)
+{
+    return ByteScan::find(p, end, '\n');
+}
+
+// The closing quote of a string, or the first escape inside it
+static const char *findQuoteOrEscape(const char *p, const char *end)
+{
+    while (end - p >= 8)
+    {
+        quint64 word = ByteScan::load(p);
+        quint64 mask = ByteScan::matchBytes(word, '"') | ByteScan::matchBytes(word, '\\');
+        if (mask)
+        {
+            return p + ByteScan::firstMatch(mask);
+        }
+        p += 8;
+    }
+    while (p < end && *p != '"' && *p != '\\')
+    {
+        ++p;
+    }
+    return p;
+}
+
+static inline const char *skipSpace(const char *p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+    {
+        ++p;
+    }
+    return p;
+}
+
+enum class LineResult
+{
+    Parsed,
+    Fallback, // valid JSON may still follow; needs the full parser
+    Invalid
+};
+
+// Fast path for flat objects whose strings contain no escapes, which covers
+// most lines of an export. Anything else is left to QJsonDocument.
+static LineResult parseFlatObject(const char *p, const char *end, ChatMessage &message, bool &hasText)
+{
+    if (p == end || *p != '{')
+    {
+        return LineResult::Invalid;
+    }
+    p = skipSpace(p + 1, end);
+    while (p < end && *p == '"')
+    {
+        const char *keyEnd = findQuoteOrEscape(p + 1, end);
+        if (keyEnd == end || *keyEnd == '\\')
+        {
+            return keyEnd == end ? LineResult::Invalid : LineResult::Fallback;
+        }
+        QByteArrayView key(p + 1, keyEnd - p - 1);
+        p = skipSpace(keyEnd + 1, end);
+        if (p == end || *p != ':')
+        {
+            return LineResult::Invalid;
+        }
+        p = skipSpace(p + 1, end);
+        if (p == end)
+        {
+            return LineResult::Invalid;
+        }
+
+        QByteArrayView value;
+        bool isString = *p == '"';
+        if (isString)
+        {
+            const char *valueEnd = findQuoteOrEscape(p + 1, end);
+            if (valueEnd == end || *valueEnd == '\\')
+            {
+                return valueEnd == end ? LineResult::Invalid : LineResult::Fallback;
+            }
+            value = QByteArrayView(p + 1, valueEnd - p - 1);
+            p = valueEnd + 1;
+        }
+        else if (*p == '{' || *p == '[')
+        {
+            return LineResult::Fallback;
+        }
+        else
+        {
+            const char *valueEnd = p;
+            while (valueEnd < end && *valueEnd != ',' && *valueEnd != '}' && *valueEnd != ' ')
+            {
+                ++valueEnd;
+            }
+            value = QByteArrayView(p, valueEnd - p);
+            p = valueEnd;
+        }
+
+        if (key == "text" && isString)
+        {
+            message.text = QString::fromUtf8(value);
+            hasText = true;
+        }
+        else if (key == "role" && isString)
+        {
+            message.role = QString::fromUtf8(value);
+        }
+        else if (key == "conversation" && isString)
+        {
+            message.conversation = QUuid::fromString(QLatin1StringView(value));
+        }
+        else if (key == "timestamp" && !isString)
+        {
+            message.timestamp = value.toLongLong();
+        }
+
+        p = skipSpace(p, end);
+        if (p < end && *p == ',')
+        {
+            p = skipSpace(p + 1, end);
+            continue;
+        }
+        return p < end && *p == '}' ? LineResult::Parsed : LineResult::Invalid;
+    }
+    return LineResult::Invalid;
+}
+
+static bool parseWithQt(const char *p, const char *end, ChatMessage &message, bool &hasText)
+{
+    QJsonParseError error;
+    QJsonDocument document = QJsonDocument::fromJson(QByteArray::fromRawData(p, end - p), &error);
+    if (error.error != QJsonParseError::NoError || !document.isObject())
+    {
+        return false;
+    }
+    QJsonObject object = document.object();
+    if (object.contains("text"))
+    {
+        message.text = object.value("text").toString();
+        hasText = true;
+    }
+    if (object.contains("role"))
+    {
+        message.role = object.value("role").toString();
+    }
+    if (object.contains("conversation"))
+    {
+        message.conversation = QUuid::fromString(object.value("conversation").toString());
+    }
+    if (object.contains("timestamp"))
+    {
+        message.timestamp = object.value("timestamp").toInteger();
+    }
+    return true;
+}
+
+int TranscriptImporter::parseRange(const char *data, qint64 size, qint64 begin, qint64 end,
+                                   const QUuid &defaultConversation, TranscriptStore::Batch &batch)
+{
+    AllocScope scope(AllocTracker::Parsing);
+    const char *fileEnd = data + size;
+    const char *p = data + begin;
+    // A line straddling our start belongs to the previous range
+    if (begin > 0 && p[-1] != '\n')
+    {
+        p = findNewline(p, fileEnd);
+        p = p < fileEnd ? p + 1 : p;
+    }
+
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    int skipped = 0;
+    while (p < data + end)
+    {
+        const char *lineEnd = findNewline(p, fileEnd);
+        const char *next = lineEnd < fileEnd ? lineEnd + 1 : lineEnd;
+
+        // Also accept an array written one object per line: "[{...},"
+        const char *first = p;
+        while (first < lineEnd && (*first == ' ' || *first == '\t' || *first == '[' || *first == ','))
+        {
+            ++first;
+        }
+        const char *last = lineEnd;
+        while (last > first && (last[-1] == ' ' || last[-1] == '\t' || last[-1] == '\r' || last[-1] == ',' || last[-1] == ']'))
+        {
+            --last;
+        }
+        p = next;
+        if (first == last)
+        {
+            continue;
+        }
+
+        ChatMessage message;
+        message.role = "user";
+        message.timestamp = now;
+        bool hasText = false;
+        LineResult result = parseFlatObject(first, last, message, hasText);
+        if (result == LineResult::Fallback)
+        {
+            message = ChatMessage();
+            message.role = "user";
+            message.timestamp = now;
+            hasText = false;
+            result = parseWithQt(first, last, message, hasText) ? LineResult::Parsed : LineResult::Invalid;
+        }
+        if (result != LineResult::Parsed || !hasText)
+        {
+            ++skipped;
+            continue;
+        }
+        if (message.conversation.isNull())
+        {
+            message.conversation = defaultConversation;
+        }
+        TranscriptStore::addToBatch(batch, message);
+    }
+    return skipped;
+}
+
+TranscriptImporter::TranscriptImporter(const QString &source, QObject *parent)
+    : QObject(parent), file(source), defaultConversation(QUuid::createUuid())
+{
+    pool.setMaxThreadCount(QThread::idealThreadCount());
+    writer.setMaxThreadCount(1);
+    // Enough to keep every parser busy while one batch is written; each is about RangeBytes
+    maxInFlight = pool.maxThreadCount() + 2;
+}
+
+TranscriptImporter::~TranscriptImporter()
+{
+    // Workers read the mapping, so it must outlive them
+    cancelled = true;
+    pool.waitForDone();
+    writer.waitForDone();
+}
+
+bool TranscriptImporter::canImport(const QString &fileName)
+{
+    QString suffix = QFileInfo(fileName).suffix().toLower();
+    return suffix == "jsonl" || suffix == "json";
+}
+
+void TranscriptImporter::start()
+{
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        emit finished(false, file.errorString());
+        return;
+    }
+    size = file.size();
+    data = size > 0 ? reinterpret_cast<const char *>(file.map(0, size)) : nullptr;
+    if (!data)
+    {
+        emit finished(false, size > 0 ? file.errorString() : tr("The file is empty"));
+        return;
+    }
+
+    clock.start();
+    rangeCount = int((size + RangeBytes - 1) / RangeBytes);
+    startRanges();
+}
+
+void TranscriptImporter::startRanges()
+{
+    QPointer<TranscriptImporter> guard(this);
+    // Started in file order, so workers finish roughly in order; a new range
+    // starts only when a batch has been written
+    for (; started < rangeCount && started - written < maxInFlight && !cancelled; ++started)
+    {
+        int range = started;
+        qint64 begin = range * RangeBytes;
+        qint64 end = qMin(size, begin + RangeBytes);
+        pool.start([this, guard, range, begin, end]()
+                   {
+                       Parsed parsed;
+                       QElapsedTimer busy;
+                       busy.start();
+                       if (!cancelled)
+                       {
+                           parsed.skipped = parseRange(data, size, begin, end, defaultConversation, parsed.batch);
+                       }
+                       qint64 busyNs = busy.nsecsElapsed();
+                       QMetaObject::invokeMethod(qApp, [guard, range, parsed, busyNs]()
+                                                 {
+                                                     if (guard)
+                                                     {
+                                                         guard->onRangeParsed(range, parsed, busyNs);
+                                                     }
+                                                 }, Qt::QueuedConnection);
+                   });
+    }
+}
+
+void TranscriptImporter::onRangeParsed(int range, const Parsed &parsed, qint64 rangeBusyNs)
+{
+    // Every started range reports back, even after a cancel (it then skips the
+    // parse), so the mapping is released only once no worker can touch it
+    ++received;
+    if (cancelled)
+    {
+        if (received == started && written == nextRange)
+        {
+            finish();
+        }
+        return;
+    }
+    busyNs += rangeBusyNs;
+    waiting.insert(range, parsed);
+    QPointer<TranscriptImporter> guard(this);
+    TranscriptStore *store = TranscriptStore::instance();
+    while (waiting.contains(nextRange))
+    {
+        Parsed ready = waiting.take(nextRange);
+        skipped += ready.skipped;
+        ++nextRange;
+        writer.start([guard, store, batch = std::move(ready.batch)]() mutable
+                     {
+                         store->writeBatch(batch);
+                         QMetaObject::invokeMethod(qApp, [guard, batch]()
+                                                   {
+                                                       if (guard)
+                                                       {
+                                                           guard->onBatchWritten(batch);
+                                                       }
+                                                   }, Qt::QueuedConnection);
+                     });
+    }
+}
+
+void TranscriptImporter::onBatchWritten(const TranscriptStore::Batch &batch)
+{
+    // Written, so readable even if the import was cancelled meanwhile
+    TranscriptStore::instance()->indexBatch(batch);
+    messages += batch.messages;
+    ++written;
+    if (cancelled)
+    {
+        if (received == started && written == nextRange)
+        {
+            finish();
+        }
+        return;
+    }
+    emit progress(qMin(size, written * RangeBytes), size);
+    if (written == rangeCount)
+    {
+        finish();
+        return;
+    }
+    startRanges();
+}
+
+void TranscriptImporter::finish()
+{
+    if (!data)
+    {
+        return; // already finished
+    }
+    wallNs = clock.nsecsElapsed();
+    file.unmap(reinterpret_cast<uchar *>(const_cast<char *>(data)));
+    data = nullptr;
+    waiting.clear();
+
+    if (cancelled)
+    {
+        emit finished(false, QString());
+        return;
+    }
+    Stats::instance()->add("import.messages", messages);
+    Stats::instance()->add("import.skipped_lines", skipped);
+    Stats::instance()->set("import.mb_per_s", qRound64(megabytesPerSecond()));
+    Stats::instance()->set("import.mb_per_s_per_core", qRound64(megabytesPerSecondPerCore()));
+    emit finished(true, QString());
+}
+
+double TranscriptImporter::megabytesPerSecond() const
+{
+    return wallNs > 0 ? size / 1e6 / (wallNs / 1e9) : 0;
+}
+
+// Parse throughput of one worker: bytes over the CPU time all workers spent
+double TranscriptImporter::megabytesPerSecondPerCore() const
+{
+    return busyNs > 0 ? size / 1e6 / (busyNs / 1e9) : 0;
+}
@@ -0,0 +1,81 @@
+#ifndef TRANSCRIPTIMPORTER_H
+#define TRANSCRIPTIMPORTER_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMap>
+#include <QThreadPool>
+#include <atomic>
+#include "transcriptstore.h"
+
+// Loads a chat-history export (JSON Lines, one message object per line, as
+// written by TranscriptExporter) into the transcript store. The file is
+// memory-mapped and cut into fixed-size ranges that are parsed in parallel;
+// each parsed range becomes one TranscriptStore batch, and batches are
+// written in file order, on a writer thread, so conversations keep their
+// message order. Only a few ranges are in flight at a time, so parsed
+// batches cannot pile up in memory when the disk is slower than the parsers.
+class TranscriptImporter : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit TranscriptImporter(const QString &source, QObject *parent = nullptr);
+    ~TranscriptImporter() override;
+
+    static bool canImport(const QString &fileName);
+
+    void start();
+    void cancel() { cancelled = true; }
+
+    // Parses every line that starts inside [begin, end) of data. Lines that are
+    // not message objects are counted in the return value and skipped.
+    static int parseRange(const char *data, qint64 size, qint64 begin, qint64 end,
+                          const QUuid &defaultConversation, TranscriptStore::Batch &batch);
+
+    int importedMessages() const { return messages; }
+    int skippedLines() const { return skipped; }
+    int threadCount() const { return pool.maxThreadCount(); }
+    double megabytesPerSecond() const;
+    double megabytesPerSecondPerCore() const;
+
+signals:
+    void progress(qint64 done, qint64 total);
+    void finished(bool ok, const QString &error); // error is empty when cancelled
+
+private:
+    struct Parsed
+    {
+        TranscriptStore::Batch batch;
+        int skipped = 0;
+    };
+
+    void startRanges();
+    void onRangeParsed(int range, const Parsed &parsed, qint64 busyNs);
+    void onBatchWritten(const TranscriptStore::Batch &batch);
+    void finish();
+
+    QFile file;
+    const char *data = nullptr;
+    qint64 size = 0;
+    QThreadPool pool;
+    QThreadPool writer; // one thread: batches reach the file in order
+    std::atomic<bool> cancelled{false};
+    QUuid defaultConversation; // for lines without a conversation field
+
+    int rangeCount = 0;
+    int maxInFlight = 0; // ranges started but not yet written
+    int started = 0;
+    int received = 0;
+    int nextRange = 0;         // ranges below this are handed to the writer
+    int written = 0;           // ranges below this are in the store
+    QMap<int, Parsed> waiting; // parsed ahead of nextRange
+    QElapsedTimer clock;
+    qint64 wallNs = 0;
+    qint64 busyNs = 0; // summed over workers
+    int messages = 0;
+    int skipped = 0;
+};
+
+#endif // TRANSCRIPTIMPORTER_H
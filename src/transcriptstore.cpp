@@ -0,0 +1,415 @@
+#include "transcriptstore.h"
+#include "alloctracker.h"
+#include "stats.h"
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QElapsedTimer>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QPointer>
+#include <QStandardPaths>
+#include <QThread>
+#include <QtEndian>
+#include <array>
+
+// Texts at least this long are split into content-defined chunks that are
+// stored once in chunks.dat; shorter ones stay inline in the record
+static const int DedupMinBytes = 4096;
+
+// FastCDC (Xia et al., 2016) with normalized chunking: 2 KB minimum, 8 KB
+// average, 64 KB maximum. A stricter mask before the average size and a
+// looser one after it narrow the spread of chunk sizes.
+static const int ChunkMin = 2048;
+static const int ChunkAverage = 8192;
+static const int ChunkMax = 65536;
+static const quint64 MaskStrict = 0x0000d9f003530000ULL; // 15 bits
+static const quint64 MaskLoose = 0x0000d90003530000ULL;  // 11 bits
+
+static const std::array<quint64, 256> gearTable = []()
+{
+    // splitmix64, so the table (and every cut point) is the same in every build
+    std::array<quint64, 256> table{};
+    quint64 state = 0x44304344;
+    for (quint64 &entry : table)
+    {
+        quint64 z = (state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        entry = z ^ (z >> 31);
+    }
+    return table;
+}();
+
+int TranscriptStore::chunkLength(const uchar *data, int size)
+{
+    if (size <= ChunkMin)
+    {
+        return size;
+    }
+    int limit = qMin(size, ChunkMax);
+    int normal = qMin(limit, ChunkAverage);
+    quint64 hash = 0;
+    int i = ChunkMin;
+    for (; i < normal; ++i)
+    {
+        hash = (hash << 1) + gearTable[data[i]];
+        if (!(hash & MaskStrict))
+        {
+            return i;
+        }
+    }
+    for (; i < limit; ++i)
+    {
+        hash = (hash << 1) + gearTable[data[i]];
+        if (!(hash & MaskLoose))
+        {
+            return i;
+        }
+    }
+    return limit;
+}
+
+// Record payload: id, conversation, role, timestamp, text. The fixed-size
+// head comes first so the index scan never has to decode text. A deduplicated
+// text is written as a null string followed by its chunk list.
+static QByteArray encodeMessage(const ChatMessage &message, const QVector<TranscriptStore::ChunkRef> *chunks = nullptr)
+{
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_6_0);
+    out << message.id << message.conversation << message.role << message.timestamp;
+    if (!chunks)
+    {
+        out << message.text;
+        return payload;
+    }
+    out << QString() << quint32(chunks->size());
+    for (const TranscriptStore::ChunkRef &chunk : *chunks)
+    {
+        out << chunk.offset << chunk.length;
+    }
+    return payload;
+}
+
+static ChatMessage decodeMessage(const QByteArray &payload, QFile *chunkFile)
+{
+    ChatMessage message;
+    QDataStream in(payload);
+    in.setVersion(QDataStream::Qt_6_0);
+    in >> message.id >> message.conversation >> message.role >> message.timestamp >> message.text;
+    if (in.atEnd() || !chunkFile)
+    {
+        return message;
+    }
+    quint32 count = 0;
+    in >> count;
+    QByteArray utf8;
+    for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i)
+    {
+        TranscriptStore::ChunkRef chunk;
+        in >> chunk.offset >> chunk.length;
+        if (chunkFile->seek(chunk.offset))
+        {
+            utf8 += chunkFile->read(chunk.length);
+        }
+    }
+    message.text = QString::fromUtf8(utf8);
+    return message;
+}
+
+TranscriptStore *TranscriptStore::instance()
+{
+    static TranscriptStore *store = new TranscriptStore(qApp);
+    return store;
+}
+
+TranscriptStore::TranscriptStore(QObject *parent) : QObject(parent)
+{
+    QString dir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+    QDir().mkpath(dir);
+    QString path = dir + "/transcripts.dat";
+    file.setFileName(path);
+    file.open(QIODevice::WriteOnly | QIODevice::Append);
+    reader.setFileName(path);
+    reader.open(QIODevice::ReadOnly);
+    QString chunkPath = dir + "/chunks.dat";
+    chunkFile.setFileName(chunkPath);
+    chunkFile.open(QIODevice::WriteOnly | QIODevice::Append);
+    chunkReader.setFileName(chunkPath);
+    chunkReader.open(QIODevice::ReadOnly);
+    scannedSize = file.size();
+    qint64 chunkLimit = chunkFile.size();
+    // Ids only need to be unique and increasing; seeding from the clock avoids
+    // waiting for the scan to learn the largest id on disk
+    nextId = quint64(QDateTime::currentMSecsSinceEpoch()) * 1000;
+
+    QPointer<TranscriptStore> guard(this);
+    qint64 limit = scannedSize;
+    QThread *scanner = QThread::create([guard, path, limit, chunkPath, chunkLimit]()
+                                       {
+                                           Index scanned;
+                                           ChunkIndex chunks = scanChunks(chunkPath, chunkLimit);
+                                           QFile input(path);
+                                           if (input.open(QIODevice::ReadOnly) && limit > 0)
+                                           {
+                                               const uchar *data = input.map(0, limit);
+                                               qint64 offset = 0;
+                                               while (data && offset + 4 + 24 <= limit)
+                                               {
+                                                   quint32 length = qFromBigEndian<quint32>(data + offset);
+                                                   if (offset + 4 + length > limit)
+                                                   {
+                                                       break; // torn tail
+                                                   }
+                                                   // Head only: skip the id (8 bytes), read the conversation (16 bytes)
+                                                   QUuid conversation = QUuid::fromRfc4122(QByteArrayView(data + offset + 4 + 8, 16));
+                                                   scanned[conversation].append(Location{offset + 4, length});
+                                                   offset += 4 + length;
+                                               }
+                                           }
+                                           QMetaObject::invokeMethod(qApp, [guard, scanned, chunks]()
+                                                                     {
+                                                                         if (guard)
+                                                                         {
+                                                                             guard->onScanFinished(scanned, chunks);
+                                                                         }
+                                                                     }, Qt::QueuedConnection);
+                                       });
+    connect(scanner, &QThread::finished, scanner, &QObject::deleteLater);
+    scanner->start(QThread::LowPriority);
+}
+
+// Chunk file records: length, 16-byte hash, UTF-8 bytes
+TranscriptStore::ChunkIndex TranscriptStore::scanChunks(const QString &path, qint64 limit)
+{
+    ChunkIndex chunks;
+    QFile input(path);
+    const uchar *data = input.open(QIODevice::ReadOnly) && limit > 0 ? input.map(0, limit) : nullptr;
+    qint64 offset = 0;
+    while (data && offset + 4 + ChunkHashBytes <= limit)
+    {
+        quint32 length = qFromBigEndian<quint32>(data + offset);
+        qint64 start = offset + 4 + ChunkHashBytes;
+        if (start + length > limit)
+        {
+            break; // torn tail
+        }
+        QByteArray hash(reinterpret_cast<const char *>(data + offset + 4), ChunkHashBytes);
+        chunks.insert(hash, ChunkRef{start, length});
+        offset = start + length;
+    }
+    return chunks;
+}
+
+void TranscriptStore::onScanFinished(const Index &scanned, const ChunkIndex &chunks)
+{
+    // Chunks written before the scan finished are kept; duplicates are harmless
+    for (auto it = chunks.constBegin(); it != chunks.constEnd(); ++it)
+    {
+        chunkIndex.insert(it.key(), it.value());
+    }
+    index = scanned;
+    indexReady = true;
+    emit indexed();
+}
+
+quint64 TranscriptStore::append(const QUuid &conversation, const QString &role, const QString &text)
+{
+    QMutexLocker locker(&writeMutex);
+    ChatMessage message;
+    message.id = nextId++;
+    message.conversation = conversation;
+    message.role = role;
+    message.timestamp = QDateTime::currentMSecsSinceEpoch();
+    message.text = text;
+
+    QByteArray utf8 = text.toUtf8();
+    QByteArray payload;
+    if (utf8.size() >= DedupMinBytes && chunkFile.isOpen())
+    {
+        QVector<ChunkRef> chunks = storeChunks(utf8);
+        payload = encodeMessage(message, &chunks);
+    }
+    else
+    {
+        payload = encodeMessage(message);
+    }
+    quint32 length = qToBigEndian<quint32>(payload.size());
+    qint64 offset = file.size();
+    file.write(reinterpret_cast<const char *>(&length), sizeof(length));
+    file.write(payload);
+    file.flush();
+
+    sessionIndex[conversation].append(Location{offset + qint64(sizeof(length)), quint32(payload.size())});
+    return message.id;
+}
+
+QVector<TranscriptStore::ChunkRef> TranscriptStore::storeChunks(const QByteArray &utf8)
+{
+    QElapsedTimer timer;
+    timer.start();
+    QVector<ChunkRef> refs;
+    qint64 written = 0;
+    const uchar *data = reinterpret_cast<const uchar *>(utf8.constData());
+    for (int position = 0; position < utf8.size();)
+    {
+        int length = chunkLength(data + position, utf8.size() - position);
+        QByteArrayView chunk(data + position, length);
+        QByteArray hash = QCryptographicHash::hash(chunk, QCryptographicHash::Blake2b_128);
+        auto known = chunkIndex.constFind(hash);
+        if (known != chunkIndex.constEnd())
+        {
+            refs.append(known.value());
+        }
+        else
+        {
+            quint32 bigLength = qToBigEndian<quint32>(length);
+            qint64 start = chunkFile.size() + 4 + ChunkHashBytes;
+            chunkFile.write(reinterpret_cast<const char *>(&bigLength), sizeof(bigLength));
+            chunkFile.write(hash);
+            chunkFile.write(chunk.data(), length);
+            ChunkRef ref{start, quint32(length)};
+            chunkIndex.insert(hash, ref);
+            refs.append(ref);
+            written += 4 + ChunkHashBytes + length;
+        }
+        position += length;
+    }
+    chunkFile.flush();
+
+    // Ratio of text bytes to bytes actually written for them (chunks and refs)
+    Stats *stats = Stats::instance();
+    stats->add("transcript.dedup.logical_bytes", utf8.size());
+    stats->add("transcript.dedup.stored_bytes", written + refs.size() * 12);
+    stats->add("transcript.dedup.write_ns", timer.nsecsElapsed());
+    stats->set("transcript.dedup.ratio_x100", 100 * stats->value("transcript.dedup.logical_bytes") /
+                                                  qMax<qint64>(1, stats->value("transcript.dedup.stored_bytes")));
+    stats->set("transcript.dedup.write_mb_per_s", stats->value("transcript.dedup.logical_bytes") * 1000 /
+                                                      qMax<qint64>(1, stats->value("transcript.dedup.write_ns")));
+    return refs;
+}
+
+void TranscriptStore::addToBatch(Batch &batch, const ChatMessage &message)
+{
+    QByteArray payload = encodeMessage(message);
+    quint32 length = qToBigEndian<quint32>(payload.size());
+    batch.index[message.conversation].append(Location{batch.data.size() + qint64(sizeof(length)), quint32(payload.size())});
+    batch.data.append(reinterpret_cast<const char *>(&length), sizeof(length));
+    batch.data.append(payload);
+    ++batch.messages;
+}
+
+void TranscriptStore::writeBatch(Batch &batch)
+{
+    AllocScope scope(AllocTracker::Transcript);
+    QMutexLocker locker(&writeMutex);
+    // The id is the first field of every payload; patch them in file order
+    char *data = batch.data.data();
+    qint64 offset = 0;
+    while (offset + 4 + 8 <= batch.data.size())
+    {
+        quint32 length = qFromBigEndian<quint32>(data + offset);
+        qToBigEndian<quint64>(nextId++, data + offset + 4);
+        offset += 4 + length;
+    }
+
+    qint64 base = file.size();
+    file.write(batch.data);
+    file.flush();
+    locker.unlock();
+    for (auto it = batch.index.begin(); it != batch.index.end(); ++it)
+    {
+        for (Location &location : it.value())
+        {
+            location.offset += base;
+        }
+    }
+}
+
+void TranscriptStore::indexBatch(const Batch &batch)
+{
+    for (auto it = batch.index.constBegin(); it != batch.index.constEnd(); ++it)
+    {
+        QVector<Location> &locations = sessionIndex[it.key()];
+        locations.reserve(locations.size() + it.value().size());
+        locations += it.value();
+    }
+}
+
+const QVector<TranscriptStore::Location> *TranscriptStore::locations(const QUuid &conversation, QVector<Location> &merged) const
+{
+    auto scanned = index.constFind(conversation);
+    auto session = sessionIndex.constFind(conversation);
+    if (session == sessionIndex.constEnd())
+    {
+        return scanned == index.constEnd() ? nullptr : &scanned.value();
+    }
+    if (scanned == index.constEnd())
+    {
+        return &session.value();
+    }
+    merged = scanned.value() + session.value();
+    return &merged;
+}
+
+int TranscriptStore::count(const QUuid &conversation) const
+{
+    return index.value(conversation).size() + sessionIndex.value(conversation).size();
+}
+
+QList<ChatMessage> TranscriptStore::messages(const QUuid &conversation, int first, int count) const
+{
+    QList<ChatMessage> result;
+    QVector<Location> merged;
+    const QVector<Location> *all = locations(conversation, merged);
+    if (!all)
+    {
+        return result;
+    }
+    int last = qMin(first + count, int(all->size()));
+    QElapsedTimer timer;
+    timer.start();
+    qint64 bytes = 0;
+    for (int i = qMax(first, 0); i < last; ++i)
+    {
+        result.append(readMessage(reader, all->at(i), &chunkReader));
+        bytes += result.last().text.size() * sizeof(QChar);
+    }
+    Stats *stats = Stats::instance();
+    stats->add("transcript.read_bytes", bytes);
+    stats->add("transcript.read_ns", timer.nsecsElapsed());
+    stats->set("transcript.read_mb_per_s", stats->value("transcript.read_bytes") * 1000 /
+                                               qMax<qint64>(1, stats->value("transcript.read_ns")));
+    return result;
+}
+
+ChatMessage TranscriptStore::readMessage(QFile &input, const Location &location, QFile *chunks)
+{
+    AllocScope scope(AllocTracker::Transcript);
+    input.seek(location.offset);
+    return decodeMessage(input.read(location.length), chunks);
+}
+
+TranscriptStore::Index TranscriptStore::snapshotIndex() const
+{
+    Index merged = index;
+    for (auto it = sessionIndex.constBegin(); it != sessionIndex.constEnd(); ++it)
+    {
+        merged[it.key()] += it.value();
+    }
+    return merged;
+}
+
+QList<QUuid> TranscriptStore::conversations() const
+{
+    QList<QUuid> result = index.keys();
+    for (auto it = sessionIndex.constBegin(); it != sessionIndex.constEnd(); ++it)
+    {
+        if (!index.contains(it.key()))
+        {
+            result.append(it.key());
+        }
+    }
+    return result;
+}
@@ -0,0 +1,105 @@
+#ifndef TRANSCRIPTSTORE_H
+#define TRANSCRIPTSTORE_H
+
+#include <QObject>
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QUuid>
+#include <QVector>
+
+struct ChatMessage
+{
+    quint64 id = 0;
+    QUuid conversation;
+    QString role; // "user" or "assistant"
+    qint64 timestamp = 0; // ms since epoch
+    QString text;
+};
+
+// Every conversation's messages, in one append-only file of length-prefixed
+// records. Only a per-conversation index of record offsets is kept in memory;
+// message text is read from disk on demand. Long texts are split into
+// content-defined chunks kept once each in a second file, so code blocks and
+// logs repeated across messages are stored once. The index of earlier sessions is
+// built on a background thread at startup, so opening the store is instant.
+class TranscriptStore : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Location
+    {
+        qint64 offset;
+        quint32 length;
+    };
+    using Index = QHash<QUuid, QVector<Location>>;
+    // Where a deduplicated text chunk's bytes are in chunks.dat
+    struct ChunkRef
+    {
+        qint64 offset;
+        quint32 length;
+    };
+
+    static TranscriptStore *instance();
+
+    quint64 append(const QUuid &conversation, const QString &role, const QString &text);
+
+    // False until the background scan of earlier sessions is done
+    bool isIndexed() const { return indexReady; }
+    int count(const QUuid &conversation) const;
+    QList<ChatMessage> messages(const QUuid &conversation, int first, int count) const;
+    QList<QUuid> conversations() const;
+
+    // For readers on other threads: the files, a copy of the offset index, and
+    // a way to decode one record from their own handles to the files. Long
+    // texts are only readable when chunks (chunkFileName()) is given.
+    QString fileName() const { return file.fileName(); }
+    QString chunkFileName() const { return chunkFile.fileName(); }
+    Index snapshotIndex() const;
+    static ChatMessage readMessage(QFile &input, const Location &location, QFile *chunks = nullptr);
+
+    // Length of the first content-defined chunk of data (FastCDC)
+    static int chunkLength(const uchar *data, int size);
+
+    // Bulk loading: records are framed into a batch on any thread and written
+    // with one writeBatch() call, also on any thread but one batch at a time.
+    // That assigns the ids and turns the batch-relative offsets in the index
+    // into file offsets; indexBatch() then makes the messages readable.
+    struct Batch
+    {
+        QByteArray data;
+        Index index;
+        int messages = 0;
+    };
+    static void addToBatch(Batch &batch, const ChatMessage &message);
+    void writeBatch(Batch &batch);
+    void indexBatch(const Batch &batch); // GUI thread
+
+signals:
+    void indexed();
+
+private:
+    static const int ChunkHashBytes = 16; // BLAKE2b-128
+    using ChunkIndex = QHash<QByteArray, ChunkRef>;
+
+    explicit TranscriptStore(QObject *parent = nullptr);
+    static ChunkIndex scanChunks(const QString &path, qint64 limit);
+    void onScanFinished(const Index &scanned, const ChunkIndex &chunks);
+    QVector<ChunkRef> storeChunks(const QByteArray &utf8);
+    const QVector<Location> *locations(const QUuid &conversation, QVector<Location> &merged) const;
+
+    QMutex writeMutex; // file and nextId, shared with writeBatch() callers
+    QFile file;
+    mutable QFile reader;
+    QFile chunkFile; // each distinct chunk of long texts, once
+    mutable QFile chunkReader;
+    ChunkIndex chunkIndex; // chunk hash -> location
+    qint64 scannedSize = 0; // records below this offset are indexed by the scan
+    bool indexReady = false;
+    quint64 nextId;
+    Index index;        // from the scan
+    Index sessionIndex; // appended since startup
+};
+
+#endif // TRANSCRIPTSTORE_H